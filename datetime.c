@@ -5,46 +5,163 @@
 #include "datetime.h"
 
 #include <stdbool.h>
+#include <stddef.h>
 
 
 #define SECONDS_PER_HOUR 3600UL
 #define SECONDS_PER_DAY (24UL * SECONDS_PER_HOUR)
-#define NONLEAP_DAYS 365
 #define DAYS_PER_FOUR_YEARS (3 * 365 + 366)
 
+// Day of 1/3/2100 since 1/1/<ref year>. 2100 is not a leap year; the other
+// years divisible by 4 in the range of the day count (until 2149) are.
+#define MARCH_2100_DAYS 47541U
+#define CENTISECS_PER_DAY (100UL * SECONDS_PER_DAY)
+
 // Definition of extern variables
-int32_t utc_offset_secs;
-struct dst_date dst_start;
-struct dst_date dst_end;
+const struct tz_rule *tz_rules;
+uint8_t tz_rule_count;
 
 struct datetime local_time;
 
-// Day count for non-leap and leap years
-static const uint8_t month_days[2][12]  = {
-    { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 },
-    { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 }
+// Timestamp corresponding to local_time
+static uint16_t cur_tstamp_days;
+static uint32_t cur_tstamp_secs;
+
+// Number of seconds local_time can be advanced before a full recalculation is
+// needed (local day change, DST transition or time zone rule change). 0 if
+// local_time is not valid.
+static uint32_t secs_to_recalc;
+
+// An absolute instant, in UTC
+struct instant {
+    uint16_t days;
+    uint32_t secs; // < SECONDS_PER_DAY
+};
+
+// Time zone rule in effect (NULL if it needs to be looked up), its start (the
+// first rule has none) and the start of the next rule (an instant after the
+// range of the timestamps if none), and its offsets in seconds
+static const struct tz_rule *tz_rule;
+static struct instant tz_rule_start;
+static struct instant tz_rule_end;
+static int32_t std_offset_secs;
+static uint32_t dst_save_secs;
+
+// DST transitions of the year dst_cache_year (standard local time year), in
+// the rule in effect. The year is 0 if the cache needs to be recalculated.
+static uint16_t dst_cache_year;
+static bool dst_enabled;
+static struct instant dst_start_instant;
+static struct instant dst_end_instant;
+
+// Next DST transition or rule change after the instant passed to the last
+// check_dst() call, in the current DST cache year and rule. Not valid if
+// dst_change_pending is false.
+static bool dst_change_pending;
+static struct instant dst_change;
+
+// Day in the year of the first day of each month, for non-leap and leap years.
+// The last entry is the number of days in the year.
+static const uint16_t month_starts[2][13] = {
+    { 0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334, 365 },
+    { 0, 31, 60, 91, 121, 152, 182, 213, 244, 274, 305, 335, 366 }
 };
 
-static uint16_t week_day_to_offset(uint8_t first_day_of_year, bool leap_year,
-    uint8_t day_month, uint8_t day_week, uint8_t day_num);
+// Year of a day, day in that year (0 = 1st of January), and leap year status
+struct year_day {
+    uint16_t year;
+    uint16_t day;
+    bool leap;
+};
+
+static void rule_start_instant(struct instant *instant,
+    const struct tz_rule *rule);
+
+static void update_tz_rule(uint16_t tstamp_days, uint32_t tstamp_secs);
+
+static uint16_t transition_to_offset(uint8_t first_day_of_year,
+    bool leap_year, const struct tz_transition *transition);
 
-static bool check_dst(uint16_t tstamp_days, uint16_t days_since_new_year,
-    uint32_t seconds_in_day, bool leap_year);
+static void make_dst_instant(struct instant *instant,
+    uint16_t new_year_days, uint16_t day_offset, int16_t minutes);
 
+static bool instant_before(uint16_t days, uint32_t secs,
+    const struct instant *instant);
 
-// Convert a week day reference ("last Sunday in March") to a day count
-// Returns 400 (invalid day count) if month is zero
-uint16_t week_day_to_offset(uint8_t first_day_of_year, bool leap_year,
-    uint8_t day_month, uint8_t day_week, uint8_t day_num)
+static void update_dst_cache(uint16_t new_year_days, bool leap_year);
+
+static bool check_dst(uint16_t tstamp_days, uint32_t tstamp_secs);
+
+static void days_to_year_day(uint16_t days, struct year_day *year_day);
+
+static uint8_t to_bcd(uint8_t val);
+
+static uint8_t bcd_add(uint8_t bcd, uint8_t val);
+
+
+// Start instant of a time zone rule
+static void rule_start_instant(struct instant *instant,
+    const struct tz_rule *rule)
 {
-    uint16_t offset = 0;
-    uint8_t cur_month;
+    instant->days = rule->start_days;
+    instant->secs = rule->start_minutes * 60UL;
+}
+
+
+// Find the time zone rule in effect at a timestamp, unless it is the cached
+// one. The rules are only looked up again when one ends.
+static void update_tz_rule(uint16_t tstamp_days, uint32_t tstamp_secs)
+{
+    uint8_t index;
+
+    if (tz_rule && !instant_before(tstamp_days, tstamp_secs, &tz_rule_start) &&
+        instant_before(tstamp_days, tstamp_secs, &tz_rule_end)) {
+        return;
+    }
+
+    tz_rule_start.days = 0;
+    tz_rule_start.secs = 0;
+    tz_rule_end.days = UINT16_MAX;
+    tz_rule_end.secs = SECONDS_PER_DAY;
+
+    for (index = 0 ; index + 1 < tz_rule_count ; index += 1) {
+        struct instant next_start;
+
+        rule_start_instant(&next_start, &tz_rules[index + 1]);
+        if (instant_before(tstamp_days, tstamp_secs, &next_start)) {
+            tz_rule_end = next_start;
+            break;
+        }
+        tz_rule_start = next_start;
+    }
+
+    tz_rule = &tz_rules[index];
+    std_offset_secs = tz_rule->std_offset * 60L;
+    dst_save_secs = tz_rule->dst_save * 60UL;
+    dst_cache_year = 0;
+}
+
+
+// Convert a transition day ("last Sunday in March", "21st of March") to a day
+// count in the year. Returns 400 (invalid day count) if the month is invalid.
+static uint16_t transition_to_offset(uint8_t first_day_of_year,
+    bool leap_year, const struct tz_transition *transition)
+{
+    const uint16_t *starts = month_starts[leap_year];
+    uint8_t day_month = transition->month_week & 0x0f;
+    uint8_t day_week = transition->month_week >> 4;
+    uint8_t day_num = transition->day;
+    uint16_t offset;
     uint8_t first_day_of_month;
     uint8_t month_offset;
 
-    // Go to the first of the month
-    for (cur_month = 1 ; cur_month < day_month ; cur_month += 1) {
-        offset += month_days[leap_year][cur_month - 1];
+    if (day_month == 0 || day_month > 12) {
+        return 400;
+    }
+    offset = starts[day_month - 1];
+
+    if (day_week == TZ_FIXED_DAY) {
+        return offset + day_num - 1;
     }
 
     // Find the first day number of the desired month
@@ -57,7 +174,7 @@ uint16_t week_day_to_offset(uint8_t first_day_of_year, bool leap_year,
     month_offset += 7 * (day_week - 1);
 
     // 5th week may not fit in month; use 4th week in this case
-    if (month_offset >= month_days[leap_year][cur_month - 1]) {
+    if (month_offset >= starts[day_month] - offset) {
         month_offset -= 7;
     }
 
@@ -65,44 +182,144 @@ uint16_t week_day_to_offset(uint8_t first_day_of_year, bool leap_year,
 }
 
 
-// Check if DST is currently active
-bool check_dst(uint16_t tstamp_days, uint16_t days_since_new_year,
-    uint32_t seconds_in_day, bool leap_year)
+// Calculate the UTC instant of a DST transition, given the standard time day
+// number of the first day of the year, the day offset in the year, and the
+// transition time (minutes after 00:00 standard time)
+static void make_dst_instant(struct instant *instant, uint16_t new_year_days,
+    uint16_t day_offset, int16_t minutes)
 {
-    uint16_t new_year_day_offset = tstamp_days - days_since_new_year;
-    uint8_t first_day_of_year = (new_year_day_offset + EPOCH_DAY_NUM) % 7;
-    uint16_t dst_start_offset;
-    uint16_t dst_end_offset;
+    int32_t secs = minutes * 60L - std_offset_secs;
+
+    instant->days = new_year_days + day_offset;
 
-    if ((dst_start.hour == 0) || (dst_end.hour == 0)
-        || (dst_start.month == 0)) {
-        return false;
+    while (secs < 0) {
+        instant->days -= 1;
+        secs += SECONDS_PER_DAY;
     }
 
-    dst_start_offset = week_day_to_offset(first_day_of_year, leap_year,
-        dst_start.month, dst_start.week, dst_start.day);
+    while (secs >= (int32_t)SECONDS_PER_DAY) {
+        instant->days += 1;
+        secs -= SECONDS_PER_DAY;
+    }
 
-    dst_end_offset = week_day_to_offset(first_day_of_year, leap_year,
-        dst_end.month, dst_end.week, dst_end.day);
+    instant->secs = (uint32_t)secs;
+}
 
-    if (days_since_new_year < dst_start_offset) {
-        return false;
 
-    } else if (days_since_new_year == dst_start_offset) {
-        uint32_t dst_start_second = (uint32_t)(dst_start.hour - 1) *
-            SECONDS_PER_HOUR;
-        return seconds_in_day >= dst_start_second;
+// Check if a timestamp is before the given instant
+static bool instant_before(uint16_t days, uint32_t secs,
+    const struct instant *instant)
+{
+    return (days < instant->days) ||
+        ((days == instant->days) && (secs < instant->secs));
+}
 
-    } else if (days_since_new_year < dst_end_offset) {
-        return true;
 
-    } else if (days_since_new_year == dst_end_offset) {
-        uint32_t dst_end_second = (uint32_t)(dst_end.hour - 1) *
-            SECONDS_PER_HOUR;
-        return seconds_in_day < dst_end_second;
+// Calculate the DST transitions of the rule in effect for the year in
+// local_time.year, if they are not already known.
+static void update_dst_cache(uint16_t new_year_days, bool leap_year)
+{
+    uint8_t first_day_of_year;
+    uint16_t start_offset;
+    uint16_t end_offset;
 
-    } else {
-        return false;
+    if (dst_cache_year == local_time.year) {
+        return;
+    }
+
+    dst_cache_year = local_time.year;
+
+    dst_enabled = (tz_rule->dst_save != 0);
+    if (!dst_enabled) {
+        return;
+    }
+
+    first_day_of_year = (new_year_days + EPOCH_DAY_NUM) % 7;
+
+    start_offset = transition_to_offset(first_day_of_year, leap_year,
+        &tz_rule->dst_start);
+    end_offset = transition_to_offset(first_day_of_year, leap_year,
+        &tz_rule->dst_end);
+
+    make_dst_instant(&dst_start_instant, new_year_days, start_offset,
+        tz_rule->dst_start.minutes);
+    make_dst_instant(&dst_end_instant, new_year_days, end_offset,
+        tz_rule->dst_end.minutes);
+}
+
+
+// Check if DST is active at the given UTC timestamp, using the cached
+// transitions. Also determines the next DST transition or rule change.
+static bool check_dst(uint16_t tstamp_days, uint32_t tstamp_secs)
+{
+    bool dst = false;
+
+    dst_change_pending = false;
+
+    if (dst_enabled) {
+        bool before_start = instant_before(tstamp_days, tstamp_secs,
+            &dst_start_instant);
+        bool before_end = instant_before(tstamp_days, tstamp_secs,
+            &dst_end_instant);
+
+        if (instant_before(dst_start_instant.days, dst_start_instant.secs,
+            &dst_end_instant)) {
+            // DST starts and ends in the same year
+            if (before_start) {
+                dst_change_pending = true;
+                dst_change = dst_start_instant;
+            } else if (before_end) {
+                dst_change_pending = true;
+                dst_change = dst_end_instant;
+                dst = true;
+            }
+        } else {
+            // DST is active at the start and at the end of the year
+            // (southern hemisphere)
+            if (before_end) {
+                dst_change_pending = true;
+                dst_change = dst_end_instant;
+                dst = true;
+            } else if (before_start) {
+                dst_change_pending = true;
+                dst_change = dst_start_instant;
+            } else {
+                dst = true;
+            }
+        }
+    }
+
+    if (!dst_change_pending ||
+        instant_before(tz_rule_end.days, tz_rule_end.secs, &dst_change)) {
+        dst_change_pending = true;
+        dst_change = tz_rule_end;
+    }
+
+    return dst;
+}
+
+
+// Find the year of a day count, in constant time and with 16-bit arithmetic.
+// The days are counted in 4-year cycles (each with a leap year as its third
+// year), as if 29/2/2100 existed; the days after it are then shifted by one.
+static void days_to_year_day(uint16_t days, struct year_day *year_day)
+{
+    uint8_t after_feb_2100 = (days >= MARCH_2100_DAYS);
+    uint16_t cycle = days / DAYS_PER_FOUR_YEARS;
+    uint16_t cycle_day = days % DAYS_PER_FOUR_YEARS + after_feb_2100;
+
+    // The years of the cycle start on days 0, 365, 730 and 1096; the shifted
+    // day can reach 1461, the first day of the next cycle.
+    uint8_t cycle_year = (uint8_t)((cycle_day * 4U + 2U) / DAYS_PER_FOUR_YEARS);
+
+    year_day->year = REF_YEAR + cycle * 4U + cycle_year;
+    year_day->day = cycle_day -
+            (uint16_t)((cycle_year * (uint16_t)DAYS_PER_FOUR_YEARS + 1U) / 4U);
+    year_day->leap = (cycle_year == 2);
+
+    if (year_day->year == 2100) {
+        year_day->day -= after_feb_2100;
+        year_day->leap = false;
     }
 }
 
@@ -110,72 +327,230 @@ bool check_dst(uint16_t tstamp_days, uint16_t days_since_new_year,
 // Recalculate the local time from the current timestamp
 void recalc_local_time(uint16_t tstamp_days, uint32_t tstamp_secs)
 {
-    uint16_t remaining_days;
-    bool is_leap;
-    
-    // Adjust timestamp per UTC offset
-    if (utc_offset_secs >= 0) {
-        tstamp_secs = (uint32_t)((int32_t)tstamp_secs + utc_offset_secs);
+    struct year_day year_day;
+    const uint16_t *starts;
+    uint8_t month;
+
+    cur_tstamp_days = tstamp_days;
+    cur_tstamp_secs = tstamp_secs;
+
+    // Find the time zone rule in effect, and adjust timestamp per its
+    // standard time offset
+    update_tz_rule(tstamp_days, tstamp_secs);
+
+    if (std_offset_secs >= 0) {
+        tstamp_secs = (uint32_t)((int32_t)tstamp_secs + std_offset_secs);
         if (tstamp_secs >= SECONDS_PER_DAY) {
             tstamp_days += 1;
             tstamp_secs -= SECONDS_PER_DAY;
         }
     } else {
-        if (tstamp_secs < (uint32_t)(-utc_offset_secs)) {
+        if (tstamp_secs < (uint32_t)(-std_offset_secs)) {
             tstamp_days -= 1;
             tstamp_secs += SECONDS_PER_DAY;
         }
-        tstamp_secs = (uint32_t)((int32_t)tstamp_secs + utc_offset_secs);
+        tstamp_secs = (uint32_t)((int32_t)tstamp_secs + std_offset_secs);
     }
 
-    remaining_days = tstamp_days;
-
     // Calculate the current year in local time, and its leap year status
-    local_time.year = REF_YEAR + 4 * (remaining_days / DAYS_PER_FOUR_YEARS);
-    remaining_days = remaining_days % DAYS_PER_FOUR_YEARS;
+    days_to_year_day(tstamp_days, &year_day);
+    local_time.year = year_day.year;
 
-    for (;;) {
-        uint16_t to_remove;
+    // The DST transitions only need to be calculated once per year
+    update_dst_cache(tstamp_days - year_day.day, year_day.leap);
 
-        is_leap = ((local_time.year % 4) == 0);
+    // The local time will need to be fully recalculated at the next standard
+    // or local day change, or at the next DST or rule change, whichever comes
+    // first.
+    secs_to_recalc = SECONDS_PER_DAY - tstamp_secs;
 
-        to_remove = is_leap ? (NONLEAP_DAYS + 1) : NONLEAP_DAYS;
-
-        if (remaining_days >= to_remove) {
-            local_time.year += 1;
-            remaining_days -= to_remove;
-        } else {
-            break;
+    // Adjust timestamp if DST is active
+    if (check_dst(cur_tstamp_days, cur_tstamp_secs)) {
+        if (tstamp_secs < SECONDS_PER_DAY - dst_save_secs) {
+            // The local day changes before the standard day
+            secs_to_recalc -= dst_save_secs;
         }
-    }
 
-    // Adjust timestamp if DST is active
-    if (check_dst(tstamp_days, remaining_days, tstamp_secs, is_leap)) {
-        tstamp_secs += SECONDS_PER_HOUR;
+        tstamp_secs += dst_save_secs;
         if (tstamp_secs >= SECONDS_PER_DAY) {
-            remaining_days += 1;
+            // The next day (possibly in the next year)
+            days_to_year_day(tstamp_days + 1, &year_day);
+            local_time.year = year_day.year;
             tstamp_secs -= SECONDS_PER_DAY;
         }
     }
 
-    // Finish formatting the date
-    local_time.month = 1;
-    while (remaining_days >= month_days[is_leap][local_time.month - 1]) {
-        remaining_days -= month_days[is_leap][local_time.month - 1];
-        local_time.month += 1;
+    if (dst_change_pending && (dst_change.days <= cur_tstamp_days + 1)) {
+        uint32_t secs_to_change = dst_change.secs - cur_tstamp_secs;
 
-        if (local_time.month == 13) {
-            // Should not happen unless a weird DST was provided.
-            local_time.month = 1;
-            local_time.year += 1;
-            break;
+        if (dst_change.days != cur_tstamp_days) {
+            secs_to_change += SECONDS_PER_DAY;
+        }
+
+        if (secs_to_change < secs_to_recalc) {
+            secs_to_recalc = secs_to_change;
         }
     }
 
-    local_time.day = (uint8_t)remaining_days + 1;
+    // Finish formatting the date. The months have 28 to 31 days, so the month
+    // is the day in the year divided by 32, or the next one.
+    starts = month_starts[year_day.leap];
+    month = (uint8_t)(year_day.day >> 5);
+    if (year_day.day >= starts[month + 1]) {
+        month += 1;
+    }
+
+    local_time.month = month + 1;
+    local_time.day = (uint8_t)(year_day.day - starts[month]) + 1;
 
-    local_time.hour = (uint8_t)(tstamp_secs / 3600);
+    local_time.hour = to_bcd((uint8_t)(tstamp_secs / 3600));
     tstamp_secs = tstamp_secs % 3600;
-    local_time.minute = (uint8_t)(tstamp_secs / 60);
-    local_time.second = tstamp_secs % 60;
+    local_time.minute = to_bcd((uint8_t)(tstamp_secs / 60));
+    local_time.second = to_bcd(tstamp_secs % 60);
+}
+
+
+// Convert a binary value (0 - 99) to packed BCD
+static uint8_t to_bcd(uint8_t val)
+{
+    uint8_t bcd = 0;
+
+    while (val >= 10) {
+        val -= 10;
+        bcd += 0x10;
+    }
+
+    return bcd | val;
+}
+
+
+// Add a binary value (0 - 59) to a packed BCD value (0x00 - 0x59). The result
+// is not wrapped: it is 0x60 or more if a minute or hour elapsed.
+static uint8_t bcd_add(uint8_t bcd, uint8_t val)
+{
+    uint8_t ones = bcd & 0x0f;
+
+    while (val >= 10) {
+        val -= 10;
+        bcd += 0x10;
+    }
+
+    ones += val;
+    if (ones >= 10) {
+        // Decimal carry from the ones to the tens
+        ones -= 10;
+        bcd += 0x10;
+    }
+
+    return (bcd & 0xf0) | ones;
+}
+
+
+// Advance the local time by a few seconds. The packed BCD digits are
+// incremented with decimal carries; a day change triggers a recalculation.
+void advance_local_time(uint8_t seconds)
+{
+    uint8_t new_second;
+    uint8_t new_minute;
+
+    cur_tstamp_secs += seconds;
+    if (cur_tstamp_secs >= SECONDS_PER_DAY) {
+        cur_tstamp_days += 1;
+        cur_tstamp_secs -= SECONDS_PER_DAY;
+    }
+
+    if (seconds >= secs_to_recalc) {
+        // Day change, DST transition or rule change reached (or invalid
+        // local time)
+        recalc_local_time(cur_tstamp_days, cur_tstamp_secs);
+        return;
+    }
+
+    secs_to_recalc -= seconds;
+
+    // The hour cannot wrap since a day change triggers a recalculation
+    new_minute = local_time.minute;
+    while (seconds >= 60) {
+        seconds -= 60;
+        new_minute = bcd_add(new_minute, 1);
+    }
+
+    new_second = bcd_add(local_time.second, seconds);
+    if (new_second >= 0x60) {
+        new_second -= 0x60;
+        new_minute = bcd_add(new_minute, 1);
+    }
+    local_time.second = new_second;
+
+    if (new_minute >= 0x60) {
+        new_minute -= 0x60;
+        local_time.hour = bcd_add(local_time.hour, 1);
+    }
+    local_time.minute = new_minute;
+}
+
+
+// Convert a GPS time to a timestamp
+void gps_to_timestamp(uint16_t gps_week, uint32_t gps_time_of_week,
+    uint16_t *tstamp_days, uint32_t *tstamp_centisecs)
+{
+    uint8_t day_in_week = (uint8_t)(gps_time_of_week / CENTISECS_PER_DAY);
+    uint32_t centisecs = gps_time_of_week - day_in_week * CENTISECS_PER_DAY;
+    uint16_t days = (uint16_t)(GPS_EPOCH_DAYS + gps_week * 7U + day_in_week);
+
+    // Take the leap seconds into account
+    if (centisecs < GPS_LEAP_SECONDS * 100) {
+        days -= 1;
+        centisecs += CENTISECS_PER_DAY;
+    }
+
+    *tstamp_days = days;
+    *tstamp_centisecs = centisecs - GPS_LEAP_SECONDS * 100;
+}
+
+
+void timestamp_to_gps(uint16_t tstamp_days, uint32_t tstamp_centisecs,
+    uint16_t *gps_week, uint32_t *gps_time_of_week)
+{
+    uint16_t days = tstamp_days - GPS_EPOCH_DAYS;
+    uint32_t centisecs = tstamp_centisecs + GPS_LEAP_SECONDS * 100;
+    uint16_t week;
+
+    // Take the leap seconds into account
+    if (centisecs >= CENTISECS_PER_DAY) {
+        days += 1;
+        centisecs -= CENTISECS_PER_DAY;
+    }
+
+    week = days / 7;
+    *gps_week = week;
+    *gps_time_of_week = (uint8_t)(days - week * 7U) * CENTISECS_PER_DAY +
+            centisecs;
+}
+
+
+// Convert a date to a day count: the days of the previous years, with a leap
+// day every 4 years except in 2100, then the days of the year
+uint16_t date_to_days(uint16_t year, uint8_t month, uint8_t day)
+{
+    uint16_t years = year - REF_YEAR;
+    bool leap = ((years & 3) == 2) && (year != 2100);
+    uint16_t days = (uint16_t)(years * 365U + (years + 1U) / 4U +
+            month_starts[leap][month - 1] + day - 1U);
+
+    if (year > 2100) {
+        days -= 1;
+    }
+
+    return days;
+}
+
+
+// Force a full recalculation of the local time, time zone rule and DST
+// transitions
+void reset_local_time(void)
+{
+    secs_to_recalc = 0;
+    tz_rule = NULL;
+    dst_cache_year = 0;
 }
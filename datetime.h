@@ -12,36 +12,98 @@
 // Day number of 1/1/<ref year>. 0 = Monday, 6 = Sunday
 #define EPOCH_DAY_NUM 3
 
-// DST configuration
-struct dst_date {
-    uint8_t month; // Month, 1-12, 0 to disable DST
-    uint8_t week; // Week in month, 1-4, 5 for last week in month
-    uint8_t day; // Day number in week, 0 = Monday, 6 = Sunday
-    uint8_t hour; // Start/end hour (xx:00:00 DST)
+// Day of the GPS epoch (6/1/1980) since 1/1/<ref year>
+#define GPS_EPOCH_DAYS 3657
+
+// Number of leap seconds (so far) since the GPS epoch. UTC stands still during
+// a leap second, but the GPS time does not.
+#define GPS_LEAP_SECONDS 18
+
+// Last supported GPS week number (the day count needs to fit in 16 bits)
+#define GPS_MAX_WEEK 8838
+
+// Last year entirely in the range of the day count (16 bits)
+#define MAX_YEAR 2148
+
+// Time zone rules (see tzdata.h). From its start, a rule gives the standard
+// offset from UTC, and the DST transitions of each year (in standard time).
+// A transition is on the nth or last week day of a month, or on a day of the
+// month, a number of minutes after 00:00 standard time (the number may be
+// negative or exceed a day). DST may end earlier in the year than it starts
+// (southern hemisphere).
+#define TZ_FIXED_DAY 0 // Week of a transition on a day of the month
+#define TZ_LAST_WEEK 5 // Week of a transition in the last week of the month
+
+struct tz_transition {
+    uint8_t month_week; // Month (1-12) | week << 4 (1-4, last or fixed day)
+    uint8_t day; // Day in week, 0 = Monday - 6 = Sunday, or day of the month
+    int16_t minutes; // Minutes after 00:00 standard time on the day
+};
+
+#define TZ_TRANSITION(month, week, day, minutes) \
+    { (uint8_t)((month) | (week) << 4), (day), (minutes) }
+
+// Transitions of a rule without DST
+#define TZ_NO_DST { 0, 0, 0 }, { 0, 0, 0 }
+
+struct tz_rule {
+    uint16_t start_days; // Start (UTC): days since 1/1/<ref year> and
+    uint16_t start_minutes; // minutes since the start of the day
+    int16_t std_offset; // Minutes added to UTC to get the standard time
+    uint8_t dst_save; // Minutes added to the standard time by DST, 0 if none
+    struct tz_transition dst_start;
+    struct tz_transition dst_end;
 };
 
-// Local date and time
+// Local date and time. The time of day is in packed BCD (tens in the high
+// nibble, ones in the low nibble), as displayed.
 struct datetime {
     uint16_t year; // 4-digit
     uint8_t month; // 1 - 12
     uint8_t day; // 1 - 31
-    uint8_t hour; // 0 - 23
-    uint8_t minute; // 0 - 59
-    uint8_t second; // 0 - 59
+    uint8_t hour; // 0x00 - 0x23 (BCD)
+    uint8_t minute; // 0x00 - 0x59 (BCD)
+    uint8_t second; // 0x00 - 0x59 (BCD)
 };
 
-// The following variables are set externally:
-// Offset from UTC, in seconds; added to timestamp to get local time w/o DST
-extern int32_t utc_offset_secs;
-extern struct dst_date dst_start; // DST start date
-extern struct dst_date dst_end; // DST end date
+// The following variables are set externally: rules of the time zone, in
+// start order. The first rule also applies before its start.
+extern const struct tz_rule *tz_rules;
+extern uint8_t tz_rule_count;
 
 // Recalculate the local date/time from the current timestamp
 // timestamp = tstamp_days * 86400 + tstamp_secs
 // tstamp_secs < 86400
 void recalc_local_time(uint16_t tstamp_days, uint32_t tstamp_secs);
 
-// The following variables are calculated by recalc_local_time
+// Advance the local date/time by the given number of seconds. A full
+// recalculation is only performed when a day change or a DST transition is
+// reached.
+void advance_local_time(uint8_t seconds);
+
+// Convert a GPS week number and time of week (in centiseconds) to a timestamp:
+// days since 1/1/<ref year> and centiseconds since the start of the day (UTC).
+// Only 16- and 32-bit arithmetic is used.
+void gps_to_timestamp(uint16_t gps_week, uint32_t gps_time_of_week,
+    uint16_t *tstamp_days, uint32_t *tstamp_centisecs);
+
+// Convert a timestamp (same format as gps_to_timestamp) to a GPS week number
+// and time of week (in centiseconds). The timestamp must be after the GPS
+// epoch.
+void timestamp_to_gps(uint16_t tstamp_days, uint32_t tstamp_centisecs,
+    uint16_t *gps_week, uint32_t *gps_time_of_week);
+
+// Convert a UTC date (year from <ref year> to MAX_YEAR, month 1 - 12, day of
+// the month from 1) to days since 1/1/<ref year>. Only 16-bit arithmetic is
+// used.
+uint16_t date_to_days(uint16_t year, uint8_t month, uint8_t day);
+
+// Invalidate the local date/time and the cached time zone rule and DST
+// transitions. Must be called after the time zone rules above are changed.
+void reset_local_time(void);
+
+// The following variables are calculated by recalc_local_time and
+// advance_local_time
 extern struct datetime local_time;
 
 #endif
@@ -3,71 +3,91 @@
 // Distributed under the terms of the MIT license.
 
 #include "gps.h"
+#include "gps_driver.h"
+#include "settings.h"
+#include "timebase.h"
 
 #include <stdint.h>
 #include <stdbool.h>
-#include <xc.h>
 
-// Uncomment to help debugging GPS errors
-//#define GPS_HALT_ON_ERRORS
+#include "hal.h"
 
 // Definition of extern variables
 enum gps_status_val gps_status;
 bool gps_is_sync;
-uint64_t gps_deciseconds;
+uint8_t gps_msg_interval;
+uint16_t gps_days;
+uint32_t gps_centisecs;
+uint16_t gps_baud_rate;
+uint32_t gps_time_delay;
+bool gps_time_captured;
+uint16_t gps_time_timer;
+uint8_t gps_time_ticks;
+int32_t gps_ecef[3];
+int32_t gps_clock_drift;
+#ifdef GPS_MSG_STATS
+uint32_t gps_msg_stats[GPS_STATUS_COUNT];
+#endif
+
+// Initialization: wait after a command (including its transmission), and time
+// allowed for the receiver to answer the whole sequence, in ticks
+#define INIT_WAIT_TICKS 3
+#define INIT_TIMEOUT_TICKS 32 // 3 seconds
 
-// Message payload buffer
-static char payload_buf[150];
-static uint8_t payload_length;
+// Wait after the initialization data, while the receiver restarts, in ticks
+#define AIDING_WAIT_TICKS 5
 
-// Message timeout detection
-static uint8_t idle_ticks;
+// Message timeout detection, in ticks (about 10.5 per second). The timeout
+// follows the clock message interval.
+static uint16_t idle_ticks;
+static uint16_t idle_timeout;
+#define IDLE_TIMEOUT(interval) ((uint16_t)(((interval) + 15) * 11))
 
 // Error reset timer counter
 static uint8_t error_reset_count;
 
-// Receive progress
-static uint8_t recv_pos;
-static uint16_t calc_csum;
-volatile enum {
-    RECEIVED_NOTHING,
-    RECEIVING_START,
-    RECEIVING_LENGTH1,
-    RECEIVING_LENGTH2,
-    RECEIVING_PAYLOAD,
-    RECEIVING_CSUM1,
-    RECEIVING_CSUM2,
-    RECEIVING_END1,
-    RECEIVING_END2,
-    RECEIVE_DONE,
-} recv_state;
-
-// GPS control messages:
-
-// Switch to binary mode
-static const char* gps_init_seq_data = (
-    // Initial wait
-    "\xfe\xfe\xfe\xfe\xfe\xfe"
-    // Switch to binary mode and wait
-    "$PSRF100,0,4800,8,1,0*0F\r\n\xfe"
-    // Disable all messages and wait
-    "\xa0\xa2\x00\x08\xa6\x02\x00\x00\x00\x00\x00\x00\x00\xa8\xb0\xb3\xfe"
-    // Enable the clock message (message 7) every 10 seconds
-    "\xa0\xa2\x00\x08\xa6\x00\x07\x0a\x00\x00\x00\x00\x00\xb7\xb0\xb3\xfe\xfe"
-    // Send the clock message (message 7) immediately and finish
-    "\xa0\xa2\x00\x02\x90\x00\x00\x90\xb0\xb3\xff"
-);
-
-
-static void gps_send_init_seq(void);
-static inline uint8_t gps_wait_byte(void);
-static uint8_t gps_wait_msg(void);
-
-#ifdef GPS_HALT_ON_ERRORS
-#define GPS_SET_ERR(error) do { gps_status = error; for (;;) {} } while(0)
-#else
-#define GPS_SET_ERR(error) do { gps_status = error; } while(0)
-#endif
+// Receive ring buffer, filled by the serial interrupt and emptied by the main
+// loop. rx_head is only written by the interrupt and rx_tail by the main loop.
+// The size holds the bytes received at 38400 baud during more than 30 ms (more
+// than a tick at 4800 baud), so that the main loop can fall behind during
+// calculations (recalc_local_time() takes about 10 ms).
+#define RX_BUF_SIZE 128 // Power of 2
+static volatile uint8_t rx_buf[RX_BUF_SIZE];
+static volatile uint8_t rx_head;
+static uint8_t rx_tail;
+
+// Reception errors recorded by the interrupt
+static volatile bool rx_serial_err;
+static volatile bool rx_overflow;
+
+// Transmit ring buffer, filled by the main loop and emptied by the serial
+// transmit interrupt. tx_head is only written by the main loop and tx_tail by
+// the interrupt. The size holds the longest command (initialization data).
+#define TX_BUF_SIZE 64 // Power of 2
+static volatile uint8_t tx_buf[TX_BUF_SIZE];
+static uint8_t tx_head;
+static volatile uint8_t tx_tail;
+
+// Arrival of the last message end byte recorded by the interrupt: position in
+// the receive buffer (RX_END_NONE if none), Timer0 value and tick count
+#define RX_END_NONE 0xff
+static volatile uint8_t rx_end_pos;
+static volatile uint16_t rx_end_timer;
+static volatile uint8_t rx_end_ticks;
+
+// Initialization progress: position in the current sequence (NULL while
+// waiting for a clock message), and ticks until the next step. The
+// initialization data is sent if aiding.
+static bool initializing;
+static bool aiding;
+static const char* init_seq;
+static volatile uint8_t init_wait;
+static volatile bool init_step_due;
+
+
+static void gps_set_baud_rate(uint16_t baud_rate);
+static void gps_init_step(void);
+static void gps_capture_msg_end(void);
 
 
 void gps_init(void)
@@ -75,215 +95,338 @@ void gps_init(void)
     gps_status = STATUS_OK;
     gps_is_sync = false;
     error_reset_count = 0;
-    recv_state = RECEIVED_NOTHING;
-    gps_deciseconds = 0;
+    gps_drv_reset();
+    rx_head = 0;
+    rx_tail = 0;
+    rx_serial_err = false;
+    rx_overflow = false;
+    rx_end_pos = RX_END_NONE;
+    tx_head = 0;
+    tx_tail = 0;
+    gps_days = 0;
+    gps_centisecs = 0;
+    gps_time_captured = false;
+    gps_msg_interval = GPS_MIN_MSG_INTERVAL;
+    idle_ticks = 0;
+    idle_timeout = IDLE_TIMEOUT(GPS_MIN_MSG_INTERVAL);
+    gps_set_baud_rate(GPS_LOW_BAUD_RATE);
+    aiding = (gps_ecef[0] != 0 || gps_ecef[1] != 0 || gps_ecef[2] != 0);
 
-    // Send the initialization sequence
-    gps_send_init_seq();
+    // Try the high rate first; the first step is run by the main loop
+    initializing = true;
+    init_seq = gps_drv_high_rate_seq;
+    init_wait = 0;
+    init_step_due = true;
 
-    // Wait for message 7
+    // Enable the serial reception and its interrupt
     RCSTAbits.CREN = 1;
-    while (gps_wait_msg() != 7);
+    PIE1bits.RCIE = 1;
+}
 
-    idle_ticks = 0;
 
-    // Enable serial interrupt
-    PIE1bits.RCIE = 1;
+void gps_send_byte(uint8_t val)
+{
+    uint8_t head = tx_head;
+    uint8_t next_head = (head + 1) & (TX_BUF_SIZE - 1);
+
+    while (next_head == tx_tail) {
+        // Wait for the interrupt to send a byte
+        HAL_SPIN();
+    }
+
+    tx_buf[head] = val;
+    tx_head = next_head;
+    PIE1bits.TXIE = 1;
 }
 
 
-// Send the initialization sequence to the GPS
-static void gps_send_init_seq(void)
+bool gps_tx_idle(void)
 {
-    const char* seq = gps_init_seq_data;
-    uint8_t val;
-
-    for (val = *seq ; val != '\xff' ; val = *(++seq)) {
-        while (TXSTAbits.TRMT == 0); // Wait for previous character to be sent
-        if (val == '\xfe') {
-            uint32_t wait = 0x1ffff;
-            while (--wait);
-        } else {
-            TXREG = val;
-        }
+    return tx_tail == tx_head && TXSTAbits.TRMT;
+}
+
+
+void gps_send_raw(const char *data, uint8_t length)
+{
+    for (uint8_t i = 0 ; i < length ; i += 1) {
+        gps_send_byte((uint8_t)data[i]);
     }
 }
 
 
-// Wait for a byte to be received on the serial, and return it.
-static inline uint8_t gps_wait_byte(void)
+void gps_handle_serial_tx(void)
 {
-    while (!PIR1bits.RCIF);// Wait for a byte to be received
+    uint8_t tail = tx_tail;
 
-    // Read and return the received byte
-    return RCREG;
+    if (tail == tx_head) {
+        // Nothing left to send
+        PIE1bits.TXIE = 0;
+        return;
+    }
+
+    HAL_UART_WRITE(tx_buf[tail]); // Also acknowledges the interrupt
+    tx_tail = (tail + 1) & (TX_BUF_SIZE - 1);
 }
 
 
-// Wait for a binary message to be received on the serial. Return the message
-// type. Does not check message CRC or length.
-static uint8_t gps_wait_msg(void)
+// Run the initialization sequence until the next wait (main loop)
+static void gps_init_step(void)
 {
-    uint8_t msg_type;
+    if (!init_seq) {
+        // Clock message not received: try the other rate
+        init_seq = (gps_baud_rate == GPS_HIGH_BAUD_RATE) ?
+                gps_drv_low_rate_seq : gps_drv_high_rate_seq;
+    }
 
     for (;;) {
-        if (gps_wait_byte() != '\xA0')
-            continue;
+        uint8_t val = *init_seq;
 
-        if (gps_wait_byte() != '\xA2')
+        if (val < SEQ_AIDING) {
+            gps_send_byte(val);
+            init_seq += 1;
             continue;
+        }
 
-        // Receive the length
-        gps_wait_byte();
-        gps_wait_byte();
-
-        // Message type
-        msg_type = gps_wait_byte();
+        if (val <= SEQ_HIGH_RATE && !gps_tx_idle()) {
+            // Switch the rate after the transmission: check again at the next
+            // tick
+            init_wait = 1;
+            return;
+        }
 
-        while (gps_wait_byte() != '\xB0') {
-            // Wait for message end
+        init_seq += 1;
+
+        switch (val) {
+            case SEQ_AIDING:
+                if (aiding) {
+                    gps_drv_send_aiding();
+                    init_wait = AIDING_WAIT_TICKS;
+                    return;
+                }
+            break;
+            case SEQ_LOW_RATE:
+                gps_set_baud_rate(GPS_LOW_BAUD_RATE);
+            break;
+            case SEQ_HIGH_RATE:
+                gps_set_baud_rate(GPS_HIGH_BAUD_RATE);
+            break;
+            case SEQ_WAIT:
+                init_wait = INIT_WAIT_TICKS;
+            return;
+            default: // SEQ_END
+                init_seq = 0;
+                init_wait = INIT_TIMEOUT_TICKS;
+            return;
         }
+    }
+}
 
-        if (gps_wait_byte() != '\xB3')
-            continue;
 
-        return msg_type;
+void gps_set_msg_interval(uint8_t interval)
+{
+    gps_drv_send_msg_interval(interval);
+
+    // The last message was just received: the new timeout applies from there
+    INTCONbits.T0IE = 0;
+    idle_timeout = IDLE_TIMEOUT(interval);
+    INTCONbits.T0IE = 1;
+
+    gps_msg_interval = interval;
+}
+
+
+// Change the serial baud rate (the transmission must be finished)
+static void gps_set_baud_rate(uint16_t baud_rate)
+{
+    if (baud_rate == GPS_HIGH_BAUD_RATE) {
+        TXSTAbits.BRGH = 1;
+        SPBRG = 35; // Base frequency / (16 * (35 + 1)) = 38400 baud
+    } else {
+        TXSTAbits.BRGH = 0;
+        SPBRG = GPS_DRV_LOW_RATE_SPBRG;
     }
+
+    // Message offset and transmission time (10 bits per byte)
+    gps_time_delay = (PHASE_PER_SECOND / 1000UL) * GPS_MSG_OFFSET_MS +
+            GPS_DRV_TIME_MSG_BYTES * 10UL * (PHASE_PER_SECOND / baud_rate);
+    gps_baud_rate = baud_rate;
 }
 
 
-bool gps_handle_serial_rx(void)
+void gps_handle_serial_rx(void)
 {
-    char recv_byte = RCREG; // Receive the data and acknowledge the interrupt
+    uint8_t head = rx_head;
+    uint8_t next_head = (head + 1) & (RX_BUF_SIZE - 1);
+    uint8_t byte;
 
     idle_ticks = 0;
 
-    if (RCSTAbits.FERR || RCSTAbits.OERR) {
-        GPS_SET_ERR(STATUS_ERR_SERIAL);
-        return false;
+    if (RCSTAbits.OERR) {
+        // Reception stopped; the bytes in the receive FIFO are still valid
+        rx_serial_err = true;
+        HAL_UART_RESTART_RX();
     }
 
-    switch (recv_state) {
-        case RECEIVED_NOTHING:
-            if (recv_byte == '\xA0') { // First start byte
-                recv_state = RECEIVING_START;
-            } else {
-                GPS_SET_ERR(STATUS_ERR_INVAL_MSG_SEQ);
-            }
-        break;
-        case RECEIVING_START:
-            if (recv_byte == '\xA2') { // Second start byte
-                recv_state = RECEIVING_LENGTH1;
-            } else {
-                GPS_SET_ERR(STATUS_ERR_INVAL_MSG_SEQ);
-            }
-        break;
-        case RECEIVING_LENGTH1:
-            if (recv_byte == 0) { // Length should be < 256 so high byte = 0
-                recv_state = RECEIVING_LENGTH2;
-            } else {
-                GPS_SET_ERR(STATUS_ERR_INVAL_MSG_TYPE);
-            }
-        break;
-        case RECEIVING_LENGTH2:
-            if (recv_byte <= sizeof(payload_buf)) {
-                payload_length = recv_byte;
-                recv_pos = 0;
-                calc_csum = 0;
-                recv_state = RECEIVING_PAYLOAD;
-            } else {
-                GPS_SET_ERR(STATUS_ERR_INVAL_MSG_TYPE);
-            }
-        break;
-        case RECEIVING_PAYLOAD:
-            payload_buf[recv_pos] = recv_byte;
-            calc_csum += recv_byte;
-            recv_pos += 1;
-            if (recv_pos == payload_length) {
-                recv_state = RECEIVING_CSUM1;
-                recv_pos = 0;
-            }
-        break;
-        case RECEIVING_CSUM1:
-            if (recv_byte == ((calc_csum >> 8) & 0x7F)) {
-                recv_state = RECEIVING_CSUM2;
-            } else {
-                GPS_SET_ERR(STATUS_ERR_INVAL_MSG_CSUM);
-            }
-        break;
-        case RECEIVING_CSUM2:
-            if (recv_byte == (calc_csum & 0xFF)) {
-                recv_state = RECEIVING_END1;
-            } else {
-                GPS_SET_ERR(STATUS_ERR_INVAL_MSG_CSUM);
-            }
-        break;
-        case RECEIVING_END1:
-            if (recv_byte == '\xb0') { // First end byte
-                recv_state = RECEIVING_END2;
-            } else {
-                GPS_SET_ERR(STATUS_ERR_INVAL_MSG_SEQ);
-            }
-        break;
-        case RECEIVING_END2:
-            if (recv_byte == '\xb3') { // Second end byte
-                recv_state = RECEIVE_DONE;
-                return true;
-            } else {
-                GPS_SET_ERR(STATUS_ERR_INVAL_MSG_SEQ);
-            }
-        break;
-        case RECEIVE_DONE:
-            GPS_SET_ERR(STATUS_ERR_OVERFLOW);
-        break;
+    if (RCSTAbits.FERR) {
+        // Invalid byte; reading it acknowledges the interrupt
+        rx_serial_err = true;
+        (void)HAL_UART_READ();
+        return;
     }
 
-    return false;
+    if (next_head == rx_tail) {
+        rx_overflow = true;
+        (void)HAL_UART_READ();
+        return;
+    }
+
+    byte = HAL_UART_READ(); // Also acknowledges the interrupt
+    rx_buf[head] = byte;
+    rx_head = next_head;
+
+    if (GPS_DRV_MSG_END(rx_buf[(head - 1) & (RX_BUF_SIZE - 1)], byte)) {
+        // Possible message end: record the timer for gps_process_received()
+        rx_end_pos = head;
+        gps_capture_msg_end();
+    }
 }
 
 
-void gps_handle_tick(void)
+// Record the Timer0 counts since the start of its period and the tick count
+// (called by the interrupt)
+static void gps_capture_msg_end(void)
 {
-    if (idle_ticks < 255) {
-        idle_ticks += 1;
-    } else if (gps_status < STATUS_ERR_NO_DATA) {
-        GPS_SET_ERR(STATUS_ERR_NO_DATA);
+    bool tick_pending = INTCONbits.T0IF;
+    uint16_t timer;
+
+    HAL_TIMER0_READ(timer);
+
+    if (!tick_pending && INTCONbits.T0IF) {
+        // The timer overflowed while being read
+        tick_pending = true;
+        HAL_TIMER0_READ(timer);
+    }
+
+    if (tick_pending) {
+        // The timer counts from the end of the period not handled yet
+        rx_end_timer = timer;
+        rx_end_ticks = tick_count + period_ticks;
+    } else {
+        rx_end_timer = TIMER0_SINCE_TICK(timer);
+        rx_end_ticks = tick_count;
     }
 }
 
 
-void gps_process_received(void)
+bool gps_work_pending(void)
 {
-    // If a message was actually received, the receive state and the other
-    // variables will be stable.
-    if (recv_state != RECEIVE_DONE)
-        return;
+    return rx_tail != rx_head || rx_serial_err || rx_overflow || init_step_due;
+}
 
-    if ((payload_buf[0] == 11) && (payload_length == 3)) {
-        // Message 11: acknowledgment of command -- ignored
-        recv_state = RECEIVED_NOTHING;
-        return;
+
+void gps_handle_tick(uint8_t ticks)
+{
+    if (init_wait != 0) {
+        if (init_wait > ticks) {
+            init_wait -= ticks;
+        } else {
+            init_wait = 0;
+            init_step_due = true;
+        }
     }
 
-    if ((payload_buf[0] == 225) && (payload_length == 39)) {
-        // Message 225: statistics channel -- ignored
-        // FIXME find how to disable this message (is debug correctly disabled?)
-        recv_state = RECEIVED_NOTHING;
-        return;
+    if (idle_ticks < idle_timeout && ticks <= idle_timeout - idle_ticks) {
+        idle_ticks += ticks;
+    } else {
+        idle_ticks = idle_timeout;
+        if (gps_status < STATUS_ERR_NO_DATA) {
+            GPS_SET_ERR(STATUS_ERR_NO_DATA);
+        }
     }
+}
 
-    if (payload_buf[0] == 93) {
-        // Message 93: ??? (the payload length seems to vary; seen 17 and 150)
-        // FIXME find how to disable this message (is debug correctly disabled?)
-        recv_state = RECEIVED_NOTHING;
-        return;
+
+uint8_t gps_ticks_until_due(void)
+{
+    uint16_t ticks = UINT8_MAX;
+
+    if (gps_status < STATUS_ERR_NO_DATA) {
+        // The timeout is reported on the tick after idle_timeout
+        ticks = (idle_ticks < idle_timeout) ?
+                (uint16_t)(idle_timeout - idle_ticks + 1) : 1;
     }
 
-    if ((payload_buf[0] != 7) | (payload_length != 20)) {
-        // Unexpected message
+    if (init_wait != 0 && init_wait < ticks) {
+        ticks = init_wait;
+    }
 
-        GPS_SET_ERR(STATUS_ERR_INVAL_MSG_TYPE);
-        return;
+    return (ticks < UINT8_MAX) ? (uint8_t)ticks : UINT8_MAX;
+}
+
+
+bool gps_process_received(void)
+{
+    if (init_step_due) {
+        init_step_due = false;
+        if (initializing) {
+            gps_init_step();
+        }
+    }
+
+    if (rx_serial_err) {
+        rx_serial_err = false;
+        gps_drv_reset();
+        GPS_SET_ERR(STATUS_ERR_SERIAL);
+    }
+
+    if (rx_overflow) {
+        rx_overflow = false;
+        gps_drv_reset();
+        GPS_SET_ERR(STATUS_ERR_OVERFLOW);
+    }
+
+    while (rx_tail != rx_head) {
+        uint8_t pos = rx_tail;
+        uint8_t recv_byte = rx_buf[pos];
+        bool captured = false;
+
+        rx_tail = (pos + 1) & (RX_BUF_SIZE - 1);
+
+        // Take the arrival recorded at this byte, if any (unless another
+        // possible message end arrived since), and clear it: a byte at the
+        // same position after the buffer wraps around, whose message end was
+        // not recorded, must not get it
+        if (rx_end_pos == pos) {
+            PIE1bits.RCIE = 0;
+            captured = (rx_end_pos == pos);
+            if (captured) {
+                gps_time_timer = rx_end_timer;
+                gps_time_ticks = rx_end_ticks;
+                rx_end_pos = RX_END_NONE;
+            }
+            PIE1bits.RCIE = 1;
+        }
+
+        // Stop at a new time so it is applied without delay; the following
+        // bytes are processed at the next call.
+        if (gps_drv_parse_byte(recv_byte)) {
+            gps_time_captured = captured;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+void gps_clock_msg_received(void)
+{
+    if (initializing && !init_seq) {
+        // The receiver answers at the current rate after the whole sequence.
+        // The errors while negotiating the rate do not count.
+        initializing = false;
+        init_wait = 0;
+        gps_status = STATUS_OK;
     }
 
     if (gps_status != STATUS_OK) {
@@ -295,34 +438,4 @@ void gps_process_received(void)
             error_reset_count = 0;
         }
     }
-
-    uint16_t gps_week;
-    uint32_t gps_time_of_week;
-
-    gps_week = ((uint16_t)payload_buf[1] << 8) | (uint16_t)payload_buf[2];
-    gps_time_of_week = ((uint32_t)payload_buf[3] << 24) |
-            ((uint32_t)payload_buf[4] << 16) |
-            ((uint32_t)payload_buf[5] << 8) | (uint32_t)payload_buf[6];
-
-    if (gps_week <= 1711) {
-        // GPS time of 2012; seems to be returned before the GPS is synchronized
-        // FIXME: Find a better way to detect desynchronized GPS? The "SVs"
-        // info (byte 7 of the message payload) might indicate the number
-        // of satellites, but it seems to always be 0.
-        gps_is_sync = false;
-        recv_state = RECEIVED_NOTHING;
-        return;
-    }
-
-    // There are 315964800 seconds between the UTC epoch 1/1/1970 and the
-    // GPS epoch 6/1/1980. However, there have been 18 leap seconds (so far)
-    // since the GPS epoch; UTC stands still during the leap second, but the
-    // GPS time does not, so we need to subtract the amount of leap seconds from
-    // the initial delta.
-    gps_deciseconds = 31596480000 - 1800 + ((uint64_t)gps_week * 60480000) +
-        (uint64_t)gps_time_of_week;
-
-    gps_is_sync = true;
-
-    recv_state = RECEIVED_NOTHING;
 }
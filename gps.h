@@ -7,6 +7,12 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include "settings.h"
+
+// Receiver protocol drivers (see GPS_DRIVER in settings.h)
+#define GPS_DRIVER_SIRF 1 // SiRF binary (gps_sirf.c)
+#define GPS_DRIVER_UBX 2 // u-blox UBX (gps_ubx.c)
+
 // GPS error and sync status
 enum gps_status_val {
     STATUS_OK = 0,                  // GPS communication OK
@@ -20,20 +26,100 @@ enum gps_status_val {
 extern enum gps_status_val gps_status;
 extern bool gps_is_sync;
 
-// Time received from GPS, in seconds * 100 from 1/1/1970 00:00:00 UTC
-// Updated when processing messages
-extern uint64_t gps_deciseconds;
+#ifdef GPS_MSG_STATS
+// Message statistics, for the host tools (not in the firmware): number of
+// complete messages with a valid checksum (index STATUS_OK), and number of
+// errors of each type (an unexpected message is counted in both)
+#define GPS_STATUS_COUNT 7
+extern uint32_t gps_msg_stats[GPS_STATUS_COUNT];
+#endif
+
+// Interval of the clock messages (SiRF message 7, UBX NAV-TIMEUTC), in
+// seconds
+#define GPS_MIN_MSG_INTERVAL 10 // Set at initialization
+#define GPS_MAX_MSG_INTERVAL 240
+extern uint8_t gps_msg_interval;
+
+// Serial baud rate negotiated with the receiver during the initialization: the
+// high rate if the receiver accepts it, else the low rate (the default rate of
+// the receiver)
+#if GPS_DRIVER == GPS_DRIVER_UBX
+#define GPS_LOW_BAUD_RATE 9600
+#else
+#define GPS_LOW_BAUD_RATE 4800
+#endif
+#define GPS_HIGH_BAUD_RATE 38400
+extern uint16_t gps_baud_rate;
+
+// Time received from GPS: days since 1/1/1970, and centiseconds since the
+// start of the day (UTC). Updated when processing messages.
+extern uint16_t gps_days;
+extern uint32_t gps_centisecs;
+
+// Moment at which the received time was valid: the end of its message, which
+// is gps_time_delay phase units (see timebase.h) after the time. If
+// gps_time_captured, gps_time_timer and gps_time_ticks are the Timer0 counts
+// since the start of its period and the tick count (including the ticks of a
+// pending period) recorded by the serial interrupt when the last byte of the
+// message arrived.
+extern uint32_t gps_time_delay;
+extern bool gps_time_captured;
+extern uint16_t gps_time_timer;
+extern uint8_t gps_time_ticks;
 
-// Initialize the GPS receiver. The serial receive status and interrupt should
-// be disabled; they will be automatically enabled when this function returns.
+// Receiver position (ECEF coordinates, in meters; all 0 if unknown), updated
+// by the answer to gps_poll_position(), and receiver clock drift (Hz), updated
+// by the synchronized clock messages (SiRF only). If the position is known
+// when gps_init() is called (restored at startup), the initialization sends
+// them to the receiver, with the current time of the timebase, for a warm
+// start.
+extern int32_t gps_ecef[3];
+extern int32_t gps_clock_drift;
+
+// Start the initialization of the GPS receiver, and enable the serial receive
+// status and interrupt (they should be disabled). The initialization sequence
+// is then sent by gps_process_received(), as the ticks elapse, until the
+// receiver answers (retrying with both baud rates); it does not block.
 void gps_init(void);
 
-// Handle serial reception interrupt. Return true if a message is received.
-bool gps_handle_serial_rx(void);
+// Change the interval of the clock messages. The command is queued and sent by
+// the serial transmit interrupt (interrupts must be enabled).
+void gps_set_msg_interval(uint8_t interval);
+
+// Request the position of the receiver (SiRF message 2, UBX NAV-POSECEF; see
+// gps_ecef). The command is queued as by gps_set_msg_interval().
+void gps_poll_position(void);
+
+// Queue raw bytes to send, as by gps_set_msg_interval() (debug output, see
+// profile.h; the receiver ignores what is not a message of its protocol)
+void gps_send_raw(const char *data, uint8_t length);
+
+// Return true if all the queued bytes are sent
+bool gps_tx_idle(void);
+
+// Handle serial reception interrupt: store the received byte for
+// gps_process_received().
+void gps_handle_serial_rx(void);
+
+// Handle serial transmit interrupt: send the next queued byte, or disable the
+// interrupt when there is none.
+void gps_handle_serial_tx(void);
+
+// Return true if received data or errors are waiting to be processed, or an
+// initialization step is due
+bool gps_work_pending(void);
+
+// Handle the end of a Timer0 period of the given number of ticks (used for
+// timeouts and the initialization steps)
+void gps_handle_tick(uint8_t ticks);
 
-// Handle a tick interrupt (used for timeout detection)
-void gps_handle_tick(void);
+// Number of ticks until gps_handle_tick() has something to do (an
+// initialization step or a message timeout due), at most UINT8_MAX. Called
+// from the interrupt handler.
+uint8_t gps_ticks_until_due(void);
 
-// Process the received message.
-void gps_process_received(void);
+// Process the received data and run the initialization (main loop). Returns
+// true if a new time was received; the data received after it is processed at
+// the next call.
+bool gps_process_received(void);
 #endif
@@ -0,0 +1,117 @@
+// 150189-71 Nixie Clock alternative firmware
+// Distributed under the terms of the MIT license.
+
+// Interface between the protocol independent GPS code (gps.c: serial buffers,
+// initialization sequencing, timeouts) and the receiver protocol drivers
+// (gps_sirf.c, gps_ubx.c). The driver is selected at compile time by
+// GPS_DRIVER (see settings.h); the other one compiles to nothing, and the
+// functions below are called directly. The receive interrupt only uses the
+// GPS_DRV_MSG_END() macro of the driver.
+
+#ifndef GPS_DRIVER_H
+#define GPS_DRIVER_H
+
+#include "gps.h"
+#include "settings.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#if GPS_DRIVER == GPS_DRIVER_SIRF
+
+// Clock message (message 7) length on the wire (payload and framing)
+#define GPS_DRV_TIME_MSG_BYTES (20 + 8)
+
+// Baud rate generator setting for GPS_LOW_BAUD_RATE (low speed mode)
+#define GPS_DRV_LOW_RATE_SPBRG 71 // Base frequency / (64 * (71 + 1)) = 4800
+
+// True if the received byte may end a clock message (called by the receive
+// interrupt; prev, the byte received before, is not evaluated)
+#define GPS_DRV_MSG_END(prev, byte) ((byte) == 0xb3)
+
+#elif GPS_DRIVER == GPS_DRIVER_UBX
+
+// Clock message (NAV-TIMEUTC) length on the wire (payload and framing)
+#define GPS_DRV_TIME_MSG_BYTES (20 + 8)
+
+// Baud rate generator setting for GPS_LOW_BAUD_RATE (low speed mode)
+#define GPS_DRV_LOW_RATE_SPBRG 35 // Base frequency / (64 * (35 + 1)) = 9600
+
+// UBX frames have no end marker: the receive interrupt counts the bytes after
+// the sync characters (0xb5 0x62), and the last byte of a clock message is
+// the one ending a frame of its length. A sync sequence inside the payload
+// restarts the count (the end is then not captured).
+extern uint8_t gps_ubx_rx_left;
+
+#define GPS_DRV_MSG_END(prev, byte) \
+    (((byte) == 0x62 && (prev) == 0xb5) ? \
+        ((gps_ubx_rx_left = GPS_DRV_TIME_MSG_BYTES - 2) == 0) : \
+        (gps_ubx_rx_left != 0 && --gps_ubx_rx_left == 0))
+
+#else
+#error "Unknown GPS_DRIVER"
+#endif
+
+// Initialization sequences, with control codes (the command bytes must be
+// below SEQ_AIDING): SEQ_AIDING sends the initialization data if aiding (then
+// waits), SEQ_LOW_RATE and SEQ_HIGH_RATE switch the serial port to the low and
+// high rates (once the previous bytes are sent), SEQ_WAIT waits, and SEQ_END
+// ends the sequence (then a clock message is expected).
+#define SEQ_AIDING '\xfb'
+#define SEQ_LOW_RATE '\xfc'
+#define SEQ_HIGH_RATE '\xfd'
+#define SEQ_WAIT '\xfe'
+#define SEQ_END '\xff'
+
+// Message statistics and error reporting (see gps_status)
+#ifdef GPS_MSG_STATS
+#define GPS_COUNT(status) do { gps_msg_stats[status] += 1; } while(0)
+#else
+#define GPS_COUNT(status) do { } while(0)
+#endif
+
+// Uncomment to help debugging GPS errors
+//#define GPS_HALT_ON_ERRORS
+
+#ifdef GPS_HALT_ON_ERRORS
+#define GPS_SET_ERR(error) \
+        do { GPS_COUNT(error); gps_status = error; for (;;) {} } while(0)
+#else
+#define GPS_SET_ERR(error) do { GPS_COUNT(error); gps_status = error; } while(0)
+#endif
+
+
+// Provided by gps.c
+
+// Queue a byte to send to the GPS. Waits if the transmit buffer is full
+// (interrupts must be enabled).
+void gps_send_byte(uint8_t val);
+
+// Handle a clock message with a valid frame, before its time is used: ends
+// the initialization, and resets the error status after 255 of them
+void gps_clock_msg_received(void);
+
+
+// Provided by the driver
+
+// Sequences switching the receiver to its binary protocol at the high rate,
+// from the low rate, and back to the low rate, from the high rate (tried in
+// turn until a clock message is received)
+extern const char gps_drv_high_rate_seq[];
+extern const char gps_drv_low_rate_seq[];
+
+// Reset the receive state: wait for the start of the next message
+void gps_drv_reset(void);
+
+// Handle a received byte (main loop). Returns true if it completes a clock
+// message with a new time (gps_days and gps_centisecs are updated).
+bool gps_drv_parse_byte(uint8_t byte);
+
+// Send the command setting the interval of the clock messages
+void gps_drv_send_msg_interval(uint8_t interval);
+
+// Send the initialization data (gps_ecef, and if the protocol takes them,
+// gps_clock_drift and the current time of the timebase)
+void gps_drv_send_aiding(void);
+
+#endif
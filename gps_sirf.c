@@ -0,0 +1,336 @@
+// 150189-71 Nixie Clock alternative firmware
+// Copyright (C) Vincent Duvert
+// Distributed under the terms of the MIT license.
+
+// SiRF binary protocol driver (see gps_driver.h): the receiver outputs the
+// clock status (message 7) at the requested interval.
+
+#include "gps.h"
+#include "gps_driver.h"
+#include "datetime.h"
+#include "timebase.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if GPS_DRIVER == GPS_DRIVER_SIRF
+
+// Received message. The payload is not stored: the fields used are decoded
+// as the bytes arrive.
+static uint8_t payload_length;
+static uint8_t msg_id;
+static uint16_t msg_week; // Message 7: GPS week
+static uint32_t msg_time_of_week; // Message 7: GPS time of week (1/100 s)
+static uint32_t msg_clock_drift; // Message 7: clock drift (Hz)
+static int32_t msg_ecef[3]; // Message 2: position (m)
+
+// Receive progress
+static uint8_t recv_pos;
+static uint16_t calc_csum;
+static enum {
+    RECEIVED_NOTHING,
+    RECEIVING_START,
+    RECEIVING_LENGTH1,
+    RECEIVING_LENGTH2,
+    RECEIVING_PAYLOAD,
+    RECEIVING_CSUM1,
+    RECEIVING_CSUM2,
+    RECEIVING_END1,
+    RECEIVING_END2,
+} recv_state;
+
+// Configure the messages, sent in binary mode at the current rate
+#define CONFIG_SEQ \
+    /* Initialization data (message 128) */ \
+    "\xfb" \
+    /* Disable all messages and wait */ \
+    "\xa0\xa2\x00\x08\xa6\x02\x00\x00\x00\x00\x00\x00\x00\xa8\xb0\xb3\xfe" \
+    /* Enable the clock message (message 7) every 10 seconds */ \
+    /* (GPS_MIN_MSG_INTERVAL) */ \
+    "\xa0\xa2\x00\x08\xa6\x00\x07\x0a\x00\x00\x00\x00\x00\xb7\xb0\xb3\xfe\xfe" \
+    /* Send the clock message (message 7) immediately and finish */ \
+    "\xa0\xa2\x00\x02\x90\x00\x00\x90\xb0\xb3\xff"
+
+// Switch to binary mode at 38400 baud, from 4800 baud. The receiver starts in
+// NMEA mode, but may still be in binary mode if only the clock was reset.
+const char gps_drv_high_rate_seq[] = (
+    // Initial wait
+    "\xfe\xfe\xfe\xfe\xfe\xfe"
+    // Message 134 (set binary serial port): 38400 baud, 8N1
+    "\xa0\xa2\x00\x09\x86\x00\x00\x96\x00\x08\x01\x00\x00\x01\x25\xb0\xb3\xfe"
+    // NMEA switch to binary mode and wait
+    "$PSRF100,0,38400,8,1,0*3C\r\n\xfe"
+    // Switch the serial port and configure
+    "\xfd" CONFIG_SEQ
+);
+
+// Switch back to binary mode at 4800 baud, from 38400 baud: in case the
+// receiver switched but its messages are not received, or did not accept the
+// higher rate
+const char gps_drv_low_rate_seq[] = (
+    // Message 134 (set binary serial port): 4800 baud, 8N1
+    "\xa0\xa2\x00\x09\x86\x00\x00\x12\xc0\x08\x01\x00\x00\x01\x61\xb0\xb3\xfe"
+    // Switch the serial port, then NMEA switch to binary mode and wait
+    "\xfc$PSRF100,0,4800,8,1,0*0F\r\n\xfe"
+    CONFIG_SEQ
+);
+
+
+static void gps_send_u32(uint32_t val, uint16_t *csum);
+static bool gps_handle_msg(void);
+
+
+void gps_drv_reset(void)
+{
+    recv_state = RECEIVED_NOTHING;
+}
+
+
+void gps_drv_send_msg_interval(uint8_t interval)
+{
+    // Message 166 (set message rate), mode 0 (one message): message 7
+    uint16_t csum = 0xa6 + 0x07 + interval;
+
+    gps_send_byte(0xa0);
+    gps_send_byte(0xa2);
+    gps_send_byte(0x00);
+    gps_send_byte(0x08);
+    gps_send_byte(0xa6);
+    gps_send_byte(0x00);
+    gps_send_byte(0x07);
+    gps_send_byte(interval);
+    for (uint8_t i = 0 ; i < 4 ; i += 1) {
+        gps_send_byte(0x00);
+    }
+    gps_send_byte((uint8_t)(csum >> 8));
+    gps_send_byte((uint8_t)csum);
+    gps_send_byte(0xb0);
+    gps_send_byte(0xb3);
+}
+
+
+void gps_poll_position(void)
+{
+    // Message 166 (set message rate), mode 1 (poll one message): message 2
+    static const uint8_t msg[16] = {
+        0xa0, 0xa2, 0x00, 0x08, 0xa6, 0x01, 0x02, 0x00,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0xa9, 0xb0, 0xb3,
+    };
+
+    for (uint8_t i = 0 ; i < sizeof(msg) ; i += 1) {
+        gps_send_byte(msg[i]);
+    }
+}
+
+
+// Queue a big-endian 32-bit value, and add its bytes to a checksum
+static void gps_send_u32(uint32_t val, uint16_t *csum)
+{
+    for (uint8_t i = 0 ; i < 4 ; i += 1) {
+        uint8_t byte = (uint8_t)(val >> 24);
+
+        gps_send_byte(byte);
+        *csum += byte;
+        val <<= 8;
+    }
+}
+
+
+// Send the initialization data (message 128): the restored position and clock
+// drift, and the current time, for a warm start of the receiver
+void gps_drv_send_aiding(void)
+{
+    struct timebase_snapshot now;
+    uint16_t week;
+    uint32_t time_of_week;
+    uint16_t csum = 128 + 12 + 0x03;
+
+    timebase_snapshot(&now);
+    timestamp_to_gps(now.days, now.secs * 100, &week, &time_of_week);
+
+    gps_send_byte(0xa0);
+    gps_send_byte(0xa2);
+    gps_send_byte(0x00);
+    gps_send_byte(25);
+    gps_send_byte(128);
+    for (uint8_t i = 0 ; i < 3 ; i += 1) {
+        gps_send_u32((uint32_t)gps_ecef[i], &csum);
+    }
+    gps_send_u32((uint32_t)gps_clock_drift, &csum);
+    gps_send_u32(time_of_week, &csum);
+    gps_send_byte((uint8_t)(week >> 8));
+    gps_send_byte((uint8_t)week);
+    csum += (uint8_t)(week >> 8) + (uint8_t)week;
+    gps_send_byte(12); // Channels
+    gps_send_byte(0x03); // Reset: warm start with the initialization data
+    gps_send_byte((uint8_t)(csum >> 8) & 0x7f);
+    gps_send_byte((uint8_t)csum);
+    gps_send_byte(0xb0);
+    gps_send_byte(0xb3);
+}
+
+
+bool gps_drv_parse_byte(uint8_t recv_byte)
+{
+    switch (recv_state) {
+        case RECEIVED_NOTHING:
+            if (recv_byte == 0xA0) { // First start byte
+                recv_state = RECEIVING_START;
+                return false;
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_SEQ);
+        break;
+        case RECEIVING_START:
+            if (recv_byte == 0xA2) { // Second start byte
+                recv_state = RECEIVING_LENGTH1;
+                return false;
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_SEQ);
+        break;
+        case RECEIVING_LENGTH1:
+            if (recv_byte == 0) { // Length should be < 256 so high byte = 0
+                recv_state = RECEIVING_LENGTH2;
+                return false;
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_TYPE);
+        break;
+        case RECEIVING_LENGTH2:
+            if (recv_byte != 0) {
+                payload_length = recv_byte;
+                recv_pos = 0;
+                calc_csum = 0;
+                recv_state = RECEIVING_PAYLOAD;
+                return false;
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_TYPE);
+        break;
+        case RECEIVING_PAYLOAD:
+            if (recv_pos == 0) {
+                msg_id = recv_byte;
+            } else if (msg_id == 7) {
+                // Message 7: big-endian week (bytes 1-2) and time of week
+                // (bytes 3-6)
+                if (recv_pos <= 2) {
+                    msg_week = (msg_week << 8) | recv_byte;
+                } else if (recv_pos <= 6) {
+                    msg_time_of_week = (msg_time_of_week << 8) | recv_byte;
+                } else if (recv_pos >= 8 && recv_pos <= 11) {
+                    // Clock drift (bytes 8-11)
+                    msg_clock_drift = (msg_clock_drift << 8) | recv_byte;
+                }
+            } else if (msg_id == 2 && recv_pos <= 12) {
+                // Message 2: big-endian ECEF X, Y and Z (bytes 1-12)
+                uint8_t axis = (recv_pos - 1) >> 2;
+
+                msg_ecef[axis] = (int32_t)((uint32_t)msg_ecef[axis] << 8 |
+                        recv_byte);
+            }
+            calc_csum += recv_byte;
+            recv_pos += 1;
+            if (recv_pos == payload_length) {
+                recv_state = RECEIVING_CSUM1;
+            }
+        return false;
+        case RECEIVING_CSUM1:
+            if (recv_byte == ((calc_csum >> 8) & 0x7F)) {
+                recv_state = RECEIVING_CSUM2;
+                return false;
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_CSUM);
+        break;
+        case RECEIVING_CSUM2:
+            if (recv_byte == (calc_csum & 0xFF)) {
+                recv_state = RECEIVING_END1;
+                return false;
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_CSUM);
+        break;
+        case RECEIVING_END1:
+            if (recv_byte == 0xb0) { // First end byte
+                recv_state = RECEIVING_END2;
+                return false;
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_SEQ);
+        break;
+        case RECEIVING_END2:
+            recv_state = RECEIVED_NOTHING;
+            if (recv_byte == 0xb3) { // Second end byte
+                GPS_COUNT(STATUS_OK);
+                return gps_handle_msg();
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_SEQ);
+        break;
+    }
+
+    // Invalid byte: wait for the start of the next message
+    recv_state = RECEIVED_NOTHING;
+    return false;
+}
+
+
+// Handle a complete message. Returns true if a new time was received.
+static bool gps_handle_msg(void)
+{
+    if ((msg_id == 11) && (payload_length == 3)) {
+        // Message 11: acknowledgment of command -- ignored
+        return false;
+    }
+
+    if ((msg_id == 2) && (payload_length == 41)) {
+        // Message 2: measured navigation data (polled) -- position, if the
+        // receiver has one
+        if (msg_ecef[0] != 0 || msg_ecef[1] != 0 || msg_ecef[2] != 0) {
+            gps_ecef[0] = msg_ecef[0];
+            gps_ecef[1] = msg_ecef[1];
+            gps_ecef[2] = msg_ecef[2];
+        }
+        return false;
+    }
+
+    if ((msg_id == 225) && (payload_length == 39)) {
+        // Message 225: statistics channel -- ignored
+        // FIXME find how to disable this message (is debug correctly disabled?)
+        return false;
+    }
+
+    if (msg_id == 93) {
+        // Message 93: ??? (the payload length seems to vary; seen 17 and 150)
+        // FIXME find how to disable this message (is debug correctly disabled?)
+        return false;
+    }
+
+    if ((msg_id != 7) | (payload_length != 20)) {
+        // Unexpected message
+
+        GPS_SET_ERR(STATUS_ERR_INVAL_MSG_TYPE);
+        return false;
+    }
+
+    gps_clock_msg_received();
+
+    uint16_t gps_week = msg_week;
+    uint32_t gps_time_of_week = msg_time_of_week;
+
+    if (gps_week <= 1711) {
+        // GPS time of 2012; seems to be returned before the GPS is synchronized
+        // FIXME: Find a better way to detect desynchronized GPS? The "SVs"
+        // info (byte 7 of the message payload) might indicate the number
+        // of satellites, but it seems to always be 0.
+        gps_is_sync = false;
+        return false;
+    }
+
+    if (gps_week > GPS_MAX_WEEK) {
+        GPS_SET_ERR(STATUS_ERR_INVAL_MSG_TYPE);
+        return false;
+    }
+
+    gps_to_timestamp(gps_week, gps_time_of_week, &gps_days, &gps_centisecs);
+    gps_clock_drift = (int32_t)msg_clock_drift;
+
+    gps_is_sync = true;
+
+    return true;
+}
+
+#endif
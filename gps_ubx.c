@@ -0,0 +1,377 @@
+// 150189-71 Nixie Clock alternative firmware
+// Distributed under the terms of the MIT license.
+
+// u-blox UBX protocol driver (see gps_driver.h): the receiver is switched to
+// UBX output only, and outputs the UTC time solution (NAV-TIMEUTC) at the
+// requested interval. The frames are checked with their 8-bit Fletcher
+// checksum, and the fields used are decoded as the bytes arrive.
+
+#include "gps.h"
+#include "gps_driver.h"
+#include "datetime.h"
+#include "timebase.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#if GPS_DRIVER == GPS_DRIVER_UBX
+
+// Message classes and types (class << 8 | id)
+#define UBX_CLASS_ACK 0x05
+#define UBX_CLASS_INF 0x04
+#define UBX_NAV_POSECEF 0x0101
+#define UBX_NAV_TIMEUTC 0x0121
+#define UBX_CFG_MSG 0x0601
+#define UBX_MGA_INI 0x1340
+
+// NAV-TIMEUTC validity flags: time of week, week number and UTC (leap
+// seconds) known
+#define VALID_UTC 0x07
+
+// Largest accuracy of a position to keep (NAV-POSECEF), and accuracy of the
+// initialization data (MGA-INI), in cm
+#define POSITION_MAX_ACC 10000UL // 100 m
+#define AIDING_POS_ACC 10000UL // 100 m
+
+// Definition of extern variables
+uint8_t gps_ubx_rx_left;
+
+// Received message. The payload is not stored: the fields used are decoded
+// as the bytes arrive (little-endian).
+static uint16_t msg_type;
+static uint8_t payload_length;
+static uint32_t msg_nano; // NAV-TIMEUTC: fraction of second (ns, signed)
+static uint8_t msg_time[8]; // NAV-TIMEUTC: year (2 bytes), month, day, hour,
+                            // minute, second and validity flags
+static int32_t msg_pos[4]; // NAV-POSECEF: ECEF X, Y, Z and accuracy (cm)
+
+// Receive progress, and Fletcher checksum of the class, id, length and
+// payload
+static uint8_t recv_pos;
+static uint8_t calc_ck_a;
+static uint8_t calc_ck_b;
+static enum {
+    RECEIVED_NOTHING,
+    RECEIVING_SYNC2,
+    RECEIVING_CLASS,
+    RECEIVING_ID,
+    RECEIVING_LENGTH1,
+    RECEIVING_LENGTH2,
+    RECEIVING_PAYLOAD,
+    RECEIVING_CK_A,
+    RECEIVING_CK_B,
+} recv_state;
+
+// Checksum of the message being sent
+static uint8_t send_ck_a;
+static uint8_t send_ck_b;
+
+// Configure the messages, sent in UBX at the current rate
+#define CONFIG_SEQ \
+    /* Initialization data (MGA-INI) */ \
+    "\xfb" \
+    /* CFG-MSG: NAV-TIMEUTC every 10 seconds (GPS_MIN_MSG_INTERVAL) */ \
+    "\xb5\x62\x06\x01\x03\x00\x01\x21\x0a\x36\x8e\xfe" \
+    /* Poll NAV-TIMEUTC and finish */ \
+    "\xb5\x62\x01\x21\x00\x00\x22\x67\xff"
+
+// CFG-PRT (port configuration): UART 1, 8N1, UBX input and output only (the
+// NMEA output stops), at 38400 or 9600 baud
+#define CFG_PRT_38400 \
+    "\xb5\x62\x06\x00\x14\x00\x01\x00\x00\x00\xd0\x08\x00\x00\x00\x96\x00\x00" \
+    "\x01\x00\x01\x00\x00\x00\x00\x00\x8b\x54"
+#define CFG_PRT_9600 \
+    "\xb5\x62\x06\x00\x14\x00\x01\x00\x00\x00\xd0\x08\x00\x00\x80\x25\x00\x00" \
+    "\x01\x00\x01\x00\x00\x00\x00\x00\x9a\x79"
+
+// Switch to UBX at 38400 baud, from 9600 baud. The receiver starts with NMEA
+// output, but accepts UBX commands; it may still be configured if only the
+// clock was reset.
+const char gps_drv_high_rate_seq[] = (
+    // Initial wait
+    "\xfe\xfe\xfe\xfe\xfe\xfe"
+    // Set the port and wait
+    CFG_PRT_38400 "\xfe"
+    // Switch the serial port and configure
+    "\xfd" CONFIG_SEQ
+);
+
+// Switch back to 9600 baud, from 38400 baud: in case the receiver switched but
+// its messages are not received, or did not accept the higher rate
+const char gps_drv_low_rate_seq[] = (
+    // Set the port (at the high rate) and wait
+    CFG_PRT_9600 "\xfe"
+    // Switch the serial port, set the port again (at the low rate) and wait
+    "\xfc" CFG_PRT_9600 "\xfe"
+    CONFIG_SEQ
+);
+
+
+static void ubx_send_header(uint16_t type, uint8_t length);
+static void ubx_send_byte(uint8_t val);
+static void ubx_send_u32(uint32_t val);
+static void ubx_send_end(void);
+static bool gps_handle_msg(void);
+
+
+void gps_drv_reset(void)
+{
+    recv_state = RECEIVED_NOTHING;
+}
+
+
+// Queue the start of a message, and reset the checksum
+static void ubx_send_header(uint16_t type, uint8_t length)
+{
+    gps_send_byte(0xb5);
+    gps_send_byte(0x62);
+    send_ck_a = 0;
+    send_ck_b = 0;
+    ubx_send_byte((uint8_t)(type >> 8));
+    ubx_send_byte((uint8_t)type);
+    ubx_send_byte(length);
+    ubx_send_byte(0);
+}
+
+
+// Queue a byte of the message, and add it to the checksum
+static void ubx_send_byte(uint8_t val)
+{
+    gps_send_byte(val);
+    send_ck_a += val;
+    send_ck_b += send_ck_a;
+}
+
+
+// Queue a little-endian 32-bit value of the message
+static void ubx_send_u32(uint32_t val)
+{
+    for (uint8_t i = 0 ; i < 4 ; i += 1) {
+        ubx_send_byte((uint8_t)val);
+        val >>= 8;
+    }
+}
+
+
+// Queue the checksum, ending the message
+static void ubx_send_end(void)
+{
+    gps_send_byte(send_ck_a);
+    gps_send_byte(send_ck_b);
+}
+
+
+void gps_drv_send_msg_interval(uint8_t interval)
+{
+    // CFG-MSG (message rate on the current port, in navigation solutions of
+    // 1 second): NAV-TIMEUTC
+    ubx_send_header(UBX_CFG_MSG, 3);
+    ubx_send_byte(UBX_NAV_TIMEUTC >> 8);
+    ubx_send_byte((uint8_t)UBX_NAV_TIMEUTC);
+    ubx_send_byte(interval);
+    ubx_send_end();
+}
+
+
+void gps_poll_position(void)
+{
+    // Poll NAV-POSECEF (message without payload)
+    ubx_send_header(UBX_NAV_POSECEF, 0);
+    ubx_send_end();
+}
+
+
+// Send the initialization data: the restored position (MGA-INI-POS_XYZ), for
+// a warm start of the receiver. The restored time is not sent: it is behind by
+// the unknown duration of the power cut, which can be days, and a time with a
+// wrong accuracy delays the fix more than none. The receiver takes the time
+// from its own RTC if it has one. The clock drift is not known either
+// (NAV-TIMEUTC does not report it).
+void gps_drv_send_aiding(void)
+{
+    ubx_send_header(UBX_MGA_INI, 20);
+    ubx_send_byte(0x00); // Type: POS_XYZ
+    ubx_send_byte(0x00); // Version
+    ubx_send_byte(0x00);
+    ubx_send_byte(0x00);
+    for (uint8_t i = 0 ; i < 3 ; i += 1) {
+        ubx_send_u32((uint32_t)(gps_ecef[i] * 100)); // cm
+    }
+    ubx_send_u32(AIDING_POS_ACC);
+    ubx_send_end();
+}
+
+
+bool gps_drv_parse_byte(uint8_t recv_byte)
+{
+    switch (recv_state) {
+        case RECEIVED_NOTHING:
+            if (recv_byte == 0xb5) { // First sync character
+                recv_state = RECEIVING_SYNC2;
+                return false;
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_SEQ);
+        break;
+        case RECEIVING_SYNC2:
+            if (recv_byte == 0x62) { // Second sync character
+                calc_ck_a = 0;
+                calc_ck_b = 0;
+                recv_state = RECEIVING_CLASS;
+                return false;
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_SEQ);
+        break;
+        case RECEIVING_CLASS:
+            msg_type = (uint16_t)recv_byte << 8;
+            recv_state = RECEIVING_ID;
+            calc_ck_a += recv_byte;
+            calc_ck_b += calc_ck_a;
+        return false;
+        case RECEIVING_ID:
+            msg_type |= recv_byte;
+            recv_state = RECEIVING_LENGTH1;
+            calc_ck_a += recv_byte;
+            calc_ck_b += calc_ck_a;
+        return false;
+        case RECEIVING_LENGTH1:
+            payload_length = recv_byte;
+            recv_state = RECEIVING_LENGTH2;
+            calc_ck_a += recv_byte;
+            calc_ck_b += calc_ck_a;
+        return false;
+        case RECEIVING_LENGTH2:
+            if (recv_byte == 0) { // Length should be < 256 so high byte = 0
+                recv_pos = 0;
+                recv_state = (payload_length != 0) ?
+                        RECEIVING_PAYLOAD : RECEIVING_CK_A;
+                calc_ck_b += calc_ck_a; // The checksum of 0
+                return false;
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_TYPE);
+        break;
+        case RECEIVING_PAYLOAD:
+            if (msg_type == UBX_NAV_TIMEUTC) {
+                if (recv_pos >= 8 && recv_pos <= 11) {
+                    // Fraction of second (bytes 8-11)
+                    msg_nano = msg_nano >> 8 | (uint32_t)recv_byte << 24;
+                } else if (recv_pos >= 12 && recv_pos <= 19) {
+                    // Date, time and validity flags (bytes 12-19)
+                    msg_time[recv_pos - 12] = recv_byte;
+                }
+            } else if (msg_type == UBX_NAV_POSECEF && recv_pos >= 4 &&
+                    recv_pos <= 19) {
+                // ECEF X, Y and Z, and accuracy (bytes 4-19)
+                uint8_t field = (recv_pos - 4) >> 2;
+
+                msg_pos[field] = (int32_t)((uint32_t)msg_pos[field] >> 8 |
+                        (uint32_t)recv_byte << 24);
+            }
+            calc_ck_a += recv_byte;
+            calc_ck_b += calc_ck_a;
+            recv_pos += 1;
+            if (recv_pos == payload_length) {
+                recv_state = RECEIVING_CK_A;
+            }
+        return false;
+        case RECEIVING_CK_A:
+            if (recv_byte == calc_ck_a) {
+                recv_state = RECEIVING_CK_B;
+                return false;
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_CSUM);
+        break;
+        case RECEIVING_CK_B:
+            recv_state = RECEIVED_NOTHING;
+            if (recv_byte == calc_ck_b) {
+                GPS_COUNT(STATUS_OK);
+                return gps_handle_msg();
+            }
+            GPS_SET_ERR(STATUS_ERR_INVAL_MSG_CSUM);
+        break;
+    }
+
+    // Invalid byte: wait for the start of the next message
+    recv_state = RECEIVED_NOTHING;
+    return false;
+}
+
+
+// Handle a complete message. Returns true if a new time was received.
+static bool gps_handle_msg(void)
+{
+    uint8_t msg_class = (uint8_t)(msg_type >> 8);
+
+    if (msg_class == UBX_CLASS_ACK || msg_class == UBX_CLASS_INF) {
+        // Acknowledgment of command, or information message -- ignored
+        return false;
+    }
+
+    if ((msg_type == UBX_NAV_POSECEF) && (payload_length == 20)) {
+        // Position (polled), if the receiver has an accurate one
+        if ((uint32_t)msg_pos[3] <= POSITION_MAX_ACC) {
+            gps_ecef[0] = msg_pos[0] / 100;
+            gps_ecef[1] = msg_pos[1] / 100;
+            gps_ecef[2] = msg_pos[2] / 100;
+        }
+        return false;
+    }
+
+    if ((msg_type != UBX_NAV_TIMEUTC) | (payload_length != 20)) {
+        // Unexpected message
+
+        GPS_SET_ERR(STATUS_ERR_INVAL_MSG_TYPE);
+        return false;
+    }
+
+    gps_clock_msg_received();
+
+    if ((msg_time[7] & VALID_UTC) != VALID_UTC) {
+        // The receiver does not know the UTC time yet
+        gps_is_sync = false;
+        return false;
+    }
+
+    uint16_t year = (uint16_t)(msg_time[0] | msg_time[1] << 8);
+    uint8_t month = msg_time[2];
+    uint8_t day = msg_time[3];
+    int32_t nano = (int32_t)msg_nano;
+
+    // The day count must not wrap
+    if (year <= REF_YEAR || year > MAX_YEAR || month < 1 || month > 12 ||
+            day < 1 || day > 31 || msg_time[4] > 23 || msg_time[5] > 59 ||
+            msg_time[6] > 60 || nano < -1000000000L || nano > 1000000000L) {
+        GPS_SET_ERR(STATUS_ERR_INVAL_MSG_TYPE);
+        return false;
+    }
+
+    if (msg_time[6] == 60) {
+        // Leap second: UTC stands still (see GPS_LEAP_SECONDS)
+        return false;
+    }
+
+    uint16_t days = date_to_days(year, month, day);
+    uint32_t centisecs = ((msg_time[4] * 60U + msg_time[5]) * 60UL +
+            msg_time[6]) * 100UL;
+
+    // Add the fraction of second, rounded to the centisecond, and offset by
+    // one second so that it is positive
+    centisecs += (uint8_t)((uint32_t)(nano + 1005000000L) / 10000000UL);
+    if (centisecs < 100) {
+        days -= 1;
+        centisecs += CENTISECS_PER_DAY;
+    }
+    centisecs -= 100;
+    if (centisecs >= CENTISECS_PER_DAY) {
+        days += 1;
+        centisecs -= CENTISECS_PER_DAY;
+    }
+
+    gps_days = days;
+    gps_centisecs = centisecs;
+
+    gps_is_sync = true;
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,94 @@
+// 150189-71 Nixie Clock alternative firmware
+// Distributed under the terms of the MIT license.
+
+// Hardware abstraction layer.
+// On the target, the special function registers are accessed directly. On the
+// host (tests), they are provided by the PIC simulator (tests/picsim.h); the
+// register accesses with side effects go through the macros below so the
+// simulator can handle them.
+
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+#ifdef __XC8
+
+#include <xc.h>
+
+// Read the received serial byte (acknowledges the receive interrupt)
+#define HAL_UART_READ() RCREG
+
+// Write a byte to the serial transmit register
+#define HAL_UART_WRITE(val) do { TXREG = (val); } while (0)
+
+// Restart the serial receiver, to clear an overrun error
+#define HAL_UART_RESTART_RX() do { \
+    RCSTAbits.CREN = 0; \
+    RCSTAbits.CREN = 1; \
+} while (0)
+
+// Read the current Timer0 value in a uint16_t variable. Reading the low byte
+// latches the high byte.
+#define HAL_TIMER0_READ(var) do { \
+    (var) = TMR0L; \
+    (var) |= (uint16_t)TMR0H << 8; \
+} while (0)
+
+// Add val * 256 to Timer0, just after its next increment: the write clears the
+// pre-scaler, so that the cycles lost (TMR0_RELOAD_CYCLES, see timebase.h) are
+// those of the code from the increment to the write, plus the 2 cycles during
+// which the timer stops. Reading TMR0H returns the high byte latched by the
+// last read of the low byte.
+#define HAL_TIMER0_ADD_HIGH(val) do { \
+    uint8_t tmr0_start_ = TMR0L; \
+    uint8_t tmr0_low_; \
+    do { \
+        tmr0_low_ = TMR0L; \
+    } while (tmr0_low_ == tmr0_start_); \
+    TMR0H = TMR0H + (val); \
+    TMR0L = tmr0_low_; \
+} while (0)
+
+// Read the current Timer1 value in a uint16_t variable (16-bit read mode:
+// reading the low byte latches the high byte)
+#define HAL_TIMER1_READ(var) do { \
+    (var) = TMR1L; \
+    (var) |= (uint16_t)TMR1H << 8; \
+} while (0)
+
+// Read a byte of the data EEPROM in a uint8_t variable
+#define HAL_EEPROM_READ(addr, var) do { \
+    EEADR = (addr); \
+    EECON1 = 0; \
+    EECON1bits.RD = 1; \
+    (var) = EEDATA; \
+} while (0)
+
+// Start writing a byte to the data EEPROM. The previous write must be done
+// (EECON1bits.WR clear), and the interrupts disabled so that the unlock
+// sequence is not interrupted. PIR2bits.EEIF is set at the end of the write.
+#define HAL_EEPROM_WRITE(addr, val) do { \
+    EEADR = (addr); \
+    EEDATA = (val); \
+    EECON1 = 0; \
+    EECON1bits.WREN = 1; \
+    EECON2 = 0x55; \
+    EECON2 = 0xAA; \
+    EECON1bits.WR = 1; \
+    EECON1bits.WREN = 0; \
+} while (0)
+
+// Called in each iteration of busy-wait loops
+#define HAL_SPIN() do { } while (0)
+
+#else
+
+#include "picsim.h"
+
+// The firmware main function is called by the simulator
+#define main firmware_main
+
+#endif
+
+#endif
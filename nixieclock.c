@@ -3,16 +3,23 @@
 // Distributed under the terms of the MIT license.
 
 // Set the DEBUG macro in the project settings to enable debug and disable
-// the watchdog.
+// the watchdog, and the ISR_PROFILE macro to enable the interrupt profiler
+// (see profile.h).
 
 #include <stdbool.h>
 #include <stdint.h>
-#include <xc.h>
 
+#ifdef __XC8
 #include "configbits.h"
+#endif
 #include "datetime.h"
 #include "gps.h"
+#include "hal.h"
+#include "persist.h"
+#include "profile.h"
 #include "settings.h"
+#include "timebase.h"
+#include "tzdata.h"
 
 
 // I/O register allocation:
@@ -28,7 +35,7 @@
 // B7       O   Used by the programmer (PGD pin)
 //
 // C<0..2>  O   Minutes (tens digit, 0 to 7)
-// C3       I   Jumper (currently unused)
+// C3       I   Jumper (interrupt profiler dump, see profile.h)
 // C4       I   Switch (currently unused)
 // C5       O   Separator between hours and minutes
 // C6       O   RS232 TX to GPS module
@@ -41,72 +48,108 @@
 #define STATUS_LED LATAbits.LA5
 #define SWITCH PORTCbits.RC3
 
-// Ticks counter
-#define TICKS_PER_DAY 911336
-static uint16_t cur_days = 0;
-static uint32_t cur_ticks = 0;
-static bool tick_happened = 0;
-
-// Displayed value (after update)
-#define BLANK ((uint8_t)0xff)
-static struct {
-    bool left_sep : 1; // Left separator
-    bool right_sep : 1; // Right separator
-    uint8_t digit0 : 2; // Hours tens, 0-2, 3 = blank
-    uint8_t digit1 : 4; // Hours ones, 0-9, 15 = blank
-    uint8_t digit2 : 4; // Minutes tens, 0-7, never blank
-    uint8_t digit3 : 4; // Minutes ones, 0-9, 15 = blank
-    uint8_t digit4 : 4; // Seconds tens, 0-7, never blank
-    uint8_t digit5 : 4; // Seconds ones, 0-9, 15 = blank
-} disp_value;
-
-// Track GPS processing
-static bool gps_proc_required = false;
+// Maximum error of the clock at a GPS fix when adapting the GPS message rate,
+// in Timer0 counts (30 ms). The displayed second is then always correct.
+#define RATE_ERROR_BUDGET \
+    ((int32_t)(OSC_FREQ / (4UL * TMR0_PRESCALER) * 30UL / 1000UL))
+
+// Maximum number of ticks handled between the end of a GPS message and its
+// processing for the Timer0 value recorded at the end to be used (beyond, the
+// timer is read again; this should not happen): two Timer0 periods
+#define MAX_CAPTURE_TICKS (2 * MAX_PERIOD_TICKS)
+
+// Interval between the saves of the clock state to the EEPROM, in seconds.
+// The records are spread over the EEPROM (see persist.c): its endurance (100k
+// writes per byte at least) allows a save every 10 minutes for over 15 years.
+#define SAVE_INTERVAL_SECS 600U
+
+// Sequence number of the last tick seen by the main loop (see tick_seq), and
+// seconds counted by the timebase at that point (see sec_count)
+static uint8_t seen_tick_seq = 0;
+static uint8_t seen_sec_count = 0;
+
+// Set by the main loop while it needs to run on every tick (startup animation,
+// profiler dump). Otherwise, a Timer0 period only ends when an event is due
+// (see next_period_ticks()), and the core sleeps until then.
+static volatile bool every_tick = true;
+
+// Display port images: the display bits of LATA to LATD (see the I/O register
+// allocation above), as last written. A port is only written when its image
+// changes. The ports are cleared at setup.
+#define LATC_LEFT_SEP 0b00100000
+#define LATD_RIGHT_SEP 0b10000000
+static uint8_t disp_lata = 0;
+static uint8_t disp_latb = 0;
+static uint8_t disp_latc = 0;
+static uint8_t disp_latd = 0;
+
+// Time shown by the display; shown_hour is NOT_SHOWN while something else is
+// displayed (animation). During POISON_HOUR, the cathode poisoning prevention
+// sequence is shown instead of the time, but the time is still tracked.
+#define NOT_SHOWN 0xff
+#define POISON_HOUR 0x02
+static uint8_t shown_hour = NOT_SHOWN;
+static uint8_t shown_minute;
+static uint8_t shown_second;
+
+// Seconds until the next save of the clock state (the first save follows the
+// first fix). The position of the receiver is polled at the fix when the save
+// is due, and the state is saved at the next fix.
+static uint16_t save_countdown = 0;
+static bool position_polled = false;
 
 static void setup(void);
+static uint8_t next_period_ticks(void);
+static void start_period(uint8_t ticks);
+static bool status_led_at(uint8_t tick);
+static bool restore_state(void);
 static bool check_tick(void);
+static void adapt_gps_rate(bool resynced);
+static void save_state(uint16_t days, uint32_t day_secs);
 static void delay(uint8_t ticks);
-static void update_display(void);
+static void disp_hours(uint8_t bcd);
+static void disp_minutes(uint8_t bcd);
+static void disp_seconds(uint8_t bcd);
+static void disp_separators(bool left, bool right);
+static void disp_all(uint8_t digit, bool separators);
 static void disp_cur_time(void);
+static void disp_status(void);
 
 
 void main(void)
 {
+    bool restored;
+
     setup();
 
-    disp_value.left_sep = 0;
-    disp_value.right_sep = 0;
-    disp_value.digit0 = 0;
-    disp_value.digit1 = 1;
-    disp_value.digit2 = 2;
-    disp_value.digit3 = 3;
-    disp_value.digit4 = 4;
-    disp_value.digit5 = 5;
+    disp_hours(0x01);
+    disp_minutes(0x23);
+    disp_seconds(0x45);
 
-    update_display();
+    restored = restore_state();
 
     gps_init();
 
-    do {
+    // Without a saved state, display an animation until the GPS is
+    // synchronized. Otherwise, the estimated time is displayed right away (the
+    // right separator does not blink until then).
+    while (!restored && !gps_is_sync) {
         for (uint8_t i = 0 ; i < 10 ; i += 1) {
-            disp_value.left_sep = i & 1;
-            disp_value.right_sep = i & 1;
-            disp_value.digit0 = i;
-            disp_value.digit1 = i;
-            disp_value.digit2 = i;
-            disp_value.digit3 = i;
-            disp_value.digit4 = i;
-            disp_value.digit5 = i;
-
-            update_display();
+            disp_all(i, i & 1);
             delay(10);
         }
-    } while (!gps_is_sync);
+    }
 
     for (;;) {
         if (check_tick()) {
             disp_cur_time();
         }
+        disp_status();
+        PROFILE_POLL();
+
+        // Run on every tick while something else than the time is displayed,
+        // or a profiler dump is in progress
+        every_tick = (shown_hour == NOT_SHOWN) || PROFILE_DUMPING();
         Sleep();
     }
 }
@@ -115,88 +158,237 @@ void main(void)
 // High priority interrupt handler
 void __interrupt(high_priority) handle_int(void)
 {
-    if (INTCONbits.T0IF) {
-        // Timer0 interrupt
-
-        // Blink the status LED to indicate the GPS status
-        uint8_t blink_count = cur_ticks & 0x1f;
-        STATUS_LED = (((blink_count & 0b11) == 0) &&
-                (blink_count >> 2) < gps_status);
-
-        // Increment tick counter
-        cur_ticks += 1;
-        if (cur_ticks == TICKS_PER_DAY) {
-            cur_days += 1;
-            cur_ticks = 0;
-        }
-        tick_happened = true;
+    PROFILE_START(profile_int_start);
+
+    if (INTCONbits.T0IE && INTCONbits.T0IF) {
+        // Timer0 interrupt (not handled while the main loop disables it)
+        PROFILE_TICK_LATENCY();
+        PROFILE_START(profile_source_start);
+
+        // Advance the timebase by the ticks of the period that ended
+        timebase_tick(period_ticks);
+
+        gps_handle_tick(period_ticks);
 
-        gps_handle_tick();
+        // Start the next period, and blink the status LED to indicate the GPS
+        // status
+        start_period(next_period_ticks());
+        STATUS_LED = status_led_at(tick_count);
 
         // Acknowledge the interrupt
         INTCONbits.T0IF = 0;
+        PROFILE_END(PROFILE_TICK, profile_source_start);
     }
 
     if (PIE1bits.RCIE && PIR1bits.RCIF) {
         // Receive interrupt
-        gps_proc_required = gps_handle_serial_rx();
+        PROFILE_START(profile_source_start);
+        gps_handle_serial_rx();
+        PROFILE_END(PROFILE_RX, profile_source_start);
+        PROFILE_RX_FULL();
+    }
+
+    if (PIE1bits.TXIE && PIR1bits.TXIF) {
+        // Transmit interrupt
+        PROFILE_START(profile_source_start);
+        gps_handle_serial_tx();
+        PROFILE_END(PROFILE_TX, profile_source_start);
+    }
+
+    if (PIE2bits.EEIE && PIR2bits.EEIF) {
+        // EEPROM write complete interrupt
+        PROFILE_START(profile_source_start);
+        persist_handle_int();
+        PROFILE_END(PROFILE_EEPROM, profile_source_start);
+    }
+
+    PROFILE_END(PROFILE_INT, profile_int_start);
+}
+
+
+// Restore the clock state saved in the EEPROM, if any: the estimated time (the
+// time of the save, as there is no real-time clock to count the time spent
+// off), the oscillator frequency correction, and the data used to aid the GPS
+// receiver. Displays the time. Returns false if there is no saved state.
+static bool restore_state(void)
+{
+    struct persist_state state;
+
+    if (!persist_load(&state) || state.secs >= SECONDS_PER_DAY ||
+            state.days <= GPS_EPOCH_DAYS) {
+        return false;
     }
+
+    INTCONbits.T0IE = 0;
+    timebase_restore(state.days, state.secs, state.tick_correction);
+    seen_sec_count = sec_count;
+    INTCONbits.T0IE = 1;
+
+    gps_ecef[0] = state.gps_ecef[0];
+    gps_ecef[1] = state.gps_ecef[1];
+    gps_ecef[2] = state.gps_ecef[2];
+    gps_clock_drift = state.gps_clock_drift;
+
+    recalc_local_time(state.days, state.secs);
+    disp_cur_time();
+    return true;
 }
 
 
-// Check if a tick interrupt happened. Also updates the local time and
-// perform GPS message processing if needed.
+// Check if a tick interrupt happened or the time was resynchronized. Also
+// updates the local time and performs GPS data processing if needed.
+// The state shared with the interrupt handler is read without disabling the
+// interrupts; only the Timer0 interrupt is disabled while the time is set.
 static bool check_tick(void)
 {
+    struct timebase_snapshot now;
     bool process_gps;
+    bool ticked;
+    bool resynced = false;
+    uint8_t secs;
 
-    // Disable interrupts in the critical section
-    INTCONbits.GIEH = 0; // FIXME: Only disable Timer0 interrupt?
-
-    process_gps = gps_proc_required;
-    gps_proc_required = false;
-    if (!tick_happened && !process_gps) {
-        INTCONbits.GIEH = 1;
+    process_gps = gps_work_pending();
+    if (tick_seq == seen_tick_seq && !process_gps) {
         return false;
     }
 
+    if (process_gps && gps_process_received() &&
+            (gps_status == STATUS_OK)) {
+        // Ticks handled since the end of the message; negative if the period
+        // ended before it but is still pending
+        int8_t ticks_handled;
+        uint16_t timer = gps_time_timer;
+
+        INTCONbits.T0IE = 0;
+        PROFILE_START(profile_critical_start);
+
+        ticks_handled = (int8_t)(tick_count - gps_time_ticks);
+        if (!gps_time_captured || ticks_handled < -MAX_PERIOD_TICKS ||
+                ticks_handled > MAX_CAPTURE_TICKS) {
+            // Fall back to the current moment (late by the processing
+            // time)
+            bool tick_pending = INTCONbits.T0IF;
+
+            HAL_TIMER0_READ(timer);
+
+            if (!tick_pending && INTCONbits.T0IF) {
+                // The timer overflowed while being read
+                tick_pending = true;
+                HAL_TIMER0_READ(timer);
+            }
+
+            if (tick_pending) {
+                ticks_handled = -(int8_t)period_ticks;
+            } else {
+                timer = TIMER0_SINCE_TICK(timer);
+                ticks_handled = 0;
+            }
+        }
+
+        timebase_set(gps_days, gps_centisecs, gps_time_delay, timer,
+                ticks_handled);
+
+        PROFILE_END(PROFILE_CRITICAL, profile_critical_start);
+        INTCONbits.T0IE = 1;
+        resynced = true;
+    }
+
+    timebase_snapshot(&now);
+    secs = (uint8_t)(now.sec_count - seen_sec_count);
+    seen_sec_count = now.sec_count;
+    ticked = (now.seq != seen_tick_seq);
+    seen_tick_seq = now.seq;
+
     if (process_gps) {
-        // Allow ticks during GPS calculations
-        INTCONbits.GIEH = 1;
+        adapt_gps_rate(resynced);
+    }
+
+    // The local time only needs a full recalculation after a resync;
+    // otherwise it is advanced when a second elapses.
+    if (resynced) {
+        recalc_local_time(now.days, now.secs);
+    } else if (secs != 0) {
+        advance_local_time(secs);
+    }
+
+    if (secs < save_countdown) {
+        save_countdown -= secs;
+    } else {
+        save_countdown = 0;
+    }
+    if (resynced) {
+        // The time of the fix (the last tick may be up to a Timer0 period
+        // before it)
+        save_state(gps_days, gps_centisecs / 100);
+    }
 
-        gps_process_received();
+    return ticked || resynced;
+}
 
-        uint64_t local_days = gps_deciseconds / 8640000;
-        uint64_t local_decisecs = gps_deciseconds % 8640000;
-        uint64_t local_ticks = TICKS_PER_DAY * local_decisecs / 8640000;
-        uint64_t local_timer = (local_decisecs % 8640000) * 65536 / 8640000;
 
-        INTCONbits.GIEH = 0;
+// Adapt the interval of the GPS clock messages to the error of the clock at
+// the last fix. The interval is doubled while the error expected at the next
+// fix (twice the last one) stays within the budget, and set back to the
+// minimum after a larger error, a time jump, a GPS error or an unsynchronized
+// fix.
+static void adapt_gps_rate(bool resynced)
+{
+    uint16_t interval = gps_msg_interval;
 
-        if (gps_status == STATUS_OK) {
-            // Prevent the timer from immediately generating a tick
-            TMR0H = 0;
+    if (!gps_is_sync || gps_status != STATUS_OK) {
+        interval = GPS_MIN_MSG_INTERVAL;
+    } else if (resynced) {
+        int32_t error = timebase_error;
 
-            cur_days = (uint16_t)local_days;
-            cur_ticks = (uint32_t)local_ticks;
+        if (error < 0) {
+            error = -error; // TIMEBASE_JUMP stays positive
+        }
 
-            TMR0L = local_timer & 0xFF;
-            TMR0H = (local_timer >> 8) & 0xFF;
+        if (error > RATE_ERROR_BUDGET) {
+            interval = GPS_MIN_MSG_INTERVAL;
+        } else if (error <= RATE_ERROR_BUDGET / 2) {
+            interval *= 2;
+            if (interval > GPS_MAX_MSG_INTERVAL) {
+                interval = GPS_MAX_MSG_INTERVAL;
+            }
         }
     }
 
-    // Convert ticks to days and seconds
-    uint16_t local_days = cur_days;
-    uint32_t local_secs = (uint32_t)((uint64_t)cur_ticks * 86400
-        / TICKS_PER_DAY);
+    if (interval != gps_msg_interval) {
+        gps_set_msg_interval((uint8_t)interval);
+    }
+}
 
-    tick_happened = false;
 
-    INTCONbits.GIEH = 1;
+// Save the clock state after a fix, when due (see save_countdown)
+static void save_state(uint16_t days, uint32_t day_secs)
+{
+    struct persist_state state;
 
-    recalc_local_time(local_days, local_secs);
+    if (save_countdown != 0) {
+        return;
+    }
 
-    return true;
+    if (!position_polled) {
+        gps_poll_position();
+        position_polled = true;
+        return;
+    }
+
+    state.days = days;
+    state.secs = day_secs;
+    state.tick_correction = tick_correction;
+    state.gps_ecef[0] = gps_ecef[0];
+    state.gps_ecef[1] = gps_ecef[1];
+    state.gps_ecef[2] = gps_ecef[2];
+    state.gps_clock_drift = gps_clock_drift;
+    if (!persist_save(&state)) {
+        // The previous save is still in progress: retry at the next fix
+        return;
+    }
+
+    position_polled = false;
+    save_countdown = SAVE_INTERVAL_SECS;
 }
 
 
@@ -221,54 +413,102 @@ static void setup(void)
     TRISC = 0b11011000; // Serial TX and RX need to be set to 1
     TRISD = 0b00000000;
 
+    // Display off (see the display port images)
+    LATA = 0;
+    LATB = 0;
+    LATC = 0;
+    LATD = 0;
+
     // Serial port and interrupt configuration
     RCSTA = 0b10000000; // Serial port enabled, 8-bit, RX disabled (for now)
     TXSTA = 0b00100000; // 8-bit, TX enabled, async, low speed
     BAUDCON = 0b00000000; // Default baud rate control
     SPBRGH = 0;
-    SPBRG = 71; // Base frequency / (64 * (71 + 1)) = 4800 baud
+    SPBRG = 71; // Base frequency / (64 * (71 + 1)) = 4800 baud (see gps_init)
 
-    IPR1 = 0b00100000; // Serial RX is high priority
-    PIE1 = 0b00000000; // Serial RX interrupt disabled (for now)
+    IPR1 = 0b00110000; // Serial RX and TX are high priority
+    PIE1 = 0b00000000; // Serial interrupts disabled (for now)
+    IPR2 = 0b00010000; // EEPROM write is high priority
+    PIE2 = 0b00000000; // EEPROM interrupt disabled (enabled while writing)
 
     // Timer and interrupt configuration
-    T0CON = 0b10000010; // Timer0 enabled, 1:8 pre-scaler used
+    T0CON = 0b10000110; // Timer0 enabled, 1:128 pre-scaler (TMR0_PRESCALER)
+    start_period(1);
 
     INTCONbits.T0IE = 1;    // Interrupt on Timer0 overflow
     INTCON2bits.TMR0IP = 1; // The Timer0 overflow interrupt is high priority
     INTCONbits.T0IF = 0;    // Acknowledge any existing Timer0 interrupt
 
+    PROFILE_INIT();         // Timer1 for the interrupt profiler, if enabled
+
     INTCONbits.PEIE = 1;    // Enable peripheral interrupts
     INTCONbits.GIEH = 1;    // Enable general interrupts
 
     // Date/time setup
-    utc_offset_secs = UTC_OFFSET_SECS;
+    tz_rules = tz_zone_rules;
+    tz_rule_count = tz_zone_rule_count;
+}
 
-    dst_start.month = DST_START_MONTH;
-    dst_start.week = DST_START_WEEK;
-    dst_start.day = DST_START_DAY;
-    dst_start.hour = DST_START_HOUR;
 
-    dst_end.month = DST_END_MONTH;
-    dst_end.week = DST_END_WEEK;
-    dst_end.day = DST_END_DAY;
-    dst_end.hour = DST_END_HOUR;
+// Number of ticks of the next Timer0 period: until the next tick if the main
+// loop needs every tick, or the end of the tick in which the next second
+// elapses, or sooner if the GPS code needs a tick or the status LED changes
+static uint8_t next_period_ticks(void)
+{
+    uint8_t ticks = every_tick ? 1 : timebase_ticks_to_second();
+    uint8_t gps_ticks = gps_ticks_until_due();
+    bool led = status_led_at(tick_count);
+
+    if (gps_ticks < ticks) {
+        ticks = gps_ticks;
+    }
+
+    for (uint8_t i = 1 ; i < ticks ; i += 1) {
+        if (status_led_at((uint8_t)(tick_count + i)) != led) {
+            return i;
+        }
+    }
+
+    return ticks;
+}
+
+
+// Reload Timer0 (just after its overflow) so that it overflows again after the
+// given number of ticks
+static void start_period(uint8_t ticks)
+{
+    period_ticks = ticks;
+    HAL_TIMER0_ADD_HIGH((uint8_t)(256U - ticks * (TICK_COUNTS / 256U)));
 }
 
 
-// Wait a certain number of ticks, while updating the local time.
+// Status LED state during a tick: the GPS status is indicated by a number of
+// flashes (one every 4 ticks) repeated every 32 ticks
+static bool status_led_at(uint8_t tick)
+{
+    uint8_t blink_count = tick & 0x1f;
+
+    return ((blink_count & 0b11) == 0) && (blink_count >> 2) < gps_status;
+}
+
+
+// Wait a certain number of ticks, while updating the local time. Sleeps until
+// the next interrupt when there is nothing to do.
 static void delay(uint8_t ticks)
 {
     while (ticks > 0) {
         if (check_tick()) {
             ticks -= 1;
+        } else {
+            Sleep();
         }
     }
 }
 
 
-// Update the display depending on the disp_value variable
-static void update_display(void)
+// Show the hours digits, in packed BCD (tens: 0-2, 3 = blank; ones: 0-9,
+// 15 = blank)
+static void disp_hours(uint8_t bcd)
 {
     // Bits to enable on port B to get the correct hour tens
     static const uint8_t hour_tens_match[4] = {
@@ -278,54 +518,138 @@ static void update_display(void)
         0b00000000, // Blank
     };
 
+    // Port B: -021XXXX 0/1/2 hour tens (0 or 1 of them), XXXX = hours ones
+    uint8_t image = hour_tens_match[(bcd >> 4) & 0b11] | (bcd & 0b00001111);
+
+    if (image != disp_latb) {
+        disp_latb = image;
+        LATB = (LATB & 0b10000000) | image;
+    }
+}
+
+
+// Show the minutes digits, in packed BCD (tens: 0-7; ones: 0-9, 15 = blank)
+static void disp_minutes(uint8_t bcd)
+{
     // Port A: ----XXXX XXXX = minutes ones
-    LATA = (LATA & 0b11110000) | (disp_value.digit3 & 0b00001111);
+    uint8_t image = bcd & 0b00001111;
 
-    // Port B: -021XXXX 0/1/2 hour tens (0 or 1 of them), XXXX = hours ones
-    LATB = (LATB & 0b10000000) |
-            (hour_tens_match[disp_value.digit0]) |
-            (disp_value.digit1 & 0b00001111);
+    if (image != disp_lata) {
+        disp_lata = image;
+        LATA = (LATA & 0b11110000) | image;
+    }
 
     // Port C: --S--XXX S = left separator, XXX = minutes tens
-    LATC = (LATC & 0b11011000) | (disp_value.left_sep ? 0b00100000 : 0) |
-            (disp_value.digit2 & 0b00000111);
+    image = (disp_latc & LATC_LEFT_SEP) | ((bcd >> 4) & 0b00000111);
+    if (image != disp_latc) {
+        disp_latc = image;
+        LATC = (LATC & 0b11011000) | image;
+    }
+}
 
+
+// Show the seconds digits, in packed BCD (tens: 0-7; ones: 0-9, 15 = blank)
+static void disp_seconds(uint8_t bcd)
+{
     // Port D: SXXXYYYY S = right separator, XXX = sec. tens, YYYY = sec. ones
-    LATD = (disp_value.right_sep ? 0b10000000 : 0) |
-            ((disp_value.digit4 << 4U) & 0b01110000) |
-            (disp_value.digit5 & 0b00001111);
+    uint8_t image = (disp_latd & LATD_RIGHT_SEP) | (bcd & 0b01111111);
+
+    if (image != disp_latd) {
+        disp_latd = image;
+        LATD = image;
+    }
+}
+
+
+// Show the separators between the hours and minutes (left) and the minutes
+// and seconds (right)
+static void disp_separators(bool left, bool right)
+{
+    uint8_t image = (disp_latc & 0b00000111) | (left ? LATC_LEFT_SEP : 0);
+
+    if (image != disp_latc) {
+        disp_latc = image;
+        LATC = (LATC & 0b11011000) | image;
+    }
+
+    image = (disp_latd & 0b01111111) | (right ? LATD_RIGHT_SEP : 0);
+    if (image != disp_latd) {
+        disp_latd = image;
+        LATD = image;
+    }
+}
+
+
+// Show the same value on all the digits (truncated to the bits of each digit),
+// with or without the separators
+static void disp_all(uint8_t digit, bool separators)
+{
+    uint8_t bcd = (uint8_t)(digit << 4) | digit;
+
+    disp_hours(bcd);
+    disp_minutes(bcd);
+    disp_seconds(bcd);
+    disp_separators(separators, separators);
+    shown_hour = NOT_SHOWN;
 }
 
 
-// Display the current time.
+// Display the current time. Only the digits that changed since the last call
+// are written: nothing changes between the ticks of a second. The local time
+// is in packed BCD, so its digits go to the ports with masks only. Between
+// 2:00:00 and 3:00:00, the cathode poisoning prevention sequence advances
+// instead, by one digit per second.
 static void disp_cur_time(void)
 {
+    // Digit displayed by the cathode poisoning prevention sequence
+    static uint8_t poison_digit = 0;
+
+    uint8_t hour = local_time.hour;
+    uint8_t minute = local_time.minute;
+    uint8_t second = local_time.second;
+
+    if (second == shown_second && minute == shown_minute &&
+            hour == shown_hour) {
+        return;
+    }
+
     // Between 2:00:00 and 3:00:00, display all digits sequentially
     // This helps preventing cathode poisoning
-    if (local_time.hour == 2) {
-        uint8_t val = cur_ticks % 10;
-
-        disp_value.left_sep = 0;
-        disp_value.right_sep = 0;
-
-        disp_value.digit0 = val;
-        disp_value.digit1 = val;
-        disp_value.digit2 = val;
-        disp_value.digit3 = val;
-        disp_value.digit4 = val;
-        disp_value.digit5 = val;
-    } else {
-        bool separator_status = local_time.second & 1;
+    if (hour == POISON_HOUR) {
+        uint8_t val = poison_digit;
+
+        poison_digit = (val == 9) ? 0 : (uint8_t)(val + 1);
+        disp_all(val, false);
+        shown_hour = hour;
+        shown_minute = minute;
+        shown_second = second;
+        return;
+    }
+
+    if (hour != shown_hour) {
+        disp_hours(hour);
+        shown_hour = hour;
+        shown_minute = NOT_SHOWN;
+    }
+    if (minute != shown_minute) {
+        disp_minutes(minute);
+        shown_minute = minute;
+    }
+    disp_seconds(second);
+    shown_second = second;
+}
 
-        disp_value.left_sep = separator_status && (gps_status == STATUS_OK);
-        disp_value.right_sep = separator_status && gps_is_sync;
 
-        disp_value.digit0 = local_time.hour / 10;
-        disp_value.digit1 = local_time.hour % 10;
-        disp_value.digit2 = local_time.minute / 10;
-        disp_value.digit3 = local_time.minute % 10;
-        disp_value.digit4 = local_time.second / 10;
-        disp_value.digit5 = local_time.second % 10;
+// Show the GPS status on the separators, which blink with the seconds of the
+// displayed time. Called on each wakeup, so that a status change shows without
+// waiting for the next second; only changed images are written.
+static void disp_status(void)
+{
+    bool blink = shown_second & 1; // Parity of the ones digit
+
+    if (shown_hour == NOT_SHOWN || shown_hour == POISON_HOUR) {
+        return;
     }
-    update_display();
+
+    disp_separators(blink && (gps_status == STATUS_OK), blink && gps_is_sync);
 }
@@ -0,0 +1,174 @@
+// 150189-71 Nixie Clock alternative firmware
+// Distributed under the terms of the MIT license.
+
+#include "persist.h"
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "hal.h"
+
+// The EEPROM holds a journal of records, written in turn to the slots so that
+// the wear is spread over the whole EEPROM. A record is a sequence number
+// (incremented on each save), the state (in the byte order of the CPU), and a
+// CRC-7 of the previous bytes. The latest valid record (highest sequence
+// number) holds the state.
+//
+// A save first sets the CRC byte to CRC_INVALID (bit 7 set, which a CRC-7
+// never has), then writes the other bytes, and the CRC last: a record
+// interrupted by a power loss is never valid, whatever the mix of old and new
+// bytes it holds.
+#define EEPROM_SIZE 256
+#define RECORD_SIZE (sizeof(struct persist_state) + 2)
+#define RECORD_CRC (RECORD_SIZE - 1)
+#define SLOT_COUNT (EEPROM_SIZE / RECORD_SIZE)
+
+// CRC-7 polynomial (x^7 + x^3 + 1, computed in the upper bits of a byte) and
+// initial value. The initial value identifies the record format.
+#define CRC_POLY 0x12
+#define CRC_INIT 0x5a
+#define CRC_INVALID 0xff
+
+// Record being written by the EEPROM interrupt: contents, address, and step of
+// the next write (0 for the invalidation of the CRC, then 1 + the position of
+// the byte in the record; RECORD_SIZE + 1 when idle)
+static uint8_t record[RECORD_SIZE];
+static uint8_t record_addr;
+static volatile uint8_t record_step = RECORD_SIZE + 1;
+
+// Slot and sequence number of the next record
+static uint8_t next_slot;
+static uint8_t next_seq;
+
+static uint8_t persist_crc(const uint8_t *data);
+static void persist_write_next(void);
+
+
+bool persist_load(struct persist_state *state)
+{
+    uint8_t *state_bytes = (uint8_t *)state;
+    uint8_t buf[RECORD_SIZE];
+    uint8_t addr = 0;
+    bool found = false;
+
+    next_slot = 0;
+    next_seq = 0;
+
+    for (uint8_t slot = 0 ; slot < SLOT_COUNT ; slot += 1) {
+        for (uint8_t i = 0 ; i < RECORD_SIZE ; i += 1) {
+            HAL_EEPROM_READ(addr, buf[i]);
+            addr += 1;
+        }
+
+        if (buf[RECORD_CRC] != persist_crc(buf)) {
+            continue;
+        }
+
+        // Sequence numbers wrap around; the valid ones are within SLOT_COUNT
+        // of each other
+        if (found && (int8_t)(buf[0] - next_seq) < 0) {
+            continue;
+        }
+
+        for (uint8_t i = 0 ; i < sizeof(struct persist_state) ; i += 1) {
+            state_bytes[i] = buf[i + 1];
+        }
+
+        found = true;
+        next_seq = buf[0] + 1;
+        next_slot = (slot + 1 == SLOT_COUNT) ? 0 : slot + 1;
+    }
+
+    return found;
+}
+
+
+bool persist_save(const struct persist_state *state)
+{
+    const uint8_t *state_bytes = (const uint8_t *)state;
+
+    if (persist_busy()) {
+        return false;
+    }
+
+    record[0] = next_seq;
+    for (uint8_t i = 0 ; i < sizeof(struct persist_state) ; i += 1) {
+        record[i + 1] = state_bytes[i];
+    }
+    record[RECORD_CRC] = persist_crc(record);
+
+    record_addr = next_slot * RECORD_SIZE;
+    next_slot = (next_slot + 1 == SLOT_COUNT) ? 0 : next_slot + 1;
+    next_seq += 1;
+
+    INTCONbits.GIEH = 0;
+    record_step = 0;
+    persist_write_next();
+    INTCONbits.GIEH = 1;
+
+    return true;
+}
+
+
+bool persist_busy(void)
+{
+    return record_step <= RECORD_SIZE;
+}
+
+
+void persist_handle_int(void)
+{
+    PIR2bits.EEIF = 0;
+    persist_write_next();
+}
+
+
+// Start the next write of the record that changes the EEPROM contents (this
+// saves time and wears the EEPROM less), or finish the record. Called with the
+// interrupts disabled (the unlock sequence of the write must not be
+// interrupted).
+static void persist_write_next(void)
+{
+    while (record_step <= RECORD_SIZE) {
+        uint8_t step = record_step;
+        uint8_t addr;
+        uint8_t val;
+        uint8_t old;
+
+        record_step = step + 1;
+
+        if (step == 0) {
+            addr = record_addr + RECORD_CRC;
+            val = CRC_INVALID;
+        } else {
+            addr = record_addr + step - 1;
+            val = record[step - 1];
+        }
+
+        HAL_EEPROM_READ(addr, old);
+        if (old != val) {
+            HAL_EEPROM_WRITE(addr, val);
+            PIE2bits.EEIE = 1;
+            return;
+        }
+    }
+
+    PIE2bits.EEIE = 0;
+}
+
+
+// CRC of a record (all bytes but the CRC), in bits 0-6
+static uint8_t persist_crc(const uint8_t *data)
+{
+    uint8_t crc = CRC_INIT;
+
+    for (uint8_t i = 0 ; i < RECORD_CRC ; i += 1) {
+        crc ^= data[i];
+        for (uint8_t bit = 0 ; bit < 8 ; bit += 1) {
+            crc = (crc & 0x80) ? (uint8_t)(crc << 1) ^ CRC_POLY :
+                    (uint8_t)(crc << 1);
+        }
+    }
+
+    return crc >> 1;
+}
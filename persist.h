@@ -0,0 +1,44 @@
+// 150189-71 Nixie Clock alternative firmware
+// Distributed under the terms of the MIT license.
+
+// Clock state saved in the data EEPROM, so that the time can be displayed and
+// sent to the GPS receiver (to shorten its time to fix) at the next start.
+
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct persist_state {
+    // Time of the save: days since 1/1/1970, seconds since the start of the
+    // day (UTC)
+    uint16_t days;
+    uint32_t secs;
+
+    // Oscillator frequency correction (see timebase.h)
+    int32_t tick_correction;
+
+    // Receiver position (ECEF, in meters; all 0 if unknown) and clock drift
+    // (Hz), see gps.h
+    int32_t gps_ecef[3];
+    int32_t gps_clock_drift;
+};
+
+// Read the latest saved state. Returns false if there is none (erased EEPROM)
+// or if all the saved records are corrupted. Must be called at startup, before
+// persist_save().
+bool persist_load(struct persist_state *state);
+
+// Start saving the state. The bytes are written in the background, by
+// persist_handle_int() (4 ms per byte). Returns false, without saving, if the
+// previous save is not finished.
+bool persist_save(const struct persist_state *state);
+
+// Return true while a save is in progress
+bool persist_busy(void);
+
+// Handle the EEPROM write interrupt: write the next byte of the record
+void persist_handle_int(void);
+
+#endif
@@ -0,0 +1,231 @@
+// 150189-71 Nixie Clock alternative firmware
+// Distributed under the terms of the MIT license.
+
+#include "profile.h"
+
+#ifdef ISR_PROFILE
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "gps.h"
+#include "hal.h"
+
+// Jumper input, starting a dump when it changes (see nixieclock.c)
+#define JUMPER PORTCbits.RC3
+
+#define HISTOGRAM_SIZE 8
+
+// Dump line, and position in the dump (DUMP_IDLE if none in progress): one
+// line per source, then the receive FIFO count
+#define LINE_SIZE 62
+#define DUMP_IDLE 0xff
+
+struct profile_stats {
+    uint16_t min;
+    uint16_t max;
+    uint16_t histogram[HISTOGRAM_SIZE];
+};
+
+uint16_t profile_int_start;
+uint16_t profile_source_start;
+uint16_t profile_critical_start;
+
+static struct profile_stats stats[PROFILE_SOURCES];
+static uint16_t rx_full_count;
+
+// Cost of recording a measurement, in instruction cycles, and number of
+// measurements recorded during the current interrupt
+static uint16_t record_cycles;
+static uint8_t int_records;
+
+static bool last_jumper;
+static uint8_t dump_pos = DUMP_IDLE;
+
+static const char *const source_names[PROFILE_SOURCES] = {
+    "INT", "TLAT", "TICK", "RX", "TX", "EE", "CRIT",
+};
+
+static void profile_reset(struct profile_stats *source_stats);
+static uint8_t profile_format(char *line, uint8_t pos);
+static uint8_t put_str(char *line, uint8_t pos, const char *str);
+static uint8_t put_hex(char *line, uint8_t pos, uint16_t val);
+
+
+void profile_init(void)
+{
+    uint16_t start;
+    uint16_t end;
+
+    // 16-bit reads, 1:1 pre-scaler, instruction clock, enabled
+    T1CON = 0b10000001;
+
+    // Measure the recording of a new minimum and maximum in the last bucket
+    // (the longest path), from the end timestamp to the next timestamp, as in
+    // an interrupt handling several sources
+    profile_reset(&stats[PROFILE_TICK]);
+    record_cycles = 0;
+    HAL_TIMER1_READ(start);
+    profile_record(PROFILE_TICK, 0xfff0);
+    HAL_TIMER1_READ(end);
+    record_cycles = (uint16_t)(end - start);
+    int_records = 0;
+
+    for (uint8_t i = 0 ; i < PROFILE_SOURCES ; i += 1) {
+        profile_reset(&stats[i]);
+    }
+    rx_full_count = 0;
+
+    last_jumper = JUMPER;
+    dump_pos = DUMP_IDLE;
+}
+
+
+void profile_record(enum profile_source source, uint16_t cycles)
+{
+    struct profile_stats *source_stats = &stats[source];
+    uint8_t bucket;
+
+    if (source == PROFILE_INT) {
+        // Without the recording of the measurements of the interrupt sources
+        uint16_t overhead = record_cycles * int_records;
+
+        cycles = (cycles > overhead) ? cycles - overhead : 0;
+        int_records = 0;
+    } else if (source != PROFILE_CRITICAL) {
+        int_records += 1;
+    }
+
+    bucket = (uint8_t)(cycles >> 8);
+
+    if (cycles < source_stats->min) {
+        source_stats->min = cycles;
+    }
+    if (cycles > source_stats->max) {
+        source_stats->max = cycles;
+    }
+
+    if (bucket >= HISTOGRAM_SIZE) {
+        bucket = HISTOGRAM_SIZE - 1;
+    }
+    if (source_stats->histogram[bucket] != 0xffff) {
+        source_stats->histogram[bucket] += 1;
+    }
+}
+
+
+void profile_rx_full(void)
+{
+    if (rx_full_count != 0xffff) {
+        rx_full_count += 1;
+    }
+}
+
+
+void profile_poll(void)
+{
+    char line[LINE_SIZE];
+
+    if (dump_pos == DUMP_IDLE) {
+        bool jumper_val = JUMPER;
+
+        if (jumper_val == last_jumper) {
+            return;
+        }
+        last_jumper = jumper_val;
+        dump_pos = 0;
+    }
+
+    if (!gps_tx_idle()) {
+        // Previous line or command still being sent
+        return;
+    }
+
+    gps_send_raw(line, profile_format(line, dump_pos));
+
+    dump_pos += 1;
+    if (dump_pos > PROFILE_SOURCES) {
+        dump_pos = DUMP_IDLE;
+    }
+}
+
+
+bool profile_dumping(void)
+{
+    return dump_pos != DUMP_IDLE;
+}
+
+
+static void profile_reset(struct profile_stats *source_stats)
+{
+    source_stats->min = 0xffff;
+    source_stats->max = 0;
+    for (uint8_t i = 0 ; i < HISTOGRAM_SIZE ; i += 1) {
+        source_stats->histogram[i] = 0;
+    }
+}
+
+
+// Format a line of the dump, and reset the statistics it holds. Returns its
+// length.
+static uint8_t profile_format(char *line, uint8_t pos)
+{
+    struct profile_stats source_stats;
+    uint8_t length = put_str(line, 0, "PROF ");
+
+    if (pos == PROFILE_SOURCES) {
+        uint16_t count;
+
+        INTCONbits.GIEH = 0;
+        count = rx_full_count;
+        rx_full_count = 0;
+        INTCONbits.GIEH = 1;
+
+        length = put_str(line, length, "RXFULL");
+        length = put_hex(line, length, count);
+    } else {
+        INTCONbits.GIEH = 0;
+        source_stats = stats[pos];
+        profile_reset(&stats[pos]);
+        INTCONbits.GIEH = 1;
+
+        length = put_str(line, length, source_names[pos]);
+        length = put_hex(line, length, source_stats.min);
+        length = put_hex(line, length, source_stats.max);
+        for (uint8_t i = 0 ; i < HISTOGRAM_SIZE ; i += 1) {
+            length = put_hex(line, length, source_stats.histogram[i]);
+        }
+    }
+
+    return put_str(line, length, "\r\n");
+}
+
+
+static uint8_t put_str(char *line, uint8_t pos, const char *str)
+{
+    while (*str) {
+        line[pos] = *str;
+        pos += 1;
+        str += 1;
+    }
+
+    return pos;
+}
+
+
+// Append a space and a 4-digit hexadecimal value
+static uint8_t put_hex(char *line, uint8_t pos, uint16_t val)
+{
+    static const char digits[16] = "0123456789abcdef";
+
+    line[pos] = ' ';
+    for (uint8_t shift = 16 ; shift != 0 ; ) {
+        shift -= 4;
+        pos += 1;
+        line[pos] = digits[(val >> shift) & 0xf];
+    }
+
+    return pos + 1;
+}
+
+#endif
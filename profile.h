@@ -0,0 +1,119 @@
+// 150189-71 Nixie Clock alternative firmware
+// Distributed under the terms of the MIT license.
+
+// Interrupt profiler, for debug builds: set the ISR_PROFILE macro in the
+// project settings to enable it. Without it, the macros below expand to
+// nothing.
+//
+// Timer1 counts the instruction cycles (free-running, wrapping every 65536
+// cycles, about 12 ms). The durations of the interrupts, of the handling of
+// each interrupt source, and of the main loop section run with the Timer0
+// interrupt disabled are measured, as well as the Timer0 tick latency (from the
+// overflow to the start of their handling). For each, the minimum, maximum and
+// a histogram (buckets of 256 cycles, the last one for 1792 cycles and more)
+// are kept. The receive interrupts which leave a byte in the receive FIFO (one
+// more byte would be an overrun) are counted.
+//
+// The statistics are sent as text on the serial TX line (ignored by the GPS
+// receiver in binary mode) when the jumper input (RC3) changes, then reset.
+// Each line is "PROF <source> <min> <max> <histogram buckets>" for a source,
+// or "PROF RXFULL <count>", with hexadecimal values.
+//
+// Taking a timestamp costs 2 instruction cycles. Recording a measurement runs
+// after its end timestamp, and takes about 50 cycles: this cost is measured by
+// profile_init(), and subtracted from the duration of an interrupt for each
+// measurement recorded during it. It is not subtracted from the latency of the
+// ticks and from the main loop section, which may include the end of another
+// interrupt.
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#ifdef ISR_PROFILE
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "hal.h"
+#include "timebase.h"
+
+enum profile_source {
+    PROFILE_INT,            // Whole interrupt handler
+    PROFILE_TICK_LATENCY,   // Timer0 overflow to tick handling
+    PROFILE_TICK,           // Tick handling
+    PROFILE_RX,             // Serial reception
+    PROFILE_TX,             // Serial transmission
+    PROFILE_EEPROM,         // EEPROM write completion
+    PROFILE_CRITICAL,       // Main loop with the Timer0 interrupt disabled
+    PROFILE_SOURCES,
+};
+
+// Start timestamps: of the interrupt, of the interrupt source being handled,
+// and of the main loop section with the Timer0 interrupt disabled
+extern uint16_t profile_int_start;
+extern uint16_t profile_source_start;
+extern uint16_t profile_critical_start;
+
+// Start Timer1 (at setup)
+void profile_init(void);
+
+// Record a duration or a latency, in instruction cycles
+void profile_record(enum profile_source source, uint16_t cycles);
+
+// Record a receive interrupt leaving a byte in the receive FIFO
+void profile_rx_full(void);
+
+// Send the next line of the statistics if a dump is in progress, or start one
+// if the jumper input changed (main loop)
+void profile_poll(void);
+
+// Return true while a dump is in progress (the main loop then runs on every
+// tick)
+bool profile_dumping(void);
+
+#define PROFILE_INIT() profile_init()
+
+// Timestamp the start of a measurement
+#define PROFILE_START(start) HAL_TIMER1_READ(start)
+
+// Record the duration since the start timestamp
+#define PROFILE_END(source, start) do { \
+    uint16_t profile_end_; \
+    HAL_TIMER1_READ(profile_end_); \
+    profile_record((source), (uint16_t)(profile_end_ - (start))); \
+} while (0)
+
+// Record the latency of the tick being handled: Timer0 counts the cycles since
+// its overflow, divided by the prescaler (the latencies beyond 65535 cycles
+// are recorded as 65535)
+#define PROFILE_TICK_LATENCY() do { \
+    uint16_t profile_timer_; \
+    HAL_TIMER0_READ(profile_timer_); \
+    profile_record(PROFILE_TICK_LATENCY, \
+            (profile_timer_ < 0x10000 / TMR0_PRESCALER) ? \
+            (uint16_t)(profile_timer_ * TMR0_PRESCALER) : 0xffff); \
+} while (0)
+
+// Count a receive interrupt that leaves a byte in the FIFO
+#define PROFILE_RX_FULL() do { \
+    if (PIR1bits.RCIF) { \
+        profile_rx_full(); \
+    } \
+} while (0)
+
+#define PROFILE_POLL() profile_poll()
+#define PROFILE_DUMPING() profile_dumping()
+
+#else
+
+#define PROFILE_INIT() do { } while (0)
+#define PROFILE_START(start) do { } while (0)
+#define PROFILE_END(source, start) do { } while (0)
+#define PROFILE_TICK_LATENCY() do { } while (0)
+#define PROFILE_RX_FULL() do { } while (0)
+#define PROFILE_POLL() do { } while (0)
+#define PROFILE_DUMPING() false
+
+#endif
+
+#endif
@@ -1,25 +1,27 @@
 // 150189-71 Nixie Clock alternative firmware
 // Distributed under the terms of the MIT license.
 
-// Edit this file to change the time zone and DST settings.
+// Edit this file to change the time zone or the GPS receiver protocol.
 
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
-// Settings for CET/CEST
+// Time zone, one of the zones compiled in tzdata.h (Europe/Paris: CET/CEST).
+// To add a zone, regenerate the tables with "make tzdata TZ_ZONES=..." in the
+// tests directory.
 
-#define UTC_OFFSET_SECS 3600 // Offset added to UTC to get the standard time
+#define TIME_ZONE TZ_EUROPE_PARIS
 
-// The following defines should be set to 0 disable DST
-
-#define DST_START_MONTH 3 // Month number for DST start, 1 to 12
-#define DST_START_WEEK 5 // Week number for DST start, 1 (first) - 5 (last)
-#define DST_START_DAY 6 // Day number for DST start, 0 (Mon) - 6 (Sun)
-#define DST_START_HOUR 3 // DST start hour (xx:00:00 DST)
+// Protocol of the GPS receiver: GPS_DRIVER_SIRF (SiRF binary, the receiver of
+// the kit) or GPS_DRIVER_UBX (u-blox UBX, for replacement modules). The tests
+// also build the firmware with the other driver, defined on the command line.
+#ifndef GPS_DRIVER
+#define GPS_DRIVER GPS_DRIVER_SIRF
+#endif
 
-#define DST_END_MONTH 10 // Month number for DST end, 1 to 12
-#define DST_END_WEEK 5 // Week number for DST end, 1 (first) - 5 (last)
-#define DST_END_DAY 6 // Day number for DST end, 0 (Mon) - 6 (Sun)
-#define DST_END_HOUR 3 // DST end hour (xx:00:00 DST)
+// Delay between the start of a GPS second and the start of the messages
+// reporting it, as output by the receiver (in milliseconds, up to 400). It is
+// compensated when setting the time, together with the transmission time.
+#define GPS_MSG_OFFSET_MS 100
 
 #endif
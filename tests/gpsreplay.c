@@ -0,0 +1,132 @@
+// Replay of receiver output captures through the firmware GPS code.
+//
+// Runs the whole firmware on the PIC simulator with the virtual GPS receiver
+// until the clock is synchronized, then replays each capture file (the raw
+// bytes output by a receiver) through the serial port, and reports the
+// messages received with a valid frame, and the errors, per gps_status_val
+// category, and the last time decoded (UTC). The output is compared with
+// captures/expected.txt by "make test". gpsreplay_ubx is built with the UBX
+// driver, for the captures of captures/ubx.
+//
+// Usage: gpsreplay [-b <capture baud rate>] [-s <speed-up>] <capture>...
+//
+// The capture baud rate defaults to 38400. The bytes are sent back to back, at
+// the capture baud rate multiplied by the speed-up (default 1); the PIC serial
+// port is switched to that rate. The simulated firmware takes no time, so the
+// replay is not limited by the parser speed (see "make bench" for its cost).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GPS_MSG_STATS
+#include "gps.h"
+#include "gpssim.h"
+#include "picsim.h"
+
+// Start of the simulation (15/6/2021 12:00:00 UTC), and time given to the
+// firmware to synchronize before the replay
+#define START_TIME 1623758400
+#define SYNC_SECS 60
+
+static const char *const status_names[GPS_STATUS_COUNT] = {
+    "ok", "no_data", "serial", "overflow", "seq", "csum", "type",
+};
+
+
+// Replay a capture in a new process (the firmware state cannot be reset).
+// Returns false if it cannot be read.
+static bool replay(const char *path, uint32_t baud)
+{
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(2);
+    }
+
+    if (pid == 0) {
+        time_t time;
+        struct tm tm;
+
+        sim_init(START_TIME);
+        gpssim_ubx = (GPS_DRIVER == GPS_DRIVER_UBX);
+        gpssim_init();
+        sim_run(SYNC_SECS);
+        if (!gps_is_sync) {
+            fprintf(stderr, "%s: clock not synchronized\n", path);
+            exit(1);
+        }
+
+        memset(gps_msg_stats, 0, sizeof(gps_msg_stats));
+        if (gpssim_replay_file(path, baud) == 0) {
+            fprintf(stderr, "Cannot read %s\n", path);
+            exit(1);
+        }
+
+        while (gpssim_replaying) {
+            sim_run(1);
+        }
+        sim_run_until(sim_peer_send_end() + 1);
+
+        printf("%s:", path);
+        for (unsigned i = 0 ; i < GPS_STATUS_COUNT ; i += 1) {
+            printf(" %s=%u", status_names[i], (unsigned)gps_msg_stats[i]);
+        }
+
+        time = (time_t)gps_days * 86400 + gps_centisecs / 100;
+        gmtime_r(&time, &tm);
+        printf(" time=%04d-%02d-%02dT%02d:%02d:%02d.%02u\n", tm.tm_year + 1900,
+                tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
+                (unsigned)(gps_centisecs % 100));
+        exit(0);
+    }
+
+    return waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+            WEXITSTATUS(status) == 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    unsigned long capture_baud = 38400;
+    double speedup = 1;
+    uint32_t baud;
+    int exit_status = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:s:")) != -1) {
+        switch (opt) {
+            case 'b':
+                capture_baud = strtoul(optarg, NULL, 10);
+            break;
+            case 's':
+                speedup = strtod(optarg, NULL);
+            break;
+            default:
+                argc = 0;
+            break;
+        }
+    }
+
+    if (optind >= argc || capture_baud == 0 || !(speedup > 0)) {
+        fprintf(stderr, "Usage: %s [-b <capture baud rate>] [-s <speed-up>] "
+                "<capture>...\n", argv[0]);
+        return 2;
+    }
+
+    baud = (uint32_t)((double)capture_baud * speedup + 0.5);
+    for (int i = optind ; i < argc ; i += 1) {
+        if (!replay(argv[i], baud)) {
+            exit_status = 1;
+        }
+    }
+
+    return exit_status;
+}
@@ -0,0 +1,793 @@
+// Virtual SiRF or u-blox GPS receiver, connected to the simulated PIC serial
+// port.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gpssim.h"
+#include "sim.h"
+
+// GPS epoch (6/1/1980), in seconds since 1/1/1970
+#define GPS_EPOCH 315964800L
+
+#define SECONDS_PER_WEEK 604800L
+
+// Week reported before the receiver has a fix
+#define NO_FIX_WEEK 1711
+
+// Interval between debug messages, in seconds
+#define DEBUG_MSG_INTERVAL 30
+
+#define MAX_PAYLOAD 256
+
+// Bytes of a replayed capture queued at once (the peer queue holds 4096)
+#define REPLAY_BLOCK 1024
+
+// UBX message types (class << 8 | id)
+#define UBX_NAV 0x01
+#define UBX_NAV_POSECEF 0x0101
+#define UBX_NAV_TIMEUTC 0x0121
+#define UBX_INF_NOTICE 0x0402
+#define UBX_ACK_NAK 0x0500
+#define UBX_ACK_ACK 0x0501
+#define UBX_CFG 0x06
+#define UBX_CFG_PRT 0x0600
+#define UBX_CFG_MSG 0x0601
+#define UBX_MGA_INI 0x1340
+
+bool gpssim_ubx;
+long double gpssim_fix_time;
+bool gpssim_enabled;
+long double gpssim_msg_delay;
+bool gpssim_debug_msgs;
+uint32_t gpssim_max_baud;
+bool gpssim_aided;
+uint32_t gpssim_msg7_count;
+bool gpssim_replaying;
+
+// Output mode (u-blox: UBX output only)
+static bool binary_mode;
+
+// Binary message rates, in seconds (0 = disabled), by message id (u-blox: NAV
+// message id)
+static uint8_t msg_rates[256];
+
+// u-blox: time to fix without the initialization data
+static long double ubx_unaided_fix_time;
+
+// Start of the last second for which messages were sent (UTC)
+static long epoch;
+
+// Command reception
+static char nmea_buf[128];
+static size_t nmea_length;
+static enum {
+    CMD_START1,
+    CMD_START2,
+    CMD_LENGTH1,
+    CMD_LENGTH2,
+    CMD_PAYLOAD,
+    CMD_CSUM1,
+    CMD_CSUM2,
+    CMD_END1,
+    CMD_END2,
+} cmd_state;
+static uint8_t cmd_buf[MAX_PAYLOAD];
+static size_t cmd_length;
+static size_t cmd_pos;
+static uint16_t cmd_csum;
+
+// Capture being replayed
+static FILE *replay_file;
+
+
+static void send_msg(const uint8_t *payload, size_t length)
+{
+    uint16_t csum = 0;
+
+    if (!gpssim_enabled) {
+        return;
+    }
+
+    sim_peer_send(0xa0);
+    sim_peer_send(0xa2);
+    sim_peer_send((uint8_t)(length >> 8));
+    sim_peer_send((uint8_t)length);
+
+    for (size_t i = 0 ; i < length ; i += 1) {
+        sim_peer_send(payload[i]);
+        csum = (csum + payload[i]) & 0x7fff;
+    }
+
+    sim_peer_send((uint8_t)(csum >> 8));
+    sim_peer_send((uint8_t)csum);
+    sim_peer_send(0xb0);
+    sim_peer_send(0xb3);
+}
+
+
+static void send_nmea(const char *sentence)
+{
+    char buf[128];
+    uint8_t csum = 0;
+
+    if (!gpssim_enabled) {
+        return;
+    }
+
+    for (const char *c = sentence ; *c ; c += 1) {
+        csum ^= (uint8_t)*c;
+    }
+
+    snprintf(buf, sizeof(buf), "$%s*%02X\r\n", sentence, csum);
+    gpssim_send_raw((const uint8_t *)buf, strlen(buf));
+}
+
+
+static void put_u16(uint8_t *buf, uint16_t val)
+{
+    buf[0] = (uint8_t)(val >> 8);
+    buf[1] = (uint8_t)val;
+}
+
+
+static void put_u32(uint8_t *buf, uint32_t val)
+{
+    put_u16(buf, (uint16_t)(val >> 16));
+    put_u16(buf + 2, (uint16_t)val);
+}
+
+
+// Message 7: clock status, for the second starting at the given UTC time
+static void send_clock_status(long utc)
+{
+    uint8_t payload[20] = {7};
+    long gps_time = utc - GPS_EPOCH + GPSSIM_LEAP_SECONDS;
+    uint16_t week;
+    uint32_t tow;
+
+    if (utc < gpssim_fix_time) {
+        // Unsynchronized receiver time
+        week = NO_FIX_WEEK;
+        tow = (uint32_t)(gps_time % SECONDS_PER_WEEK) * 100;
+    } else {
+        week = (uint16_t)(gps_time / SECONDS_PER_WEEK);
+        tow = (uint32_t)(gps_time % SECONDS_PER_WEEK) * 100;
+        payload[7] = 8; // Satellites used
+    }
+
+    put_u16(payload + 1, week);
+    put_u32(payload + 3, tow);
+    put_u32(payload + 8, 96250); // Clock drift (Hz)
+    put_u32(payload + 12, 123456); // Clock bias (ns)
+    put_u32(payload + 16, (uint32_t)(gps_time % SECONDS_PER_WEEK) * 1000);
+
+    send_msg(payload, sizeof(payload));
+    gpssim_msg7_count += 1;
+}
+
+
+static void send_msg_type(uint8_t type, long utc)
+{
+    uint8_t payload[MAX_PAYLOAD] = {0};
+
+    switch (type) {
+        case 7:
+            send_clock_status(utc);
+        break;
+
+        case 2: // Measured navigation data
+            payload[0] = 2;
+            if (utc >= gpssim_fix_time) {
+                put_u32(payload + 1, (uint32_t)GPSSIM_ECEF_X);
+                put_u32(payload + 5, (uint32_t)GPSSIM_ECEF_Y);
+                put_u32(payload + 9, (uint32_t)GPSSIM_ECEF_Z);
+            }
+            send_msg(payload, 41);
+        break;
+
+        case 225: // Statistics channel
+            payload[0] = 225;
+            send_msg(payload, 39);
+        break;
+
+        case 93: // Undocumented debug message (seen with 17 to 150 bytes)
+            payload[0] = 93;
+            send_msg(payload, 200);
+        break;
+
+        default:
+        break;
+    }
+}
+
+
+static void send_ubx(uint16_t type, const uint8_t *payload, size_t length)
+{
+    uint8_t header[4] = {
+        (uint8_t)(type >> 8), (uint8_t)type, (uint8_t)length,
+        (uint8_t)(length >> 8),
+    };
+    uint8_t ck_a = 0;
+    uint8_t ck_b = 0;
+
+    if (!gpssim_enabled) {
+        return;
+    }
+
+    sim_peer_send(0xb5);
+    sim_peer_send(0x62);
+
+    for (size_t i = 0 ; i < sizeof(header) + length ; i += 1) {
+        uint8_t byte = (i < sizeof(header)) ? header[i] :
+                payload[i - sizeof(header)];
+
+        sim_peer_send(byte);
+        ck_a = (uint8_t)(ck_a + byte);
+        ck_b = (uint8_t)(ck_b + ck_a);
+    }
+
+    sim_peer_send(ck_a);
+    sim_peer_send(ck_b);
+}
+
+
+static void put_le16(uint8_t *buf, uint16_t val)
+{
+    buf[0] = (uint8_t)val;
+    buf[1] = (uint8_t)(val >> 8);
+}
+
+
+static void put_le32(uint8_t *buf, uint32_t val)
+{
+    put_le16(buf, (uint16_t)val);
+    put_le16(buf + 2, (uint16_t)(val >> 16));
+}
+
+
+// NAV-TIMEUTC: UTC time solution, for the second starting at the given UTC
+// time. The solution is a little before the second.
+static void send_time_utc(long utc)
+{
+    uint8_t payload[20] = {0};
+    long gps_time = utc - GPS_EPOCH + GPSSIM_LEAP_SECONDS;
+    time_t time = (time_t)utc;
+    struct tm tm;
+
+    gmtime_r(&time, &tm);
+
+    put_le32(payload, (uint32_t)(gps_time % SECONDS_PER_WEEK) * 1000);
+    put_le32(payload + 8, (uint32_t)-150); // Fraction of second (ns)
+    put_le16(payload + 12, (uint16_t)(tm.tm_year + 1900));
+    payload[14] = (uint8_t)(tm.tm_mon + 1);
+    payload[15] = (uint8_t)tm.tm_mday;
+    payload[16] = (uint8_t)tm.tm_hour;
+    payload[17] = (uint8_t)tm.tm_min;
+    payload[18] = (uint8_t)tm.tm_sec;
+
+    if (utc >= gpssim_fix_time) {
+        put_le32(payload + 4, 25); // Time accuracy (ns)
+        payload[19] = 0x07; // Valid time of week, week number and UTC
+    } else {
+        put_le32(payload + 4, UINT32_MAX);
+    }
+
+    send_ubx(UBX_NAV_TIMEUTC, payload, sizeof(payload));
+    gpssim_msg7_count += 1;
+}
+
+
+static void send_ubx_nav(uint8_t id, long utc)
+{
+    uint8_t payload[20] = {0};
+
+    switch (id) {
+        case UBX_NAV_TIMEUTC & 0xff:
+            send_time_utc(utc);
+        break;
+
+        case UBX_NAV_POSECEF & 0xff: // Position (cm) and its accuracy
+            if (utc >= gpssim_fix_time) {
+                put_le32(payload + 4, (uint32_t)(GPSSIM_ECEF_X * 100));
+                put_le32(payload + 8, (uint32_t)(GPSSIM_ECEF_Y * 100));
+                put_le32(payload + 12, (uint32_t)(GPSSIM_ECEF_Z * 100));
+                put_le32(payload + 16, 500);
+            } else {
+                put_le32(payload + 16, UINT32_MAX);
+            }
+            send_ubx(UBX_NAV_POSECEF, payload, sizeof(payload));
+        break;
+
+        default:
+        break;
+    }
+}
+
+
+static void epoch_callback(void)
+{
+    epoch += 1;
+    sim_at((long double)epoch + 1 + gpssim_msg_delay, epoch_callback);
+
+    if (!binary_mode) {
+        send_nmea("GPGGA,,,,,,0,00,,,,,,,");
+        return;
+    }
+
+    for (unsigned type = 0 ; type < 256 ; type += 1) {
+        if (msg_rates[type] != 0 && (epoch % msg_rates[type]) == 0) {
+            if (gpssim_ubx) {
+                send_ubx_nav((uint8_t)type, epoch);
+            } else {
+                send_msg_type((uint8_t)type, epoch);
+            }
+        }
+    }
+
+    if (gpssim_debug_msgs && (epoch % DEBUG_MSG_INTERVAL) == 0) {
+        if (gpssim_ubx) {
+            static const char notice[] = "ANTSTATUS=OK";
+
+            send_ubx(UBX_INF_NOTICE, (const uint8_t *)notice,
+                    sizeof(notice) - 1);
+        } else {
+            send_msg_type(225, epoch);
+            send_msg_type(93, epoch);
+        }
+    }
+}
+
+
+static void handle_nmea_cmd(void)
+{
+    unsigned protocol, baud, data_bits, stop_bits, parity, csum;
+    uint8_t calc_csum = 0;
+    char *end = strchr(nmea_buf, '*');
+
+    if (!end || nmea_buf[0] != '$') {
+        return;
+    }
+
+    for (char *c = nmea_buf + 1 ; c < end ; c += 1) {
+        calc_csum ^= (uint8_t)*c;
+    }
+
+    if (sscanf(end + 1, "%2X", &csum) != 1 || csum != calc_csum) {
+        return;
+    }
+
+    if (sscanf(nmea_buf, "$PSRF100,%u,%u,%u,%u,%u*", &protocol, &baud,
+            &data_bits, &stop_bits, &parity) == 5 && protocol == 0 &&
+            baud <= gpssim_max_baud) {
+        binary_mode = true;
+        sim_peer_baud = baud;
+
+        // Default binary messages
+        memset(msg_rates, 0, sizeof(msg_rates));
+        msg_rates[2] = 1;
+        msg_rates[7] = 1;
+    }
+}
+
+
+static uint32_t get_u32(const uint8_t *buf)
+{
+    return (uint32_t)buf[0] << 24 | (uint32_t)buf[1] << 16 |
+            (uint32_t)buf[2] << 8 | buf[3];
+}
+
+
+// Message 128: initialize data source. A warm start with a position and a
+// close enough time gives an earlier fix.
+static void handle_init_data(void)
+{
+    long gps_time = epoch - GPS_EPOCH + GPSSIM_LEAP_SECONDS;
+    long aided_time;
+    bool has_position;
+
+    if (cmd_length < 25 || !(cmd_buf[24] & 0x01)) {
+        return;
+    }
+
+    has_position = get_u32(cmd_buf + 1) != 0 || get_u32(cmd_buf + 5) != 0 ||
+            get_u32(cmd_buf + 9) != 0;
+    aided_time = (long)(cmd_buf[21] << 8 | cmd_buf[22]) * SECONDS_PER_WEEK +
+            (long)(get_u32(cmd_buf + 17) / 100);
+
+    if (has_position &&
+            labs(aided_time - gps_time) <= GPSSIM_AIDING_MAX_ERROR) {
+        long double fix_time = sim_time() + GPSSIM_AIDED_FIX_SECS;
+
+        if (fix_time < gpssim_fix_time) {
+            gpssim_fix_time = fix_time;
+        }
+        gpssim_aided = true;
+    }
+}
+
+
+static void send_ack(uint8_t type)
+{
+    uint8_t payload[3] = {11, type, 0};
+    send_msg(payload, sizeof(payload));
+}
+
+
+static void handle_binary_cmd(void)
+{
+    switch (cmd_buf[0]) {
+        case 166: // Set message rate
+            if (cmd_length < 8) {
+                return;
+            }
+
+            switch (cmd_buf[1]) {
+                case 0: // Set the rate of one message
+                    msg_rates[cmd_buf[2]] = cmd_buf[3];
+                break;
+
+                case 1: // Poll one message
+                    send_msg_type(cmd_buf[2], epoch);
+                break;
+
+                case 2: // Set the rate of all messages
+                    memset(msg_rates, cmd_buf[3], sizeof(msg_rates));
+                break;
+
+                default:
+                break;
+            }
+        break;
+
+        case 144: // Poll clock status
+            send_clock_status(epoch);
+        break;
+
+        case 128: // Initialize data source (the receiver restarts)
+            handle_init_data();
+        return;
+
+        case 134: { // Set binary serial port
+            uint32_t baud;
+
+            if (cmd_length < 9) {
+                return;
+            }
+
+            baud = get_u32(cmd_buf + 1);
+            if (baud > gpssim_max_baud) {
+                return;
+            }
+
+            // Acknowledged at the old rate
+            send_ack(cmd_buf[0]);
+            sim_peer_baud = baud;
+        }
+        return;
+
+        default:
+            return;
+    }
+
+    send_ack(cmd_buf[0]);
+}
+
+
+static uint32_t get_le32(const uint8_t *buf)
+{
+    return (uint32_t)buf[3] << 24 | (uint32_t)buf[2] << 16 |
+            (uint32_t)buf[1] << 8 | buf[0];
+}
+
+
+static void send_ubx_ack(uint16_t type, bool ack)
+{
+    uint8_t payload[2] = {(uint8_t)(type >> 8), (uint8_t)type};
+    send_ubx(ack ? UBX_ACK_ACK : UBX_ACK_NAK, payload, sizeof(payload));
+}
+
+
+// MGA-INI: initialization data. A position (POS_XYZ) gives an earlier fix, as
+// with message 128: the receiver keeps the time in its RTC. A GPS time
+// (TIME_GNSS) further from the actual time than its accuracy spoils it.
+static void handle_ubx_init_data(const uint8_t *payload, size_t length)
+{
+    if (length == 20 && payload[0] == 0x00) { // POS_XYZ
+        long double fix_time = sim_time() + GPSSIM_AIDED_FIX_SECS;
+
+        if (get_le32(payload + 4) == 0 && get_le32(payload + 8) == 0 &&
+                get_le32(payload + 12) == 0) {
+            return;
+        }
+
+        ubx_unaided_fix_time = gpssim_fix_time;
+        if (fix_time < gpssim_fix_time) {
+            gpssim_fix_time = fix_time;
+        }
+        gpssim_aided = true;
+    } else if (length == 24 && payload[0] == 0x11 && payload[3] == 0) {
+        long gps_time = epoch - GPS_EPOCH + GPSSIM_LEAP_SECONDS;
+        long aided_time = (long)(payload[6] | payload[7] << 8) *
+                SECONDS_PER_WEEK + (long)get_le32(payload + 8);
+        long accuracy = (long)(payload[16] | payload[17] << 8);
+
+        if (gpssim_aided && labs(aided_time - gps_time) > accuracy) {
+            gpssim_fix_time = ubx_unaided_fix_time;
+            gpssim_aided = false;
+        }
+    }
+}
+
+
+// Handle a UBX command (class, id, length and payload in cmd_buf)
+static void handle_ubx_cmd(void)
+{
+    uint16_t type = (uint16_t)(cmd_buf[0] << 8 | cmd_buf[1]);
+    const uint8_t *payload = cmd_buf + 4;
+
+    switch (type) {
+        case UBX_CFG_PRT: { // Port configuration
+            uint32_t baud;
+            uint16_t out_proto;
+
+            if (cmd_length != 20 || payload[0] != 1) { // UART 1
+                send_ubx_ack(type, false);
+                return;
+            }
+
+            baud = get_le32(payload + 8);
+            out_proto = (uint16_t)(payload[14] | payload[15] << 8);
+            if (baud > gpssim_max_baud) {
+                send_ubx_ack(type, false);
+                return;
+            }
+
+            // Acknowledged at the old rate
+            send_ubx_ack(type, true);
+            sim_peer_baud = baud;
+            binary_mode = (out_proto == 0x0001);
+        }
+        return;
+
+        case UBX_CFG_MSG: // Message rate (on the current port)
+            if (cmd_length != 3 && cmd_length != 8) {
+                send_ubx_ack(type, false);
+                return;
+            }
+
+            if (payload[0] == UBX_NAV) {
+                msg_rates[payload[1]] = payload[cmd_length == 3 ? 2 : 3];
+            }
+            send_ubx_ack(type, true);
+        return;
+
+        case UBX_NAV_TIMEUTC:
+        case UBX_NAV_POSECEF:
+            if (cmd_length == 0) { // Poll
+                send_ubx_nav((uint8_t)type, epoch);
+            }
+        return;
+
+        case UBX_MGA_INI: // Not acknowledged by default
+            handle_ubx_init_data(payload, cmd_length);
+        return;
+
+        default:
+            if (cmd_buf[0] == UBX_CFG) {
+                send_ubx_ack(type, false);
+            }
+        return;
+    }
+}
+
+
+// Receive a UBX frame (in any output mode): class, id, length, payload and
+// checksum, after the sync characters
+static void receive_ubx_byte(uint8_t byte)
+{
+    switch (cmd_state) {
+        case CMD_START1:
+            cmd_state = (byte == 0xb5) ? CMD_START2 : CMD_START1;
+        break;
+        case CMD_START2:
+            cmd_pos = 0;
+            cmd_state = (byte == 0x62) ? CMD_PAYLOAD : CMD_START1;
+        break;
+        default: {
+            uint8_t ck_a = 0;
+            uint8_t ck_b = 0;
+
+            cmd_buf[cmd_pos++] = byte;
+            if (cmd_pos == 4) {
+                cmd_length = (size_t)(cmd_buf[2] | cmd_buf[3] << 8);
+                if (cmd_length + 6 > MAX_PAYLOAD) {
+                    cmd_state = CMD_START1;
+                }
+            }
+
+            if (cmd_pos < 6 || cmd_pos != cmd_length + 6) {
+                return;
+            }
+
+            for (size_t i = 0 ; i < cmd_length + 4 ; i += 1) {
+                ck_a = (uint8_t)(ck_a + cmd_buf[i]);
+                ck_b = (uint8_t)(ck_b + ck_a);
+            }
+
+            if (cmd_buf[cmd_length + 4] == ck_a &&
+                    cmd_buf[cmd_length + 5] == ck_b) {
+                handle_ubx_cmd();
+            }
+            cmd_state = CMD_START1;
+        }
+        break;
+    }
+}
+
+
+static void receive_byte(uint8_t byte)
+{
+    if (gpssim_ubx) {
+        receive_ubx_byte(byte);
+        return;
+    }
+
+    if (!binary_mode) {
+        if (byte == '$') {
+            nmea_length = 0;
+        }
+
+        if (byte == '\n') {
+            nmea_buf[nmea_length] = '\0';
+            handle_nmea_cmd();
+            nmea_length = 0;
+        } else if (nmea_length < sizeof(nmea_buf) - 1) {
+            nmea_buf[nmea_length++] = (char)byte;
+        }
+        return;
+    }
+
+    switch (cmd_state) {
+        case CMD_START1:
+            cmd_state = (byte == 0xa0) ? CMD_START2 : CMD_START1;
+        break;
+        case CMD_START2:
+            cmd_state = (byte == 0xa2) ? CMD_LENGTH1 : CMD_START1;
+        break;
+        case CMD_LENGTH1:
+            cmd_length = (size_t)byte << 8;
+            cmd_state = CMD_LENGTH2;
+        break;
+        case CMD_LENGTH2:
+            cmd_length |= byte;
+            cmd_pos = 0;
+            cmd_csum = 0;
+            cmd_state = (cmd_length > 0 && cmd_length <= MAX_PAYLOAD) ?
+                    CMD_PAYLOAD : CMD_START1;
+        break;
+        case CMD_PAYLOAD:
+            cmd_buf[cmd_pos++] = byte;
+            cmd_csum = (cmd_csum + byte) & 0x7fff;
+            if (cmd_pos == cmd_length) {
+                cmd_state = CMD_CSUM1;
+            }
+        break;
+        case CMD_CSUM1:
+            cmd_state = (byte == (cmd_csum >> 8)) ? CMD_CSUM2 : CMD_START1;
+        break;
+        case CMD_CSUM2:
+            cmd_state = (byte == (cmd_csum & 0xff)) ? CMD_END1 : CMD_START1;
+        break;
+        case CMD_END1:
+            cmd_state = (byte == 0xb0) ? CMD_END2 : CMD_START1;
+        break;
+        case CMD_END2:
+            if (byte == 0xb3) {
+                handle_binary_cmd();
+            }
+            cmd_state = CMD_START1;
+        break;
+    }
+}
+
+
+void gpssim_init(void)
+{
+    gpssim_fix_time = 0;
+    gpssim_enabled = true;
+    gpssim_msg_delay = 0.1L;
+    gpssim_debug_msgs = false;
+    gpssim_max_baud = 38400;
+    gpssim_aided = false;
+    gpssim_msg7_count = 0;
+    gpssim_replaying = false;
+
+    if (replay_file) {
+        fclose(replay_file);
+        replay_file = NULL;
+    }
+
+    binary_mode = false;
+    memset(msg_rates, 0, sizeof(msg_rates));
+    ubx_unaided_fix_time = 0;
+    nmea_length = 0;
+    cmd_state = CMD_START1;
+
+    sim_peer_baud = gpssim_ubx ? 9600 : 4800;
+    sim_peer_receive = receive_byte;
+
+    epoch = (long)floorl(sim_time());
+    sim_at((long double)epoch + 1 + gpssim_msg_delay, epoch_callback);
+}
+
+
+void gpssim_send_raw(const uint8_t *data, size_t length)
+{
+    for (size_t i = 0 ; i < length ; i += 1) {
+        sim_peer_send(data[i]);
+    }
+}
+
+
+bool gpssim_send_file(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    uint8_t buf[256];
+    size_t length;
+
+    if (!file) {
+        return false;
+    }
+
+    while ((length = fread(buf, 1, sizeof(buf), file)) > 0) {
+        gpssim_send_raw(buf, length);
+    }
+
+    fclose(file);
+    return true;
+}
+
+
+// Queue the next block of the capture, and schedule the following one when it
+// is sent
+static void replay_callback(void)
+{
+    uint8_t buf[REPLAY_BLOCK];
+    size_t length = fread(buf, 1, sizeof(buf), replay_file);
+
+    gpssim_send_raw(buf, length);
+
+    if (length < sizeof(buf)) {
+        fclose(replay_file);
+        replay_file = NULL;
+        gpssim_replaying = false;
+        return;
+    }
+
+    sim_at(sim_peer_send_end(), replay_callback);
+}
+
+
+uint32_t gpssim_replay_file(const char *path, uint32_t baud)
+{
+    if (replay_file) {
+        fclose(replay_file);
+    }
+
+    replay_file = fopen(path, "rb");
+    if (!replay_file) {
+        gpssim_replaying = false;
+        return 0;
+    }
+
+    gpssim_enabled = false;
+    gpssim_replaying = true;
+    sim_peer_baud = sim_set_uart_baud(baud);
+    replay_callback();
+
+    return sim_peer_baud;
+}
@@ -0,0 +1,87 @@
+// Virtual SiRF or u-blox GPS receiver, connected to the simulated PIC serial
+// port.
+//
+// The SiRF receiver starts in NMEA mode at 4800 baud, and switches to binary
+// mode (and to the requested baud rate) when it receives a $PSRF100 command.
+// In binary mode, it outputs the enabled messages on each second, and answers
+// the message rate (166), clock status poll (144), serial port (134) and
+// initialize data source (128) commands. The time of week reported in the
+// clock status messages (message 7) is derived from the simulation time.
+//
+// The u-blox receiver starts with NMEA output at 9600 baud, and accepts UBX
+// commands: port configuration (CFG-PRT, which switches the baud rate and the
+// output protocols), message rate (CFG-MSG), polls of NAV-TIMEUTC and
+// NAV-POSECEF, and initialization data (MGA-INI). With UBX output, it outputs
+// the enabled NAV messages on each second.
+
+#ifndef GPSSIM_H
+#define GPSSIM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Difference between the GPS time and UTC, in seconds
+#define GPSSIM_LEAP_SECONDS 18
+
+// Position reported in message 2 after the fix (ECEF, in meters)
+#define GPSSIM_ECEF_X 4201000
+#define GPSSIM_ECEF_Y 168000
+#define GPSSIM_ECEF_Z 4780000
+
+// Time to fix after a warm start with initialization data, if the data has a
+// position, and for message 128 a time within GPSSIM_AIDING_MAX_ERROR seconds
+#define GPSSIM_AIDED_FIX_SECS 8
+#define GPSSIM_AIDING_MAX_ERROR 60
+
+// Initialize the receiver, and connect it to the PIC serial port. Should be
+// called after sim_init().
+void gpssim_init(void);
+
+// If true when gpssim_init() is called, the receiver is a u-blox one (UBX
+// protocol) instead of a SiRF one. Not changed by gpssim_init().
+extern bool gpssim_ubx;
+
+// Time at which the receiver gets a fix. Before that, message 7 reports an
+// invalid week, and NAV-TIMEUTC an invalid time (the receiver time is not
+// set).
+extern long double gpssim_fix_time;
+
+// If false, the receiver does not send anything (disconnected or powered off)
+extern bool gpssim_enabled;
+
+// Delay between the start of a second and the output of its messages
+extern long double gpssim_msg_delay;
+
+// If true, the debug messages (SiRF: 225 and 93, u-blox: INF-NOTICE) are sent
+// every 30 seconds, even if all messages were disabled
+extern bool gpssim_debug_msgs;
+
+// Highest baud rate accepted by the receiver; the commands requesting a higher
+// rate are ignored
+extern uint32_t gpssim_max_baud;
+
+// Set when usable initialization data is received
+extern bool gpssim_aided;
+
+// Number of clock status messages (message 7 or NAV-TIMEUTC) sent
+extern uint32_t gpssim_msg7_count;
+
+// Queue raw bytes to send to the PIC (for example a recorded message stream),
+// at the current baud rate.
+void gpssim_send_raw(const uint8_t *data, size_t length);
+
+// Queue the contents of a file. Returns false if the file cannot be read.
+bool gpssim_send_file(const char *path);
+
+// Replay a capture of a receiver output (a file of raw bytes) instead of the
+// simulated messages: the receiver stops sending anything else, the PIC serial
+// port is switched to the closest baud rate to the given one (see
+// sim_set_uart_baud()), and the bytes are sent back to back. Returns the baud
+// rate obtained, or 0 if the file cannot be opened.
+uint32_t gpssim_replay_file(const char *path, uint32_t baud);
+
+// Set while the replayed capture is not entirely queued
+extern bool gpssim_replaying;
+
+#endif
@@ -0,0 +1,337 @@
+// Cycle benchmark of the firmware hot paths.
+//
+// Runs the firmware image built with XC8 on the PIC18 instruction set
+// simulator, with the virtual GPS receiver, through scripted scenarios. Reports
+// the minimum, mean and maximum instruction cycles taken by each function
+// listed in the budget file, and by the interrupts, and fails if a maximum
+// exceeds its budget.
+//
+// Usage: pic18bench <image.hex> <symbols> <budget file>
+//                   [<capture> [<speed-up>]]
+//
+// If a capture of a receiver output is given (see gpsreplay.c), it is replayed
+// in an additional scenario, at 38400 baud multiplied by the speed-up (default
+// 1), and the cost per received byte of the serial interrupt and of the parser
+// is reported, with the byte rate they would use the whole CPU at.
+//
+// The symbols are read from the ELF file produced by XC8, or from a text file
+// with one "name address" line per function (hexadecimal byte address).
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpssim.h"
+#include "pic18iss.h"
+#include "symbols.h"
+#include "timebase.h"
+
+#define MAX_FUNCTIONS 32
+#define MAX_NAME 64
+
+// Budget file entry for the interrupts
+#define INT_NAME "interrupt"
+
+// Functions handling the received bytes, profiled by the replay
+#define RX_NAME "gps_handle_serial_rx"
+#define PARSER_NAME "gps_process_received"
+
+// Baud rate of the replayed capture, before the speed-up
+#define REPLAY_BAUD 38400
+
+struct function {
+    char name[MAX_NAME];
+    uint64_t budget;
+    uint32_t addr;
+    bool found;
+    struct iss_profile *profile;
+
+    // Totals over all scenarios
+    uint32_t calls;
+    uint64_t total_cycles;
+    uint64_t min_cycles;
+    uint64_t max_cycles;
+};
+
+static struct function functions[MAX_FUNCTIONS];
+static unsigned function_count;
+
+// Replayed capture (NULL if none), and its speed-up
+static const char *replay_path;
+static double replay_speedup = 1;
+
+
+static bool load_budgets(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[256];
+
+    if (!file) {
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        struct function *function = &functions[function_count];
+        char name[MAX_NAME];
+        unsigned long long budget;
+
+        if (line[0] == '#' ||
+                sscanf(line, "%63s %llu", name, &budget) != 2) {
+            continue;
+        }
+
+        if (function_count == MAX_FUNCTIONS) {
+            fclose(file);
+            return false;
+        }
+
+        memset(function, 0, sizeof(*function));
+        strcpy(function->name, name);
+        function->budget = budget;
+        function_count += 1;
+    }
+
+    fclose(file);
+    return true;
+}
+
+
+static void add_profile(struct function *function,
+        const struct iss_profile *profile)
+{
+    if (profile->calls == 0) {
+        return;
+    }
+
+    if (function->calls == 0 || profile->min_cycles < function->min_cycles) {
+        function->min_cycles = profile->min_cycles;
+    }
+    if (profile->max_cycles > function->max_cycles) {
+        function->max_cycles = profile->max_cycles;
+    }
+    function->calls += profile->calls;
+    function->total_cycles += profile->total_cycles;
+}
+
+
+// Scenarios
+
+// Boot, then DST start with the debug messages enabled
+static void scenario_dst(void)
+{
+    gpssim_debug_msgs = true;
+    sim_run(1200);
+}
+
+
+// GPS outage, then recovery
+static void scenario_outage(void)
+{
+    sim_run(300);
+    gpssim_enabled = false;
+    sim_run(300);
+    gpssim_enabled = true;
+    sim_run(300);
+}
+
+
+// Profile of a function listed in the budget file, or NULL if not profiled
+static const struct iss_profile *find_profile(const char *name)
+{
+    for (unsigned f = 0 ; f < function_count ; f += 1) {
+        if (strcmp(functions[f].name, name) == 0) {
+            return functions[f].profile;
+        }
+    }
+
+    return NULL;
+}
+
+
+// Boot, then replay the capture after the synchronization
+static void scenario_replay(void)
+{
+    const struct iss_profile *rx = find_profile(RX_NAME);
+    const struct iss_profile *parser = find_profile(PARSER_NAME);
+    uint64_t int_cycles, rx_cycles, parser_cycles;
+    uint32_t ints, bytes, overruns, baud;
+
+    if (!rx || !parser) {
+        printf("Replay: %s and %s must be in the budget file\n", RX_NAME,
+                PARSER_NAME);
+        return;
+    }
+
+    sim_run(60);
+
+    int_cycles = iss_int_profile.total_cycles;
+    ints = iss_int_profile.calls;
+    rx_cycles = rx->total_cycles;
+    bytes = rx->calls;
+    parser_cycles = parser->total_cycles;
+    overruns = sim_uart_overruns;
+
+    baud = gpssim_replay_file(replay_path,
+            (uint32_t)(REPLAY_BAUD * replay_speedup + 0.5));
+    if (baud == 0) {
+        printf("Replay: cannot read %s\n", replay_path);
+        return;
+    }
+    while (gpssim_replaying) {
+        sim_run(1);
+    }
+    sim_run_until(sim_peer_send_end() + 1);
+
+    int_cycles = iss_int_profile.total_cycles - int_cycles;
+    ints = iss_int_profile.calls - ints;
+    rx_cycles = rx->total_cycles - rx_cycles;
+    bytes = rx->calls - bytes;
+    parser_cycles = parser->total_cycles - parser_cycles;
+    overruns = sim_uart_overruns - overruns;
+
+    if (bytes == 0) {
+        printf("Replay: no byte received\n");
+        return;
+    }
+
+    printf("Replay of %s at %" PRIu32 " baud: %" PRIu32 " bytes received, %"
+            PRIu32 " lost\n", replay_path, baud, bytes, overruns);
+    // The interrupts are mostly the receptions (a Timer0 period per second)
+    printf("Cycles per byte: %.1f interrupt (%.1f %s), %.1f %s; "
+            "whole CPU at %.0f bytes/s\n", (double)int_cycles / ints,
+            (double)rx_cycles / bytes, RX_NAME, (double)parser_cycles / bytes,
+            PARSER_NAME, OSC_FREQ / 4.0 / ((double)int_cycles / ints +
+            (double)parser_cycles / bytes));
+}
+
+
+static const struct {
+    const char *name;
+    long double start_time;
+    void (*run)(void);
+} scenarios[] = {
+    {"dst", 1616892600, scenario_dst}, // 28/3/2021 00:50:00 UTC
+    {"outage", 1623758400, scenario_outage}, // 15/6/2021 12:00:00 UTC
+    {"replay", 1623758400, scenario_replay}, // If a capture is given
+};
+
+
+static bool run_scenarios(const char *hex_path)
+{
+    for (size_t i = 0 ; i < sizeof(scenarios) / sizeof(scenarios[0]) ; i += 1) {
+        if (scenarios[i].run == scenario_replay && !replay_path) {
+            continue;
+        }
+
+        sim_init(scenarios[i].start_time);
+        if (!iss_load_hex(hex_path)) {
+            fprintf(stderr, "Cannot load %s\n", hex_path);
+            return false;
+        }
+
+        gpssim_init();
+        scenarios[i].run();
+
+        printf("Scenario %s: %" PRIu64 " cycles, %" PRIu32 " interrupts\n",
+                scenarios[i].name, sim_cycles(), iss_int_profile.calls);
+
+        for (unsigned f = 0 ; f < function_count ; f += 1) {
+            if (strcmp(functions[f].name, INT_NAME) == 0) {
+                add_profile(&functions[f], &iss_int_profile);
+            } else if (functions[f].profile) {
+                add_profile(&functions[f], functions[f].profile);
+            }
+        }
+    }
+
+    return true;
+}
+
+
+static bool report(void)
+{
+    bool ok = true;
+
+    printf("\n%-24s %8s %8s %8s %8s %8s\n", "function", "calls", "min",
+            "mean", "max", "budget");
+
+    for (unsigned f = 0 ; f < function_count ; f += 1) {
+        struct function *function = &functions[f];
+        const char *status = "";
+
+        if (!function->found) {
+            printf("%-24s (not found, inlined?)\n", function->name);
+            continue;
+        }
+
+        if (function->max_cycles > function->budget) {
+            status = " OVER BUDGET";
+            ok = false;
+        }
+
+        printf("%-24s %8" PRIu32 " %8" PRIu64 " %8" PRIu64 " %8" PRIu64
+                " %8" PRIu64 "%s\n", function->name, function->calls,
+                function->min_cycles, function->calls ?
+                function->total_cycles / function->calls : 0,
+                function->max_cycles, function->budget, status);
+    }
+
+    return ok;
+}
+
+
+int main(int argc, char **argv)
+{
+    if (argc < 4 || argc > 6) {
+        fprintf(stderr, "Usage: %s <image.hex> <symbols> <budget file> "
+                "[<capture> [<speed-up>]]\n", argv[0]);
+        return 2;
+    }
+
+    if (argc >= 5) {
+        replay_path = argv[4];
+    }
+    if (argc == 6) {
+        replay_speedup = strtod(argv[5], NULL);
+        if (!(replay_speedup > 0)) {
+            fprintf(stderr, "Invalid speed-up %s\n", argv[5]);
+            return 2;
+        }
+    }
+
+    if (!symbols_load(argv[2])) {
+        fprintf(stderr, "Cannot read %s\n", argv[2]);
+        return 2;
+    }
+
+    if (!load_budgets(argv[3])) {
+        fprintf(stderr, "Cannot read %s\n", argv[3]);
+        return 2;
+    }
+
+    for (unsigned f = 0 ; f < function_count ; f += 1) {
+        if (strcmp(functions[f].name, INT_NAME) == 0) {
+            functions[f].found = true;
+        } else {
+            functions[f].found = symbols_find(functions[f].name,
+                    &functions[f].addr);
+        }
+
+        if (functions[f].found && strcmp(functions[f].name, INT_NAME) != 0) {
+            // Kept by sim_init() for all the scenarios
+            functions[f].profile = iss_profile_function(functions[f].name,
+                    functions[f].addr);
+            if (!functions[f].profile) {
+                fprintf(stderr, "Cannot profile %s\n", functions[f].name);
+                return 2;
+            }
+        }
+    }
+
+    if (!run_scenarios(argv[1])) {
+        return 2;
+    }
+
+    return report() ? 0 : 1;
+}
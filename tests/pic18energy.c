@@ -0,0 +1,283 @@
+// Duty cycle and energy accounting of the firmware.
+//
+// Runs the firmware image built with XC8 on the PIC18 instruction set
+// simulator, with the virtual GPS receiver, through scripted scenarios. Every
+// instruction cycle is charged to a category: idle mode (sleep), interrupt
+// sources, main loop tasks and busy-waits, as listed in the model file (see
+// energy_model.txt). Reports the share of each category, the duty cycle (the
+// share of the cycles with the core running), and the current drawn according
+// to the current model of the file, in mAh per hour of operation.
+//
+// Usage: pic18energy <image.hex> <symbols> <model file>
+//
+// The output only depends on the image and the model: the reports of two
+// images can be compared to measure the effect of a change.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpssim.h"
+#include "pic18iss.h"
+#include "symbols.h"
+
+#define MAX_TASKS 32
+#define MAX_CATEGORIES 32
+#define MAX_NAME 64
+
+// Categories of the cycles not charged to a task
+#define SLEEP_NAME "sleep"
+#define INT_OTHER_NAME "int-other"
+#define MAIN_OTHER_NAME "main-other"
+
+struct category {
+    char name[MAX_NAME];
+    bool idle;
+    uint64_t cycles;
+};
+
+struct task {
+    char name[MAX_NAME];
+    struct category *category;
+    struct iss_profile *profile;
+};
+
+static struct category categories[MAX_CATEGORIES];
+static unsigned category_count;
+static struct task tasks[MAX_TASKS];
+static unsigned task_count;
+
+// Current model, in mA
+static double run_current;
+static double idle_current;
+static double base_current;
+
+
+// Find a category, or add it. Returns NULL if there are too many.
+static struct category *get_category(const char *name)
+{
+    struct category *category;
+
+    for (unsigned c = 0 ; c < category_count ; c += 1) {
+        if (strcmp(categories[c].name, name) == 0) {
+            return &categories[c];
+        }
+    }
+
+    if (category_count == MAX_CATEGORIES) {
+        return NULL;
+    }
+
+    category = &categories[category_count];
+    memset(category, 0, sizeof(*category));
+    strcpy(category->name, name);
+    category_count += 1;
+
+    return category;
+}
+
+
+static bool load_model(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[256];
+
+    if (!file) {
+        return false;
+    }
+
+    get_category(SLEEP_NAME)->idle = true;
+    get_category(INT_OTHER_NAME);
+    get_category(MAIN_OTHER_NAME);
+
+    while (fgets(line, sizeof(line), file)) {
+        char name[MAX_NAME];
+        char category[MAX_NAME];
+        double current;
+
+        if (line[0] == '#') {
+            continue;
+        }
+
+        if (sscanf(line, "current %63s %lf", name, &current) == 2) {
+            if (strcmp(name, "run") == 0) {
+                run_current = current;
+            } else if (strcmp(name, "idle") == 0) {
+                idle_current = current;
+            } else if (strcmp(name, "base") == 0) {
+                base_current = current;
+            } else {
+                fclose(file);
+                return false;
+            }
+        } else if (sscanf(line, "task %63s %63s", name, category) == 2) {
+            if (task_count == MAX_TASKS) {
+                fclose(file);
+                return false;
+            }
+
+            strcpy(tasks[task_count].name, name);
+            tasks[task_count].category = get_category(category);
+            if (!tasks[task_count].category) {
+                fclose(file);
+                return false;
+            }
+            task_count += 1;
+        }
+    }
+
+    fclose(file);
+    return true;
+}
+
+
+// Scenarios
+
+// Boot and synchronization, then an hour of steady operation (the GPS message
+// interval stretches as the oscillator frequency is learned)
+static void scenario_hour(void)
+{
+    sim_run(3600);
+}
+
+
+// GPS outage, then recovery
+static void scenario_outage(void)
+{
+    sim_run(300);
+    gpssim_enabled = false;
+    sim_run(300);
+    gpssim_enabled = true;
+    sim_run(300);
+}
+
+
+static const struct {
+    const char *name;
+    long double start_time;
+    void (*run)(void);
+} scenarios[] = {
+    {"hour", 1623758400, scenario_hour}, // 15/6/2021 12:00:00 UTC
+    {"outage", 1623758400, scenario_outage}, // 15/6/2021 12:00:00 UTC
+};
+
+
+// Charge the cycles of the scenario to the categories
+static void account(void)
+{
+    for (unsigned c = 0 ; c < category_count ; c += 1) {
+        categories[c].cycles = 0;
+    }
+
+    get_category(SLEEP_NAME)->cycles = iss_idle_cycles;
+    get_category(INT_OTHER_NAME)->cycles = iss_int_profile.self_cycles;
+    get_category(MAIN_OTHER_NAME)->cycles = iss_other_cycles;
+
+    for (unsigned t = 0 ; t < task_count ; t += 1) {
+        if (tasks[t].profile) {
+            tasks[t].category->cycles += tasks[t].profile->self_cycles;
+        }
+    }
+}
+
+
+// Report the share and current of each category. Returns false if cycles are
+// not accounted for.
+static bool report(const char *name, double duration)
+{
+    uint64_t total = 0;
+    uint64_t running = 0;
+    double charge = 0;
+
+    for (unsigned c = 0 ; c < category_count ; c += 1) {
+        total += categories[c].cycles;
+        if (!categories[c].idle) {
+            running += categories[c].cycles;
+        }
+    }
+
+    if (total != sim_cycles()) {
+        printf("Scenario %s: %" PRIu64 " cycles accounted for out of %"
+                PRIu64 "\n", name, total, sim_cycles());
+        return false;
+    }
+
+    printf("\nScenario %s: %.0f s, %" PRIu32 " interrupts, duty cycle "
+            "%.3f%%\n", name, duration, iss_int_profile.calls,
+            100.0 * (double)running / (double)total);
+    printf("%-16s %14s %9s %12s\n", "category", "cycles", "time %",
+            "mAh/hour");
+
+    for (unsigned c = 0 ; c < category_count ; c += 1) {
+        double share = (double)categories[c].cycles / (double)total;
+        double current = share *
+                (categories[c].idle ? idle_current : run_current);
+
+        charge += current;
+        printf("%-16s %14" PRIu64 " %9.4f %12.4f\n", categories[c].name,
+                categories[c].cycles, 100.0 * share, current);
+    }
+
+    printf("%-16s %14s %9s %12.4f\n", "base", "", "", base_current);
+    printf("%-16s %14" PRIu64 " %9.4f %12.4f\n", "total", total, 100.0,
+            charge + base_current);
+
+    return true;
+}
+
+
+int main(int argc, char **argv)
+{
+    bool ok = true;
+
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s <image.hex> <symbols> <model file>\n",
+                argv[0]);
+        return 2;
+    }
+
+    if (!symbols_load(argv[2])) {
+        fprintf(stderr, "Cannot read %s\n", argv[2]);
+        return 2;
+    }
+
+    if (!load_model(argv[3])) {
+        fprintf(stderr, "Cannot read %s\n", argv[3]);
+        return 2;
+    }
+
+    for (unsigned t = 0 ; t < task_count ; t += 1) {
+        uint32_t addr;
+
+        if (!symbols_find(tasks[t].name, &addr)) {
+            printf("%s not found (inlined?): charged to its caller\n",
+                    tasks[t].name);
+            continue;
+        }
+
+        // Kept by sim_init() for all the scenarios
+        tasks[t].profile = iss_profile_function(tasks[t].name, addr);
+        if (!tasks[t].profile) {
+            fprintf(stderr, "Cannot profile %s\n", tasks[t].name);
+            return 2;
+        }
+    }
+
+    for (size_t i = 0 ; i < sizeof(scenarios) / sizeof(scenarios[0]) ; i += 1) {
+        sim_init(scenarios[i].start_time);
+        if (!iss_load_hex(argv[1])) {
+            fprintf(stderr, "Cannot load %s\n", argv[1]);
+            return 2;
+        }
+
+        gpssim_init();
+        scenarios[i].run();
+
+        account();
+        ok = report(scenarios[i].name,
+                (double)(sim_time() - scenarios[i].start_time)) && ok;
+    }
+
+    return ok ? 0 : 1;
+}
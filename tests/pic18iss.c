@@ -0,0 +1,1265 @@
+// PIC18 instruction set simulator.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pic18iss.h"
+#include "simcore.h"
+
+// Special function registers
+#define R_PIE1 0xf9d
+#define R_PIR1 0xf9e
+#define R_IPR1 0xf9f
+#define R_PIE2 0xfa0
+#define R_PIR2 0xfa1
+#define R_EECON1 0xfa6
+#define R_EECON2 0xfa7
+#define R_EEDATA 0xfa8
+#define R_EEADR 0xfa9
+#define R_RCSTA 0xfab
+#define R_TXSTA 0xfac
+#define R_TXREG 0xfad
+#define R_RCREG 0xfae
+#define R_SPBRG 0xfaf
+#define R_SPBRGH 0xfb0
+#define R_BAUDCON 0xfb8
+#define R_T1CON 0xfcd
+#define R_TMR1L 0xfce
+#define R_TMR1H 0xfcf
+#define R_RCON 0xfd0
+#define R_OSCCON 0xfd3
+#define R_T0CON 0xfd5
+#define R_TMR0L 0xfd6
+#define R_TMR0H 0xfd7
+#define R_STATUS 0xfd8
+#define R_BSR 0xfe0
+#define R_WREG 0xfe8
+#define R_INTCON2 0xff1
+#define R_INTCON 0xff2
+#define R_PRODL 0xff3
+#define R_PRODH 0xff4
+#define R_TABLAT 0xff5
+#define R_TBLPTRL 0xff6
+#define R_TBLPTRH 0xff7
+#define R_TBLPTRU 0xff8
+#define R_PCL 0xff9
+#define R_PCLATH 0xffa
+#define R_PCLATU 0xffb
+#define R_STKPTR 0xffc
+#define R_TOSL 0xffd
+#define R_TOSH 0xffe
+#define R_TOSU 0xfff
+
+// INDF registers of the three FSRs; the POSTINC, POSTDEC, PREINC, PLUSW, FSRH
+// and FSRL registers are located just below.
+#define R_INDF0 0xfef
+#define R_INDF1 0xfe7
+#define R_INDF2 0xfdf
+
+// Implemented general purpose RAM, and first special function register
+#define RAM_SIZE 0x300
+#define SFR_START 0xf80
+
+// Address returned for indirect accesses to the INDF registers themselves
+#define NULL_ADDR 0x1000
+
+// STATUS bits
+#define S_C 0x01
+#define S_DC 0x02
+#define S_Z 0x04
+#define S_OV 0x08
+#define S_N 0x10
+
+// Other register bits
+#define OSCCON_IDLEN 0x80
+#define RCON_IPEN 0x80
+#define EECON1_EEPGD 0x80
+#define EECON1_CFGS 0x40
+#define EECON1_WREN 0x04
+#define EECON1_WR 0x02
+#define EECON1_RD 0x01
+
+// Interrupt vector (compatibility mode) and latency
+#define INT_VECTOR 0x0008
+#define INT_LATENCY_CYCLES 3
+
+#define STACK_SIZE 31
+#define MAX_PROFILES 32
+#define MAX_ACTIVE_PROFILES 64
+
+#define W iss_ram[R_WREG]
+#define STATUS iss_ram[R_STATUS]
+
+uint8_t iss_ram[4096];
+struct iss_profile iss_int_profile;
+uint64_t iss_idle_cycles;
+uint64_t iss_other_cycles;
+
+static const struct simcore_regs regs = {
+    .intcon = &iss_ram[R_INTCON],
+    .pir1 = &iss_ram[R_PIR1],
+    .pie1 = &iss_ram[R_PIE1],
+    .rcsta = &iss_ram[R_RCSTA],
+    .txsta = &iss_ram[R_TXSTA],
+    .baudcon = &iss_ram[R_BAUDCON],
+    .spbrg = &iss_ram[R_SPBRG],
+    .spbrgh = &iss_ram[R_SPBRGH],
+    .t0con = &iss_ram[R_T0CON],
+    .t1con = &iss_ram[R_T1CON],
+    .pir2 = &iss_ram[R_PIR2],
+    .pie2 = &iss_ram[R_PIE2],
+    .eecon1 = &iss_ram[R_EECON1],
+};
+
+static uint8_t flash[ISS_FLASH_SIZE];
+
+// Core state
+static uint32_t pc;
+static uint32_t stack[STACK_SIZE + 1]; // Entry 0 is unused
+static uint8_t stkptr;
+static uint8_t shadow_w;
+static uint8_t shadow_status;
+static uint8_t shadow_bsr;
+static bool sleeping;
+
+// Set by the instructions that pop the return address stack
+static bool returned;
+
+// EEPROM unlock sequence progress
+static uint8_t eecon2_seq;
+
+// Profiling: index + 1 of the profile of each function start address
+static struct iss_profile profiles[MAX_PROFILES];
+static unsigned profile_count;
+static uint8_t profile_map[ISS_FLASH_SIZE / 2];
+
+// Profiled calls in progress
+static struct {
+    struct iss_profile *profile;
+    uint64_t start_cycles;
+    uint64_t start_int_cycles;
+    uint8_t depth;
+    bool in_int;
+} active[MAX_ACTIVE_PROFILES];
+static unsigned active_count;
+
+// Interrupt in progress
+static bool in_int;
+static uint8_t int_depth;
+static uint64_t int_start_cycles;
+static uint64_t int_cycles_total;
+
+
+// Profiling
+
+// Charge executed cycles to the innermost profiled call in progress in the
+// current context (main program or interrupt)
+static void profile_charge(uint64_t cycles)
+{
+    if (active_count > 0 && active[active_count - 1].in_int == in_int) {
+        active[active_count - 1].profile->self_cycles += cycles;
+    } else if (in_int) {
+        iss_int_profile.self_cycles += cycles;
+    } else {
+        iss_other_cycles += cycles;
+    }
+}
+
+
+static void profile_add(struct iss_profile *profile, uint64_t cycles)
+{
+    if (profile->calls == 0 || cycles < profile->min_cycles) {
+        profile->min_cycles = cycles;
+    }
+    if (cycles > profile->max_cycles) {
+        profile->max_cycles = cycles;
+    }
+    profile->calls += 1;
+    profile->total_cycles += cycles;
+}
+
+
+static void profile_enter(void)
+{
+    struct iss_profile *profile = &profiles[profile_map[pc >> 1] - 1];
+
+    // Ignore jumps back to the start of the function while it runs
+    if (active_count > 0 && active[active_count - 1].profile == profile &&
+            active[active_count - 1].depth == stkptr) {
+        return;
+    }
+
+    if (active_count == MAX_ACTIVE_PROFILES) {
+        simcore_fatal("too many nested profiled calls");
+    }
+
+    active[active_count].profile = profile;
+    active[active_count].start_cycles = simcore_cycles;
+    active[active_count].start_int_cycles = int_cycles_total;
+    active[active_count].depth = stkptr;
+    active[active_count].in_int = in_int;
+    active_count += 1;
+}
+
+
+// Check the end of the profiled calls and interrupts after a return
+static void profile_return(void)
+{
+    if (in_int && stkptr < int_depth) {
+        uint64_t cycles = simcore_cycles - int_start_cycles;
+
+        in_int = false;
+        int_cycles_total += cycles;
+        profile_add(&iss_int_profile, cycles);
+    }
+
+    while (active_count > 0 && stkptr < active[active_count - 1].depth) {
+        unsigned i = active_count - 1;
+        uint64_t cycles = simcore_cycles - active[i].start_cycles;
+
+        if (!active[i].in_int) {
+            cycles -= int_cycles_total - active[i].start_int_cycles;
+        }
+
+        profile_add(active[i].profile, cycles);
+        active_count -= 1;
+    }
+}
+
+
+struct iss_profile *iss_profile_function(const char *name, uint32_t addr)
+{
+    struct iss_profile *profile;
+
+    if (profile_count == MAX_PROFILES || addr >= ISS_FLASH_SIZE ||
+            (addr & 1) != 0) {
+        return NULL;
+    }
+
+    profile = &profiles[profile_count];
+    memset(profile, 0, sizeof(*profile));
+    profile->name = name;
+    profile->addr = addr;
+
+    profile_count += 1;
+    profile_map[addr >> 1] = (uint8_t)profile_count;
+
+    return profile;
+}
+
+
+void iss_profile_reset(void)
+{
+    for (unsigned i = 0 ; i < profile_count ; i += 1) {
+        profiles[i].calls = 0;
+        profiles[i].total_cycles = 0;
+        profiles[i].min_cycles = 0;
+        profiles[i].max_cycles = 0;
+        profiles[i].self_cycles = 0;
+    }
+
+    memset(&iss_int_profile, 0, sizeof(iss_int_profile));
+    iss_int_profile.name = "interrupt";
+    iss_idle_cycles = 0;
+    iss_other_cycles = 0;
+    active_count = 0;
+}
+
+
+// Stack
+
+static void push(uint32_t addr)
+{
+    if (stkptr == STACK_SIZE) {
+        simcore_fatal("stack overflow");
+    }
+
+    stkptr += 1;
+    stack[stkptr] = addr;
+}
+
+
+static uint32_t pop(void)
+{
+    if (stkptr == 0) {
+        simcore_fatal("stack underflow");
+    }
+
+    stkptr -= 1;
+    return stack[stkptr + 1];
+}
+
+
+// Data memory accesses
+
+// Check if an address is one of the indirect addressing registers
+static bool is_indirect(uint16_t addr)
+{
+    return (addr >= R_INDF2 - 4 && addr <= R_INDF2) ||
+            (addr >= R_INDF1 - 4 && addr <= R_INDF1) ||
+            (addr >= R_INDF0 - 4 && addr <= R_INDF0);
+}
+
+
+// Return the address accessed through an INDF, POSTINC, POSTDEC, PREINC or
+// PLUSW register, after updating the FSR. Other addresses are unchanged.
+static uint16_t resolve(uint16_t addr)
+{
+    uint16_t indf;
+    uint16_t fsr;
+    uint16_t target;
+
+    if (!is_indirect(addr)) {
+        return addr;
+    }
+
+    if (addr >= R_INDF2 - 4 && addr <= R_INDF2) {
+        indf = R_INDF2;
+    } else if (addr >= R_INDF1 - 4 && addr <= R_INDF1) {
+        indf = R_INDF1;
+    } else {
+        indf = R_INDF0;
+    }
+
+    fsr = (uint16_t)(iss_ram[indf - 6] | ((iss_ram[indf - 5] & 0x0f) << 8));
+    target = fsr;
+
+    switch (indf - addr) {
+        case 0: // INDF
+        break;
+        case 1: // POSTINC
+            fsr += 1;
+        break;
+        case 2: // POSTDEC
+            fsr -= 1;
+        break;
+        case 3: // PREINC
+            fsr += 1;
+            target = fsr;
+        break;
+        case 4: // PLUSW
+            target = (uint16_t)(fsr + (int8_t)W);
+        break;
+    }
+
+    iss_ram[indf - 6] = (uint8_t)fsr;
+    iss_ram[indf - 5] = (uint8_t)((fsr >> 8) & 0x0f);
+    target &= 0x0fff;
+
+    // Indirect accesses to the indirect addressing registers read 0
+    if (is_indirect(target)) {
+        return NULL_ADDR;
+    }
+
+    return target;
+}
+
+
+static uint8_t read_reg(uint16_t addr)
+{
+    if (addr < RAM_SIZE) {
+        return iss_ram[addr];
+    }
+
+    if (addr < SFR_START || addr == NULL_ADDR) {
+        return 0; // Unimplemented
+    }
+
+    switch (addr) {
+        case R_TMR0L: {
+            // Reading the low byte latches the high byte
+            uint16_t val = simcore_timer0_read();
+            iss_ram[R_TMR0H] = (uint8_t)(val >> 8);
+            return (uint8_t)val;
+        }
+
+        case R_TMR1L: {
+            // Reading the low byte latches the high byte (16-bit read mode)
+            uint16_t val = simcore_timer1_read();
+            iss_ram[R_TMR1H] = (uint8_t)(val >> 8);
+            return (uint8_t)val;
+        }
+
+        case R_RCREG:
+            return simcore_uart_read();
+
+        case R_PCL:
+            iss_ram[R_PCLATH] = (uint8_t)(pc >> 8);
+            iss_ram[R_PCLATU] = (uint8_t)(pc >> 16);
+            return (uint8_t)pc;
+
+        case R_TOSL:
+            return (uint8_t)stack[stkptr];
+        case R_TOSH:
+            return (uint8_t)(stack[stkptr] >> 8);
+        case R_TOSU:
+            return (uint8_t)(stack[stkptr] >> 16);
+
+        case R_STKPTR:
+            return stkptr;
+
+        case R_EECON1:
+            simcore_sync();
+            return iss_ram[R_EECON1];
+
+        default:
+            return iss_ram[addr];
+    }
+}
+
+
+static void set_tos(uint32_t mask, unsigned shift, uint8_t val)
+{
+    stack[stkptr] = (stack[stkptr] & ~mask) | ((uint32_t)val << shift);
+}
+
+
+static void write_eecon1(uint8_t val)
+{
+    bool unlocked = (eecon2_seq == 2);
+    uint8_t old;
+
+    simcore_sync();
+    old = iss_ram[R_EECON1];
+
+    eecon2_seq = 0;
+    iss_ram[R_EECON1] = (uint8_t)(val & ~EECON1_RD);
+
+    if (val & (EECON1_EEPGD | EECON1_CFGS)) {
+        simcore_fatal("flash self-programming not supported");
+    }
+
+    if (val & EECON1_RD) {
+        iss_ram[R_EEDATA] = sim_eeprom[iss_ram[R_EEADR]];
+    }
+
+    if ((val & EECON1_WR) && !(old & EECON1_WR)) {
+        iss_ram[R_EECON1] &= (uint8_t)~EECON1_WR;
+        if (unlocked && (val & EECON1_WREN)) {
+            simcore_eeprom_write(iss_ram[R_EEADR], iss_ram[R_EEDATA]);
+        }
+    } else if (old & EECON1_WR) {
+        // WR can only be cleared by the hardware
+        iss_ram[R_EECON1] |= EECON1_WR;
+    }
+}
+
+
+// Write a register. Returns true if the program counter was written.
+static bool write_reg(uint16_t addr, uint8_t val)
+{
+    if (addr < RAM_SIZE) {
+        iss_ram[addr] = val;
+        return false;
+    }
+
+    if (addr < SFR_START || addr == NULL_ADDR) {
+        return false; // Unimplemented
+    }
+
+    switch (addr) {
+        case R_TMR0L:
+            // The high byte is written from its buffer
+            simcore_timer0_write((uint16_t)(iss_ram[R_TMR0H] << 8 | val));
+        break;
+
+        case R_TXREG:
+            simcore_uart_write(val);
+        break;
+
+        case R_RCREG:
+        break;
+
+        case R_INTCON:
+        case R_PIR1:
+        case R_PIE1:
+        case R_PIR2:
+        case R_PIE2:
+        case R_RCSTA:
+        case R_TXSTA:
+        case R_BAUDCON:
+        case R_SPBRG:
+        case R_SPBRGH:
+        case R_T0CON:
+            iss_ram[addr] = val;
+            simcore_sync();
+        break;
+
+        case R_RCON:
+            if (val & RCON_IPEN) {
+                simcore_fatal("interrupt priorities not supported");
+            }
+            iss_ram[addr] = val;
+        break;
+
+        case R_PCL:
+            pc = ((uint32_t)iss_ram[R_PCLATU] << 16 |
+                    (uint32_t)iss_ram[R_PCLATH] << 8 | val) & 0x1ffffe;
+        return true;
+
+        case R_TOSL:
+            set_tos(0x0000ff, 0, val);
+        break;
+        case R_TOSH:
+            set_tos(0x00ff00, 8, val);
+        break;
+        case R_TOSU:
+            set_tos(0x1f0000, 16, (uint8_t)(val & 0x1f));
+        break;
+
+        case R_STKPTR:
+            stkptr = (uint8_t)(val & 0x1f);
+        break;
+
+        case R_BSR:
+        case R_INDF0 - 5: // FSR0H
+        case R_INDF1 - 5: // FSR1H
+        case R_INDF2 - 5: // FSR2H
+            iss_ram[addr] = (uint8_t)(val & 0x0f);
+        break;
+
+        case R_EECON2:
+            if (val == 0x55) {
+                eecon2_seq = 1;
+            } else if (val == 0xaa && eecon2_seq == 1) {
+                eecon2_seq = 2;
+            } else {
+                eecon2_seq = 0;
+            }
+        break;
+
+        case R_EECON1:
+            write_eecon1(val);
+        break;
+
+        default:
+            iss_ram[addr] = val;
+        break;
+    }
+
+    return false;
+}
+
+
+// Program memory accesses
+
+static uint16_t fetch(uint32_t addr)
+{
+    if (addr + 1 >= ISS_FLASH_SIZE) {
+        simcore_fatal("program counter out of program memory");
+    }
+
+    return (uint16_t)(flash[addr] | flash[addr + 1] << 8);
+}
+
+
+static uint8_t table_read(uint32_t addr)
+{
+    return (addr < ISS_FLASH_SIZE) ? flash[addr] : 0xff;
+}
+
+
+// ALU
+
+static void set_zn(uint8_t result)
+{
+    STATUS = (uint8_t)((STATUS & ~(S_Z | S_N)) | (result == 0 ? S_Z : 0) |
+            (result & 0x80 ? S_N : 0));
+}
+
+
+// Add with carry, setting all the flags (subtractions add the complement)
+static uint8_t add(uint8_t a, uint8_t b, unsigned carry)
+{
+    unsigned sum = a + b + carry;
+    uint8_t result = (uint8_t)sum;
+    uint8_t status = (uint8_t)(STATUS & ~(S_C | S_DC | S_OV));
+
+    if (sum > 0xff) {
+        status |= S_C;
+    }
+    if ((a & 0x0f) + (b & 0x0f) + carry > 0x0f) {
+        status |= S_DC;
+    }
+    if (~(a ^ b) & (a ^ result) & 0x80) {
+        status |= S_OV;
+    }
+
+    STATUS = status;
+    set_zn(result);
+    return result;
+}
+
+
+// Execution
+
+// Address of a file register operand
+static uint16_t file_addr(uint16_t op)
+{
+    uint8_t f = (uint8_t)op;
+
+    if (op & 0x100) {
+        return (uint16_t)((iss_ram[R_BSR] & 0x0f) << 8 | f);
+    }
+
+    return (f < 0x80) ? f : (uint16_t)(0xf00 | f);
+}
+
+
+static void vector_interrupt(void)
+{
+    push(pc);
+    shadow_w = W;
+    shadow_status = STATUS;
+    shadow_bsr = iss_ram[R_BSR];
+    iss_ram[R_INTCON] &= (uint8_t)~SIMCORE_INTCON_GIE;
+
+    pc = INT_VECTOR;
+
+    in_int = true;
+    int_depth = stkptr;
+    int_start_cycles = simcore_cycles;
+    simcore_cycles += INT_LATENCY_CYCLES;
+    iss_int_profile.self_cycles += INT_LATENCY_CYCLES;
+}
+
+
+// Execute a control instruction (0x00xx)
+static unsigned execute_control(uint16_t op)
+{
+    uint32_t tblptr = (uint32_t)iss_ram[R_TBLPTRU] << 16 |
+            (uint32_t)iss_ram[R_TBLPTRH] << 8 | iss_ram[R_TBLPTRL];
+
+    switch (op) {
+        case 0x0000: // NOP
+        case 0x0004: // CLRWDT
+            return 1;
+
+        case 0x0003: // SLEEP
+            if (!(iss_ram[R_OSCCON] & OSCCON_IDLEN)) {
+                simcore_fatal("sleep mode not supported (only idle mode)");
+            }
+            sleeping = true;
+            return 1;
+
+        case 0x0005: // PUSH
+            push(pc);
+            return 1;
+
+        case 0x0006: // POP
+            pop();
+            returned = true;
+            return 1;
+
+        case 0x0007: { // DAW
+            unsigned val = W;
+
+            if ((val & 0x0f) > 9 || (STATUS & S_DC)) {
+                val += 0x06;
+            }
+            if (val > 0x9f || (STATUS & S_C)) {
+                val += 0x60;
+            }
+            if (val > 0xff) {
+                STATUS |= S_C;
+            }
+            W = (uint8_t)val;
+            return 1;
+        }
+
+        case 0x0008: // TBLRD*
+        case 0x0009: // TBLRD*+
+        case 0x000a: // TBLRD*-
+        case 0x000b: // TBLRD+*
+        case 0x000c: // TBLWT*
+        case 0x000d: // TBLWT*+
+        case 0x000e: // TBLWT*-
+        case 0x000f: // TBLWT+*
+            if ((op & 3) == 3) {
+                tblptr += 1;
+            }
+
+            if (op < 0x000c) {
+                iss_ram[R_TABLAT] = table_read(tblptr);
+            }
+
+            if ((op & 3) == 1) {
+                tblptr += 1;
+            } else if ((op & 3) == 2) {
+                tblptr -= 1;
+            }
+
+            tblptr &= 0x3fffff;
+            iss_ram[R_TBLPTRL] = (uint8_t)tblptr;
+            iss_ram[R_TBLPTRH] = (uint8_t)(tblptr >> 8);
+            iss_ram[R_TBLPTRU] = (uint8_t)(tblptr >> 16);
+            return 2;
+
+        case 0x0010: // RETFIE
+        case 0x0011: // RETFIE FAST
+            pc = pop();
+            iss_ram[R_INTCON] |= SIMCORE_INTCON_GIE;
+            if (op & 1) {
+                W = shadow_w;
+                STATUS = shadow_status;
+                iss_ram[R_BSR] = shadow_bsr;
+            }
+            returned = true;
+            return 2;
+
+        case 0x0012: // RETURN
+        case 0x0013: // RETURN FAST
+            pc = pop();
+            if (op & 1) {
+                W = shadow_w;
+                STATUS = shadow_status;
+                iss_ram[R_BSR] = shadow_bsr;
+            }
+            returned = true;
+            return 2;
+
+        default:
+            simcore_fatal("invalid instruction");
+    }
+
+    return 1;
+}
+
+
+// Execute a literal instruction (0x08xx to 0x0fxx)
+static unsigned execute_literal(uint16_t op)
+{
+    uint8_t k = (uint8_t)op;
+
+    switch (op >> 8) {
+        case 0x08: // SUBLW
+            W = add(k, (uint8_t)~W, 1);
+        break;
+        case 0x09: // IORLW
+            W |= k;
+            set_zn(W);
+        break;
+        case 0x0a: // XORLW
+            W ^= k;
+            set_zn(W);
+        break;
+        case 0x0b: // ANDLW
+            W &= k;
+            set_zn(W);
+        break;
+        case 0x0c: // RETLW
+            W = k;
+            pc = pop();
+            returned = true;
+        return 2;
+        case 0x0d: { // MULLW
+            uint16_t prod = (uint16_t)(W * k);
+            iss_ram[R_PRODL] = (uint8_t)prod;
+            iss_ram[R_PRODH] = (uint8_t)(prod >> 8);
+        }
+        break;
+        case 0x0e: // MOVLW
+            W = k;
+        break;
+        case 0x0f: // ADDLW
+            W = add(W, k, 0);
+        break;
+    }
+
+    return 1;
+}
+
+
+// Execute a byte-oriented file register instruction (0x02xx to 0x6fxx)
+static unsigned execute_file(uint16_t op)
+{
+    uint16_t addr = file_addr(op);
+    bool to_file = (op & 0x200) != 0;
+    unsigned carry = STATUS & S_C;
+    uint8_t val;
+    uint8_t result;
+    bool skip = false;
+    bool pc_written;
+
+    // Instructions with a destination (d bit)
+    unsigned opcode = op >> 10;
+
+    if (opcode >= 0x18) {
+        // CPFSLT to MOVWF (no destination bit)
+        unsigned sub = (op >> 9) & 7;
+
+        addr = resolve(addr);
+
+        switch (sub) {
+            case 0: // CPFSLT
+                skip = read_reg(addr) < W;
+            break;
+            case 1: // CPFSEQ
+                skip = read_reg(addr) == W;
+            break;
+            case 2: // CPFSGT
+                skip = read_reg(addr) > W;
+            break;
+            case 3: // TSTFSZ
+                skip = read_reg(addr) == 0;
+            break;
+            case 4: // SETF
+                return write_reg(addr, 0xff) ? 2 : 1;
+            case 5: // CLRF
+                STATUS |= S_Z;
+                return write_reg(addr, 0) ? 2 : 1;
+            case 6: // NEGF
+                result = add(0, (uint8_t)~read_reg(addr), 1);
+                return write_reg(addr, result) ? 2 : 1;
+            case 7: // MOVWF
+                return write_reg(addr, W) ? 2 : 1;
+        }
+
+        if (skip) {
+            pc += 2;
+            return 2;
+        }
+        return 1;
+    }
+
+    if (opcode == 0x00) {
+        // MULWF
+        uint16_t prod = (uint16_t)(W * read_reg(resolve(addr)));
+        iss_ram[R_PRODL] = (uint8_t)prod;
+        iss_ram[R_PRODH] = (uint8_t)(prod >> 8);
+        return 1;
+    }
+
+    addr = resolve(addr);
+    val = read_reg(addr);
+
+    switch (opcode) {
+        case 0x01: // DECF
+            result = add(val, 0xff, 0);
+        break;
+        case 0x04: // IORWF
+            result = val | W;
+            set_zn(result);
+        break;
+        case 0x05: // ANDWF
+            result = val & W;
+            set_zn(result);
+        break;
+        case 0x06: // XORWF
+            result = val ^ W;
+            set_zn(result);
+        break;
+        case 0x07: // COMF
+            result = (uint8_t)~val;
+            set_zn(result);
+        break;
+        case 0x08: // ADDWFC
+            result = add(val, W, carry);
+        break;
+        case 0x09: // ADDWF
+            result = add(val, W, 0);
+        break;
+        case 0x0a: // INCF
+            result = add(val, 1, 0);
+        break;
+        case 0x0b: // DECFSZ
+            result = (uint8_t)(val - 1);
+            skip = (result == 0);
+        break;
+        case 0x0c: // RRCF
+            result = (uint8_t)(val >> 1 | carry << 7);
+            STATUS = (uint8_t)((STATUS & ~S_C) | (val & 1));
+            set_zn(result);
+        break;
+        case 0x0d: // RLCF
+            result = (uint8_t)(val << 1 | carry);
+            STATUS = (uint8_t)((STATUS & ~S_C) | (val >> 7));
+            set_zn(result);
+        break;
+        case 0x0e: // SWAPF
+            result = (uint8_t)(val << 4 | val >> 4);
+        break;
+        case 0x0f: // INCFSZ
+            result = (uint8_t)(val + 1);
+            skip = (result == 0);
+        break;
+        case 0x10: // RRNCF
+            result = (uint8_t)(val >> 1 | val << 7);
+            set_zn(result);
+        break;
+        case 0x11: // RLNCF
+            result = (uint8_t)(val << 1 | val >> 7);
+            set_zn(result);
+        break;
+        case 0x12: // INFSNZ
+            result = (uint8_t)(val + 1);
+            skip = (result != 0);
+        break;
+        case 0x13: // DCFSNZ
+            result = (uint8_t)(val - 1);
+            skip = (result != 0);
+        break;
+        case 0x14: // MOVF
+            result = val;
+            set_zn(result);
+        break;
+        case 0x15: // SUBFWB
+            result = add(W, (uint8_t)~val, carry);
+        break;
+        case 0x16: // SUBWFB
+            result = add(val, (uint8_t)~W, carry);
+        break;
+        case 0x17: // SUBWF
+            result = add(val, (uint8_t)~W, 1);
+        break;
+        default:
+            simcore_fatal("invalid instruction");
+    }
+
+    if (to_file) {
+        pc_written = write_reg(addr, result);
+    } else {
+        W = result;
+        pc_written = false;
+    }
+
+    if (skip) {
+        pc += 2;
+        return 2;
+    }
+
+    return pc_written ? 2 : 1;
+}
+
+
+// Execute a bit-oriented instruction (0x7xxx to 0xbxxx)
+static unsigned execute_bit(uint16_t op)
+{
+    uint16_t addr = resolve(file_addr(op));
+    uint8_t mask = (uint8_t)(1 << ((op >> 9) & 7));
+    uint8_t val = read_reg(addr);
+
+    switch (op >> 12) {
+        case 0x7: // BTG
+            return write_reg(addr, val ^ mask) ? 2 : 1;
+        case 0x8: // BSF
+            return write_reg(addr, val | mask) ? 2 : 1;
+        case 0x9: // BCF
+            return write_reg(addr, (uint8_t)(val & ~mask)) ? 2 : 1;
+        case 0xa: // BTFSS
+            if (val & mask) {
+                pc += 2;
+                return 2;
+            }
+        return 1;
+        default: // BTFSC
+            if (!(val & mask)) {
+                pc += 2;
+                return 2;
+            }
+        return 1;
+    }
+}
+
+
+// Execute a branch, call or two-word instruction (0xcxxx to 0xexxx)
+static unsigned execute_branch(uint16_t op)
+{
+    bool taken;
+
+    switch (op >> 11) {
+        case 0x18: // MOVFF (0xc)
+        case 0x19: {
+            uint16_t dst = fetch(pc) & 0x0fff;
+            uint8_t val;
+
+            pc += 2;
+            val = read_reg(resolve(op & 0x0fff));
+            write_reg(resolve(dst), val);
+            return 2;
+        }
+
+        case 0x1a: // BRA
+        case 0x1b: { // RCALL
+            int32_t offset = op & 0x7ff;
+
+            if (offset & 0x400) {
+                offset -= 0x800;
+            }
+            if (op & 0x0800) {
+                push(pc);
+            }
+            pc = (uint32_t)((int32_t)pc + 2 * offset);
+            return 2;
+        }
+    }
+
+    switch (op >> 8) {
+        case 0xe0: taken = (STATUS & S_Z) != 0; break; // BZ
+        case 0xe1: taken = (STATUS & S_Z) == 0; break; // BNZ
+        case 0xe2: taken = (STATUS & S_C) != 0; break; // BC
+        case 0xe3: taken = (STATUS & S_C) == 0; break; // BNC
+        case 0xe4: taken = (STATUS & S_OV) != 0; break; // BOV
+        case 0xe5: taken = (STATUS & S_OV) == 0; break; // BNOV
+        case 0xe6: taken = (STATUS & S_N) != 0; break; // BN
+        case 0xe7: taken = (STATUS & S_N) == 0; break; // BNN
+
+        case 0xec: // CALL
+        case 0xed:
+        case 0xef: { // GOTO
+            uint16_t word2 = fetch(pc);
+            uint32_t target =
+                    ((uint32_t)(word2 & 0x0fff) << 8 | (op & 0xff)) << 1;
+
+            pc += 2;
+            if ((op >> 8) != 0xef) {
+                if (op & 0x100) {
+                    shadow_w = W;
+                    shadow_status = STATUS;
+                    shadow_bsr = iss_ram[R_BSR];
+                }
+                push(pc);
+            }
+            pc = target;
+            return 2;
+        }
+
+        case 0xee: { // LFSR
+            uint16_t word2 = fetch(pc);
+            unsigned fsr = (op >> 4) & 3;
+            static const uint16_t fsr_l[3] = {
+                R_INDF0 - 6, R_INDF1 - 6, R_INDF2 - 6,
+            };
+
+            if (fsr == 3) {
+                simcore_fatal("invalid instruction");
+            }
+
+            pc += 2;
+            iss_ram[fsr_l[fsr]] = (uint8_t)word2;
+            iss_ram[fsr_l[fsr] + 1] = (uint8_t)(op & 0x0f);
+            return 2;
+        }
+
+        default:
+            simcore_fatal("invalid instruction (extended instruction set?)");
+            return 1;
+    }
+
+    if (taken) {
+        int8_t offset = (int8_t)(op & 0xff);
+        pc = (uint32_t)((int32_t)pc + 2 * offset);
+        return 2;
+    }
+
+    return 1;
+}
+
+
+static void execute(void)
+{
+    uint16_t op;
+    unsigned cycles;
+
+    if (profile_map[pc >> 1]) {
+        profile_enter();
+    }
+
+    op = fetch(pc);
+    pc += 2;
+
+    if (op < 0x0100) {
+        cycles = execute_control(op);
+    } else if (op < 0x0200) {
+        // MOVLB
+        if ((op & 0xf0) != 0) {
+            simcore_fatal("invalid instruction");
+        }
+        iss_ram[R_BSR] = (uint8_t)(op & 0x0f);
+        cycles = 1;
+    } else if (op >= 0x0800 && op < 0x1000) {
+        cycles = execute_literal(op);
+    } else if (op < 0x7000) {
+        cycles = execute_file(op);
+    } else if (op < 0xc000) {
+        cycles = execute_bit(op);
+    } else if (op < 0xf000) {
+        cycles = execute_branch(op);
+    } else {
+        // Second word of a two-word instruction, executed as NOP
+        cycles = 1;
+    }
+
+    simcore_cycles += cycles;
+    profile_charge(cycles);
+
+    // The calls end after the return instruction
+    if (returned) {
+        returned = false;
+        profile_return();
+    }
+}
+
+
+void sim_run_until(long double time)
+{
+    uint64_t stop = simcore_time_to_cycles(time);
+
+    while (simcore_cycles < stop) {
+        if (sleeping) {
+            if (!simcore_int_pending()) {
+                uint64_t start = simcore_cycles;
+
+                simcore_step(stop);
+                iss_idle_cycles += simcore_cycles - start;
+                continue;
+            }
+            sleeping = false;
+        }
+
+        if ((iss_ram[R_INTCON] & SIMCORE_INTCON_GIE) &&
+                simcore_int_pending()) {
+            vector_interrupt();
+        }
+
+        execute();
+
+        while (simcore_cycles >= simcore_next_event) {
+            simcore_step(simcore_cycles);
+        }
+    }
+}
+
+
+void sim_init(long double start_time)
+{
+    memset(iss_ram, 0, sizeof(iss_ram));
+    memset(flash, 0xff, sizeof(flash));
+
+    // Reset values of the special function registers
+    iss_ram[R_INTCON] = 0x00;
+    iss_ram[R_INTCON2] = 0xf5;
+    iss_ram[R_IPR1] = 0xff;
+    iss_ram[R_TXSTA] = 0x02;
+    iss_ram[R_BAUDCON] = 0x40;
+    iss_ram[R_T0CON] = 0xff;
+    iss_ram[R_OSCCON] = 0x40;
+    iss_ram[R_RCON] = 0x1c;
+    for (uint16_t addr = 0xf92 ; addr <= 0xf96 ; addr += 1) {
+        iss_ram[addr] = 0xff; // TRISx
+    }
+
+    pc = 0;
+    stkptr = 0;
+    sleeping = false;
+    eecon2_seq = 0;
+
+    in_int = false;
+    int_cycles_total = 0;
+    iss_profile_reset();
+
+    simcore_init(&regs, start_time);
+
+    // The EEPROM data comes from the image
+    memset(sim_eeprom, 0xff, sizeof(sim_eeprom));
+}
+
+
+uint32_t iss_pc(void)
+{
+    return pc;
+}
+
+
+void iss_load_words(uint32_t addr, const uint16_t *words, size_t count)
+{
+    for (size_t i = 0 ; i < count ; i += 1) {
+        if (addr + 2 * i + 1 < ISS_FLASH_SIZE) {
+            flash[addr + 2 * i] = (uint8_t)words[i];
+            flash[addr + 2 * i + 1] = (uint8_t)(words[i] >> 8);
+        }
+    }
+}
+
+
+static int hex_byte(const char *str)
+{
+    unsigned val;
+
+    if (sscanf(str, "%2x", &val) != 1) {
+        return -1;
+    }
+    return (int)val;
+}
+
+
+bool iss_load_hex(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[600];
+    uint32_t base = 0;
+    bool ok = false;
+
+    if (!file) {
+        return false;
+    }
+
+    while (fgets(line, sizeof(line), file)) {
+        int length, type;
+        uint32_t addr;
+        uint8_t data[256];
+        uint8_t sum;
+
+        if (line[0] != ':') {
+            continue;
+        }
+
+        length = hex_byte(line + 1);
+        if (length < 0 || strlen(line) < (size_t)(11 + 2 * length)) {
+            break;
+        }
+
+        sum = 0;
+        for (int i = 0 ; i < length + 5 ; i += 1) {
+            int val = hex_byte(line + 1 + 2 * i);
+            if (val < 0) {
+                length = -1;
+                break;
+            }
+            if (i >= 4 && i < length + 4) {
+                data[i - 4] = (uint8_t)val;
+            }
+            sum = (uint8_t)(sum + val);
+        }
+        if (length < 0 || sum != 0) {
+            break;
+        }
+
+        addr = (uint32_t)(hex_byte(line + 3) << 8 | hex_byte(line + 5));
+        type = hex_byte(line + 7);
+
+        if (type == 0x00) {
+            for (int i = 0 ; i < length ; i += 1) {
+                uint32_t a = base + addr + (uint32_t)i;
+
+                if (a < ISS_FLASH_SIZE) {
+                    flash[a] = data[i];
+                } else if (a >= 0xf00000 && a < 0xf00000 + SIM_EEPROM_SIZE) {
+                    sim_eeprom[a - 0xf00000] = data[i];
+                }
+                // Configuration and ID words are ignored
+            }
+        } else if (type == 0x01) {
+            ok = true;
+            break;
+        } else if (type == 0x02 && length == 2) {
+            base = (uint32_t)(data[0] << 8 | data[1]) << 4;
+        } else if (type == 0x04 && length == 2) {
+            base = (uint32_t)(data[0] << 8 | data[1]) << 16;
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,71 @@
+// PIC18 instruction set simulator, used to measure the instruction cycles
+// taken by the firmware built with XC8 (see pic18bench.c).
+//
+// It implements the PIC18 core (without the extended instruction set) with
+// its instruction timings, interrupts in compatibility mode (IPEN = 0), and
+// the peripherals of simcore.c: Timer0 and the EUSART. The simulation control
+// and serial port peer interface of sim.h are provided, so the virtual GPS
+// receiver (gpssim.c) can be connected.
+
+#ifndef PIC18ISS_H
+#define PIC18ISS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+// PIC18F4420 memory sizes
+#define ISS_FLASH_SIZE 0x4000
+
+// Data memory, including the special function registers (0xf80 to 0xfff)
+extern uint8_t iss_ram[4096];
+
+// Load an Intel HEX image (program memory and EEPROM data). Should be called
+// after sim_init(). Returns false if the file cannot be read or is invalid.
+bool iss_load_hex(const char *path);
+
+// Load instruction words in program memory, at the given byte address
+void iss_load_words(uint32_t addr, const uint16_t *words, size_t count);
+
+// Current program counter
+uint32_t iss_pc(void);
+
+
+// Profiling
+
+// Cycles taken by the calls to a function, or by the interrupts. The self
+// cycles are those executed by the function itself: not by the profiled
+// functions it calls, nor by the interrupts taken during its calls (for the
+// interrupts, those of the handler outside the profiled functions, including
+// the interrupt latency).
+struct iss_profile {
+    const char *name;
+    uint32_t addr;
+    uint32_t calls;
+    uint64_t total_cycles;
+    uint64_t min_cycles;
+    uint64_t max_cycles;
+    uint64_t self_cycles;
+};
+
+// Measure the calls to the function starting at the given address: from the
+// execution of its first instruction to its return. The cycles spent in
+// interrupts are excluded (unless the function is called by the interrupt
+// handler). Returns NULL if too many functions are profiled.
+struct iss_profile *iss_profile_function(const char *name, uint32_t addr);
+
+// Interrupts, from the interrupt request to the return from interrupt
+extern struct iss_profile iss_int_profile;
+
+// Cycles spent in idle mode (after SLEEP, until an interrupt wakes the core
+// up), and cycles executed outside the interrupts and the profiled functions.
+// With the self cycles of the profiles, every cycle is accounted for once.
+extern uint64_t iss_idle_cycles;
+extern uint64_t iss_other_cycles;
+
+// Reset the profiling data (the profiled functions are kept)
+void iss_profile_reset(void);
+
+#endif
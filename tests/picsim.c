@@ -0,0 +1,337 @@
+// PIC18F4420 simulator, used to run the firmware on the host.
+
+#include <stdlib.h>
+#include <string.h>
+#include <ucontext.h>
+
+#include "picsim.h"
+#include "simcore.h"
+
+// Instruction cycles taken by each iteration of a busy-wait loop
+#define SPIN_CYCLES 8
+
+// Maximum number of consecutive interrupts before assuming the interrupt
+// handler does not acknowledge an interrupt
+#define MAX_NESTED_INTS 1000
+
+// Firmware stack size (host)
+#define FIRMWARE_STACK_SIZE (256 * 1024)
+
+
+// Registers
+
+#define SIM_REG_DEF(name) volatile uint8_t name
+#define SIM_BITS_REG_DEF(name) volatile union sim_##name sim_##name
+
+SIM_BITS_REG_DEF(INTCON);
+SIM_BITS_REG_DEF(INTCON2);
+SIM_BITS_REG_DEF(PIR1);
+SIM_BITS_REG_DEF(PIE1);
+SIM_BITS_REG_DEF(IPR1);
+SIM_BITS_REG_DEF(PIR2);
+SIM_BITS_REG_DEF(PIE2);
+SIM_BITS_REG_DEF(IPR2);
+SIM_BITS_REG_DEF(EECON1);
+SIM_BITS_REG_DEF(RCSTA);
+SIM_BITS_REG_DEF(TXSTA);
+SIM_BITS_REG_DEF(BAUDCON);
+SIM_BITS_REG_DEF(T0CON);
+SIM_REG_DEF(T1CON);
+SIM_BITS_REG_DEF(LATA);
+SIM_BITS_REG_DEF(PORTC);
+SIM_REG_DEF(LATB);
+SIM_REG_DEF(LATC);
+SIM_REG_DEF(LATD);
+SIM_REG_DEF(TRISA);
+SIM_REG_DEF(TRISB);
+SIM_REG_DEF(TRISC);
+SIM_REG_DEF(TRISD);
+SIM_REG_DEF(OSCCON);
+SIM_REG_DEF(ADCON0);
+SIM_REG_DEF(ADCON1);
+SIM_REG_DEF(SPBRG);
+SIM_REG_DEF(SPBRGH);
+
+
+// Public state
+struct sim_display sim_display;
+void (*sim_display_changed)(void);
+uint64_t sim_spin_cycles;
+uint64_t sim_wakeups;
+
+static const struct simcore_regs regs = {
+    .intcon = &INTCON,
+    .pir1 = &PIR1,
+    .pie1 = &PIE1,
+    .rcsta = &RCSTA,
+    .txsta = &TXSTA,
+    .baudcon = &BAUDCON,
+    .spbrg = &SPBRG,
+    .spbrgh = &SPBRGH,
+    .t0con = &T0CON,
+    .t1con = &T1CON,
+    .pir2 = &PIR2,
+    .pie2 = &PIE2,
+    .eecon1 = &EECON1,
+};
+
+// Stop time of the current sim_run() call
+static uint64_t stop_cycles;
+
+// Firmware context
+static ucontext_t harness_context;
+static ucontext_t firmware_context;
+static void *firmware_stack;
+static bool firmware_started;
+static bool in_interrupt;
+
+// Last decoded port values
+static uint8_t last_ports[4];
+
+
+static void dispatch_interrupts(void)
+{
+    unsigned count = 0;
+
+    if (in_interrupt) {
+        return;
+    }
+
+    simcore_sync();
+    while (INTCONbits.GIEH && simcore_int_pending()) {
+        if (++count > MAX_NESTED_INTS) {
+            simcore_fatal("interrupt not acknowledged");
+        }
+
+        in_interrupt = true;
+        INTCONbits.GIEH = 0;
+        handle_int();
+        INTCONbits.GIEH = 1;
+        in_interrupt = false;
+        simcore_sync();
+    }
+}
+
+
+static int8_t bcd_digit(uint8_t value)
+{
+    return (value <= 9) ? (int8_t)value : -1;
+}
+
+
+static void sample_display(void)
+{
+    uint8_t ports[4] = {LATA, LATB, LATC, LATD};
+
+    if (memcmp(ports, last_ports, sizeof(ports)) == 0) {
+        return;
+    }
+    memcpy(last_ports, ports, sizeof(ports));
+
+    switch (ports[1] & 0x70) {
+        case 0x40: sim_display.digits[0] = 0; break;
+        case 0x10: sim_display.digits[0] = 1; break;
+        case 0x20: sim_display.digits[0] = 2; break;
+        default: sim_display.digits[0] = -1; break;
+    }
+    sim_display.digits[1] = bcd_digit(ports[1] & 0x0f);
+    sim_display.digits[2] = (int8_t)(ports[2] & 0x07);
+    sim_display.digits[3] = bcd_digit(ports[0] & 0x0f);
+    sim_display.digits[4] = (int8_t)((ports[3] >> 4) & 0x07);
+    sim_display.digits[5] = bcd_digit(ports[3] & 0x0f);
+    sim_display.left_sep = (ports[2] & 0x20) != 0;
+    sim_display.right_sep = (ports[3] & 0x80) != 0;
+    sim_display.status_led = (ports[0] & 0x20) != 0;
+
+    if (sim_display_changed) {
+        sim_display_changed();
+    }
+}
+
+
+// Return to the harness if the simulation reached its stop time
+static void check_stop(void)
+{
+    if (simcore_cycles >= stop_cycles) {
+        if (in_interrupt) {
+            simcore_fatal("interrupt handler waiting");
+        }
+
+        swapcontext(&firmware_context, &harness_context);
+    }
+}
+
+
+__attribute__((noreturn)) static void firmware_entry(void)
+{
+    firmware_main();
+}
+
+
+// Hardware abstraction layer
+
+uint8_t sim_uart_read(void)
+{
+    return simcore_uart_read();
+}
+
+
+void sim_uart_write(uint8_t val)
+{
+    simcore_uart_write(val);
+}
+
+
+void sim_uart_restart_rx(void)
+{
+    RCSTAbits.CREN = 0;
+    simcore_sync();
+    RCSTAbits.CREN = 1;
+    simcore_sync();
+}
+
+
+uint16_t sim_timer0_read(void)
+{
+    return simcore_timer0_read();
+}
+
+
+// The firmware takes no time: the reload waits for the next increment (the
+// code of the target macro is modelled by the cycles lost)
+void sim_timer0_add_high(uint8_t val, uint32_t lost_cycles)
+{
+    simcore_timer0_add((uint16_t)(val << 8), lost_cycles);
+}
+
+
+uint16_t sim_timer1_read(void)
+{
+    return simcore_timer1_read();
+}
+
+
+uint8_t sim_eeprom_read(uint8_t addr)
+{
+    return sim_eeprom[addr];
+}
+
+
+void sim_eeprom_write(uint8_t addr, uint8_t val)
+{
+    if (INTCONbits.GIEH) {
+        // The unlock sequence must not be interrupted
+        simcore_fatal("EEPROM write with interrupts enabled");
+    }
+
+    simcore_eeprom_write(addr, val);
+}
+
+
+void sim_spin(void)
+{
+    uint64_t end = simcore_cycles + SPIN_CYCLES;
+
+    sim_spin_cycles += SPIN_CYCLES;
+    sample_display();
+
+    while (simcore_step(end)) {
+        dispatch_interrupts();
+    }
+    dispatch_interrupts();
+
+    check_stop();
+}
+
+
+void Sleep(void)
+{
+    sample_display();
+
+    for (;;) {
+        simcore_sync();
+        if (simcore_int_pending()) {
+            break;
+        }
+
+        check_stop();
+        simcore_step(stop_cycles);
+    }
+
+    sim_wakeups += 1;
+    dispatch_interrupts();
+    sample_display();
+}
+
+
+// Simulation control
+
+void sim_init(long double start_time)
+{
+    stop_cycles = 0;
+    firmware_started = false;
+    in_interrupt = false;
+
+    // Reset values of the registers
+    INTCON = 0x00;
+    INTCON2 = 0xf5;
+    PIR1 = 0x00;
+    PIE1 = 0x00;
+    IPR1 = 0xff;
+    PIR2 = 0x00;
+    PIE2 = 0x00;
+    IPR2 = 0xdf;
+    EECON1 = 0x00;
+    RCSTA = 0x00;
+    TXSTA = 0x02;
+    BAUDCON = 0x40;
+    T0CON = 0xff;
+    T1CON = 0x00;
+    LATA = 0x00;
+    LATB = 0x00;
+    LATC = 0x00;
+    LATD = 0x00;
+    TRISA = 0xff;
+    TRISB = 0xff;
+    TRISC = 0xff;
+    TRISD = 0xff;
+    OSCCON = 0x40;
+    ADCON0 = 0x00;
+    ADCON1 = 0x00;
+    SPBRG = 0x00;
+    SPBRGH = 0x00;
+
+    simcore_init(&regs, start_time);
+
+    memset(&sim_display, 0, sizeof(sim_display));
+    memset(last_ports, 0, sizeof(last_ports));
+    sim_display_changed = NULL;
+    sim_spin_cycles = 0;
+    sim_wakeups = 0;
+}
+
+
+void sim_run_until(long double time)
+{
+    stop_cycles = simcore_time_to_cycles(time);
+
+    if (!firmware_started) {
+        if (!firmware_stack) {
+            firmware_stack = malloc(FIRMWARE_STACK_SIZE);
+            if (!firmware_stack) {
+                simcore_fatal("cannot allocate the firmware stack");
+            }
+        }
+
+        getcontext(&firmware_context);
+        firmware_context.uc_stack.ss_sp = firmware_stack;
+        firmware_context.uc_stack.ss_size = FIRMWARE_STACK_SIZE;
+        firmware_context.uc_link = NULL;
+        makecontext(&firmware_context, firmware_entry, 0);
+        firmware_started = true;
+    }
+
+    if (simcore_cycles < stop_cycles) {
+        swapcontext(&harness_context, &firmware_context);
+    }
+}
@@ -0,0 +1,204 @@
+// PIC18F4420 simulator, used to run the firmware on the host.
+//
+// The special function registers used by the firmware are provided as plain
+// variables; the simulator implements the behavior of Timer0, of the EUSART,
+// of the data EEPROM and of the interrupts. The CPU itself is not simulated:
+// the firmware code is compiled for the host and executes instantly; time only
+// advances when the firmware sleeps (Sleep()) or busy-waits (HAL_SPIN()). This
+// allows simulating years of operation in a short time.
+//
+// The firmware runs in its own context; sim_run() (see sim.h) runs it for a
+// given amount of (simulated) time and returns.
+
+#ifndef PICSIM_H
+#define PICSIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+
+// Special function registers
+
+#define SIM_REG(name) extern volatile uint8_t name
+
+#define SIM_BITS_REG(name, fields) \
+    union sim_##name { uint8_t reg; struct fields bits; }; \
+    extern volatile union sim_##name sim_##name
+
+SIM_BITS_REG(INTCON, {
+    unsigned RBIF : 1; unsigned INT0IF : 1; unsigned T0IF : 1;
+    unsigned RBIE : 1; unsigned INT0IE : 1; unsigned T0IE : 1;
+    unsigned PEIE : 1; unsigned GIEH : 1; });
+#define INTCON sim_INTCON.reg
+#define INTCONbits sim_INTCON.bits
+
+SIM_BITS_REG(INTCON2, {
+    unsigned RBIP : 1; unsigned : 1; unsigned TMR0IP : 1; unsigned : 1;
+    unsigned INTEDG2 : 1; unsigned INTEDG1 : 1; unsigned INTEDG0 : 1;
+    unsigned RBPU : 1; });
+#define INTCON2 sim_INTCON2.reg
+#define INTCON2bits sim_INTCON2.bits
+
+SIM_BITS_REG(PIR1, {
+    unsigned TMR1IF : 1; unsigned TMR2IF : 1; unsigned CCP1IF : 1;
+    unsigned SSPIF : 1; unsigned TXIF : 1; unsigned RCIF : 1;
+    unsigned ADIF : 1; unsigned PSPIF : 1; });
+#define PIR1 sim_PIR1.reg
+#define PIR1bits sim_PIR1.bits
+
+SIM_BITS_REG(PIE1, {
+    unsigned TMR1IE : 1; unsigned TMR2IE : 1; unsigned CCP1IE : 1;
+    unsigned SSPIE : 1; unsigned TXIE : 1; unsigned RCIE : 1;
+    unsigned ADIE : 1; unsigned PSPIE : 1; });
+#define PIE1 sim_PIE1.reg
+#define PIE1bits sim_PIE1.bits
+
+SIM_BITS_REG(IPR1, {
+    unsigned TMR1IP : 1; unsigned TMR2IP : 1; unsigned CCP1IP : 1;
+    unsigned SSPIP : 1; unsigned TXIP : 1; unsigned RCIP : 1;
+    unsigned ADIP : 1; unsigned PSPIP : 1; });
+#define IPR1 sim_IPR1.reg
+#define IPR1bits sim_IPR1.bits
+
+SIM_BITS_REG(PIR2, {
+    unsigned CCP2IF : 1; unsigned TMR3IF : 1; unsigned HLVDIF : 1;
+    unsigned BCLIF : 1; unsigned EEIF : 1; unsigned : 1;
+    unsigned CMIF : 1; unsigned OSCFIF : 1; });
+#define PIR2 sim_PIR2.reg
+#define PIR2bits sim_PIR2.bits
+
+SIM_BITS_REG(PIE2, {
+    unsigned CCP2IE : 1; unsigned TMR3IE : 1; unsigned HLVDIE : 1;
+    unsigned BCLIE : 1; unsigned EEIE : 1; unsigned : 1;
+    unsigned CMIE : 1; unsigned OSCFIE : 1; });
+#define PIE2 sim_PIE2.reg
+#define PIE2bits sim_PIE2.bits
+
+SIM_BITS_REG(IPR2, {
+    unsigned CCP2IP : 1; unsigned TMR3IP : 1; unsigned HLVDIP : 1;
+    unsigned BCLIP : 1; unsigned EEIP : 1; unsigned : 1;
+    unsigned CMIP : 1; unsigned OSCFIP : 1; });
+#define IPR2 sim_IPR2.reg
+#define IPR2bits sim_IPR2.bits
+
+SIM_BITS_REG(EECON1, {
+    unsigned RD : 1; unsigned WR : 1; unsigned WREN : 1; unsigned WRERR : 1;
+    unsigned FREE : 1; unsigned : 1; unsigned CFGS : 1; unsigned EEPGD : 1; });
+#define EECON1 sim_EECON1.reg
+#define EECON1bits sim_EECON1.bits
+
+SIM_BITS_REG(RCSTA, {
+    unsigned RX9D : 1; unsigned OERR : 1; unsigned FERR : 1;
+    unsigned ADDEN : 1; unsigned CREN : 1; unsigned SREN : 1;
+    unsigned RX9 : 1; unsigned SPEN : 1; });
+#define RCSTA sim_RCSTA.reg
+#define RCSTAbits sim_RCSTA.bits
+
+SIM_BITS_REG(TXSTA, {
+    unsigned TX9D : 1; unsigned TRMT : 1; unsigned BRGH : 1;
+    unsigned SENDB : 1; unsigned SYNC : 1; unsigned TXEN : 1;
+    unsigned TX9 : 1; unsigned CSRC : 1; });
+#define TXSTA sim_TXSTA.reg
+#define TXSTAbits sim_TXSTA.bits
+
+SIM_BITS_REG(BAUDCON, {
+    unsigned ABDEN : 1; unsigned WUE : 1; unsigned : 1; unsigned BRG16 : 1;
+    unsigned TXCKP : 1; unsigned RXDTP : 1; unsigned RCIDL : 1;
+    unsigned ABDOVF : 1; });
+#define BAUDCON sim_BAUDCON.reg
+#define BAUDCONbits sim_BAUDCON.bits
+
+SIM_BITS_REG(T0CON, {
+    unsigned T0PS : 3; unsigned PSA : 1; unsigned T0SE : 1;
+    unsigned T0CS : 1; unsigned T08BIT : 1; unsigned TMR0ON : 1; });
+#define T0CON sim_T0CON.reg
+#define T0CONbits sim_T0CON.bits
+
+SIM_BITS_REG(LATA, {
+    unsigned LA0 : 1; unsigned LA1 : 1; unsigned LA2 : 1; unsigned LA3 : 1;
+    unsigned LA4 : 1; unsigned LA5 : 1; unsigned LA6 : 1; unsigned LA7 : 1; });
+#define LATA sim_LATA.reg
+#define LATAbits sim_LATA.bits
+
+SIM_BITS_REG(PORTC, {
+    unsigned RC0 : 1; unsigned RC1 : 1; unsigned RC2 : 1; unsigned RC3 : 1;
+    unsigned RC4 : 1; unsigned RC5 : 1; unsigned RC6 : 1; unsigned RC7 : 1; });
+#define PORTC sim_PORTC.reg
+#define PORTCbits sim_PORTC.bits
+
+SIM_REG(LATB);
+SIM_REG(LATC);
+SIM_REG(LATD);
+SIM_REG(TRISA);
+SIM_REG(TRISB);
+SIM_REG(TRISC);
+SIM_REG(TRISD);
+SIM_REG(OSCCON);
+SIM_REG(ADCON0);
+SIM_REG(ADCON1);
+SIM_REG(SPBRG);
+SIM_REG(SPBRGH);
+SIM_REG(T1CON);
+
+
+// Hardware abstraction layer (see hal.h)
+
+uint8_t sim_uart_read(void);
+void sim_uart_write(uint8_t val);
+void sim_uart_restart_rx(void);
+uint16_t sim_timer0_read(void);
+void sim_timer0_add_high(uint8_t val, uint32_t lost_cycles);
+uint16_t sim_timer1_read(void);
+uint8_t sim_eeprom_read(uint8_t addr);
+void sim_eeprom_write(uint8_t addr, uint8_t val);
+void sim_spin(void);
+
+#define HAL_UART_READ() sim_uart_read()
+#define HAL_UART_WRITE(val) sim_uart_write(val)
+#define HAL_UART_RESTART_RX() sim_uart_restart_rx()
+#define HAL_TIMER0_READ(var) do { (var) = sim_timer0_read(); } while (0)
+#define HAL_TIMER0_ADD_HIGH(val) \
+    sim_timer0_add_high((val), TMR0_RELOAD_CYCLES)
+#define HAL_TIMER1_READ(var) do { (var) = sim_timer1_read(); } while (0)
+#define HAL_EEPROM_READ(addr, var) do { \
+    (var) = sim_eeprom_read(addr); \
+} while (0)
+#define HAL_EEPROM_WRITE(addr, val) sim_eeprom_write((addr), (val))
+#define HAL_SPIN() sim_spin()
+
+// Compiler specific definitions
+#define __interrupt(priority)
+void Sleep(void);
+
+// The firmware entry point (main() is renamed by hal.h), which never returns,
+// and interrupt handler
+__attribute__((noreturn)) void firmware_main(void);
+void handle_int(void);
+
+
+// Display
+
+// Displayed value, decoded from the I/O ports. The digits are -1 if blank.
+struct sim_display {
+    int8_t digits[6];
+    bool left_sep;
+    bool right_sep;
+    bool status_led;
+};
+
+extern struct sim_display sim_display;
+
+// If not NULL, called each time the displayed value changes
+extern void (*sim_display_changed)(void);
+
+
+// Instruction cycles spent by the firmware in busy-wait loops (HAL_SPIN())
+extern uint64_t sim_spin_cycles;
+
+// Number of times the firmware woke up from Sleep()
+extern uint64_t sim_wakeups;
+
+
+#endif
@@ -0,0 +1,69 @@
+// Simulation control and serial port peer interface, common to the host PIC
+// simulator (picsim.c) and the PIC18 instruction set simulator (pic18iss.c).
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Reset the simulator. The simulation starts at the given UTC time (seconds
+// since 1/1/1970), with the firmware not started yet.
+void sim_init(long double start_time);
+
+// Set the actual frequency of the oscillator, in Hz. Defaults to OSC_FREQ.
+void sim_set_osc_freq(double freq);
+
+// Run the firmware for the given duration, in seconds.
+void sim_run(long double duration);
+
+// Run the firmware until the given UTC time.
+void sim_run_until(long double time);
+
+// Current simulation time (UTC, seconds since 1/1/1970)
+long double sim_time(void);
+
+// Instruction cycles elapsed since the simulation start
+uint64_t sim_cycles(void);
+
+// Schedule a callback at the given time. The callbacks are called in time
+// order; callbacks scheduled at the same time are called in scheduling order.
+void sim_at(long double time, void (*callback)(void));
+
+
+// Data EEPROM contents. Erased (0xff) by the first sim_init(), then kept, as
+// on the chip across power cycles.
+#define SIM_EEPROM_SIZE 256
+extern uint8_t sim_eeprom[SIM_EEPROM_SIZE];
+
+// If not NULL, called when the firmware starts writing a byte to the data
+// EEPROM (the new value is already in sim_eeprom). Used to simulate power
+// losses during the writes.
+extern void (*sim_eeprom_write_started)(uint8_t addr);
+
+
+// Serial port peer (GPS receiver)
+
+// Baud rate used by the peer. Bytes sent at a different baud rate (more than 3%
+// difference) are received as framing errors.
+extern uint32_t sim_peer_baud;
+
+// Called when the peer receives a byte from the PIC
+extern void (*sim_peer_receive)(uint8_t byte);
+
+// Send a byte from the peer to the PIC. It is sent after the previously queued
+// bytes (10 bits per byte, at the peer baud rate).
+void sim_peer_send(uint8_t byte);
+
+// Time at which the peer will be done sending the queued bytes
+long double sim_peer_send_end(void);
+
+// Switch the PIC serial port to the closest available baud rate, as the
+// firmware would (16-bit baud rate generator, high speed), for example to
+// replay a capture faster than its actual rate. Returns the rate obtained.
+uint32_t sim_set_uart_baud(uint32_t baud);
+
+// Number of bytes lost by the PIC serial port because of overruns
+extern uint32_t sim_uart_overruns;
+
+#endif
@@ -0,0 +1,634 @@
+// Peripheral models shared by the PIC simulators.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simcore.h"
+#include "timebase.h"
+
+// Maximum number of pending callbacks and queued peer bytes
+#define MAX_CALLBACKS 64
+#define PEER_QUEUE_SIZE 4096
+
+// Tolerated difference between the PIC and peer baud rates
+#define MAX_BAUD_ERROR 0.03
+
+// Data EEPROM write time: 4 ms
+#define EEPROM_WRITE_SECS 0.004L
+
+// Register bits
+#define RCSTA_SPEN 0x80
+#define RCSTA_CREN 0x10
+#define RCSTA_FERR 0x04
+#define RCSTA_OERR 0x02
+#define TXSTA_TXEN 0x20
+#define TXSTA_BRGH 0x04
+#define TXSTA_TRMT 0x02
+#define BAUDCON_BRG16 0x08
+#define PIR1_RCIF 0x20
+#define PIR1_TXIF 0x10
+#define PIR2_EEIF 0x10
+#define EECON1_WR 0x02
+#define T0CON_TMR0ON 0x80
+#define T0CON_T08BIT 0x40
+#define T0CON_PSA 0x08
+#define T0CON_T0PS 0x07
+#define T1CON_T1CKPS 0x30
+#define T1CON_TMR1CS 0x02
+#define T1CON_TMR1ON 0x01
+
+#define SET_BIT(reg, bit, val) \
+    (*(reg) = (uint8_t)((val) ? (*(reg) | (bit)) : (*(reg) & ~(bit))))
+
+
+// Public state
+uint32_t sim_peer_baud;
+void (*sim_peer_receive)(uint8_t byte);
+uint32_t sim_uart_overruns;
+uint8_t sim_eeprom[SIM_EEPROM_SIZE];
+void (*sim_eeprom_write_started)(uint8_t addr);
+uint64_t simcore_cycles;
+uint64_t simcore_next_event;
+
+static struct simcore_regs regs;
+
+// Time keeping: the simulation time is counted in instruction cycles
+// (oscillator frequency / 4). The UTC time is derived from it.
+static long double osc_freq;
+static uint64_t time_base_cycles;
+static long double time_base;
+
+// Scheduled callbacks, in time order
+static struct {
+    uint64_t cycles;
+    void (*callback)(void);
+} callbacks[MAX_CALLBACKS];
+static unsigned callback_count;
+
+// Timer0: the timer had the value tmr0_start_value at tmr0_start_cycles, with
+// the T0CON value tmr0_con.
+static uint8_t tmr0_con;
+static uint64_t tmr0_start_cycles;
+static uint32_t tmr0_start_value;
+
+// EUSART receiver
+static struct {
+    uint8_t byte;
+    bool ferr;
+} rx_fifo[2];
+static uint8_t rx_count;
+static uint8_t rx_last;
+static bool rx_oerr;
+
+// EUSART transmitter
+static bool tsr_busy;
+static uint8_t tsr_byte;
+static bool tsr_valid; // Sent at the peer baud rate
+static uint64_t tsr_end_cycles;
+static bool txreg_full;
+static uint8_t txreg;
+
+// Bytes sent by the peer: end of their stop bit, and baud rate used
+static struct {
+    long double end;
+    uint8_t byte;
+    uint32_t baud;
+} peer_queue[PEER_QUEUE_SIZE];
+static unsigned peer_queue_start;
+static unsigned peer_queue_count;
+static long double peer_send_end;
+
+// Data EEPROM: erased on the first initialization, end of the write in
+// progress
+static bool eeprom_initialized;
+static bool eeprom_busy;
+static uint64_t eeprom_write_end;
+
+
+void simcore_fatal(const char *msg)
+{
+    fprintf(stderr, "sim: %s\n", msg);
+    abort();
+}
+
+
+// Time conversions
+
+long double simcore_cycles_to_time(uint64_t c)
+{
+    return time_base + (long double)(c - time_base_cycles) * 4 / osc_freq;
+}
+
+
+uint64_t simcore_time_to_cycles(long double t)
+{
+    if (t <= time_base) {
+        return time_base_cycles;
+    }
+
+    return time_base_cycles + (uint64_t)ceill((t - time_base) * osc_freq / 4);
+}
+
+
+// Timer0
+
+static uint32_t tmr0_prescaler(uint8_t con)
+{
+    if (con & T0CON_PSA) {
+        return 1;
+    }
+    return 2U << (con & T0CON_T0PS);
+}
+
+
+static uint32_t tmr0_modulus(uint8_t con)
+{
+    return (con & T0CON_T08BIT) ? 256 : 65536;
+}
+
+
+static uint32_t tmr0_value(uint64_t c)
+{
+    if (!(tmr0_con & T0CON_TMR0ON) || c < tmr0_start_cycles) {
+        return tmr0_start_value;
+    }
+
+    uint64_t counts = (c - tmr0_start_cycles) / tmr0_prescaler(tmr0_con);
+    return (uint32_t)((tmr0_start_value + counts) % tmr0_modulus(tmr0_con));
+}
+
+
+static uint64_t tmr0_next_overflow(void)
+{
+    if (!(tmr0_con & T0CON_TMR0ON)) {
+        return UINT64_MAX;
+    }
+
+    return tmr0_start_cycles + (uint64_t)(tmr0_modulus(tmr0_con) -
+            tmr0_start_value) * tmr0_prescaler(tmr0_con);
+}
+
+
+// Baud rate, in instruction cycles per bit
+static uint32_t uart_bit_cycles(void)
+{
+    uint32_t n = *regs.spbrg;
+    bool brg16 = (*regs.baudcon & BAUDCON_BRG16) != 0;
+    bool brgh = (*regs.txsta & TXSTA_BRGH) != 0;
+
+    if (brg16) {
+        n |= (uint32_t)*regs.spbrgh << 8;
+    }
+
+    if (brg16 && brgh) {
+        return n + 1;
+    } else if (brg16 || brgh) {
+        return 4 * (n + 1);
+    } else {
+        return 16 * (n + 1);
+    }
+}
+
+
+static bool uart_baud_matches(uint32_t baud)
+{
+    long double pic_baud = osc_freq / 4 / uart_bit_cycles();
+    return fabsl(pic_baud - baud) < baud * MAX_BAUD_ERROR;
+}
+
+
+static void uart_start_tx(uint8_t byte)
+{
+    tsr_busy = true;
+    tsr_byte = byte;
+    tsr_valid = uart_baud_matches(sim_peer_baud);
+    tsr_end_cycles = simcore_cycles + 10 * uart_bit_cycles();
+}
+
+
+static void uart_rx(uint8_t byte, bool ferr)
+{
+    if (!(*regs.rcsta & RCSTA_SPEN) || !(*regs.rcsta & RCSTA_CREN) ||
+            rx_oerr) {
+        return;
+    }
+
+    if (rx_count == 2) {
+        rx_oerr = true;
+        sim_uart_overruns += 1;
+        return;
+    }
+
+    rx_fifo[rx_count].byte = byte;
+    rx_fifo[rx_count].ferr = ferr;
+    rx_count += 1;
+}
+
+
+// Events
+
+enum event_type { NONE, TIMER0, TX_DONE, RX, EEPROM_DONE, CALLBACK };
+
+// Find the earliest event; simultaneous events are processed in the order of
+// the checks below.
+static enum event_type next_event(uint64_t *event_cycles)
+{
+    enum event_type event = NONE;
+
+#define CHECK_EVENT(type, event_time) do { \
+        uint64_t c = (event_time); \
+        if (c < *event_cycles || (event == NONE && c == *event_cycles)) { \
+            event = type; \
+            *event_cycles = c; \
+        } \
+    } while (0)
+
+    CHECK_EVENT(TIMER0, tmr0_next_overflow());
+    if (tsr_busy) {
+        CHECK_EVENT(TX_DONE, tsr_end_cycles);
+    }
+    if (peer_queue_count > 0) {
+        long double end = peer_queue[peer_queue_start].end;
+        CHECK_EVENT(RX, simcore_time_to_cycles(end));
+    }
+    if (eeprom_busy) {
+        CHECK_EVENT(EEPROM_DONE, eeprom_write_end);
+    }
+    if (callback_count > 0) {
+        CHECK_EVENT(CALLBACK, callbacks[0].cycles);
+    }
+
+#undef CHECK_EVENT
+
+    return event;
+}
+
+
+static void update_next_event(void)
+{
+    simcore_next_event = UINT64_MAX;
+    next_event(&simcore_next_event);
+}
+
+
+void simcore_sync(void)
+{
+    uint8_t rcsta;
+
+    if (*regs.t0con != tmr0_con) {
+        tmr0_start_value = tmr0_value(simcore_cycles);
+        tmr0_start_cycles = simcore_cycles;
+        tmr0_con = *regs.t0con;
+        update_next_event();
+    }
+
+    rcsta = *regs.rcsta;
+    if (!(rcsta & RCSTA_SPEN) || !(rcsta & RCSTA_CREN)) {
+        rx_oerr = false;
+    }
+
+    SET_BIT(regs.rcsta, RCSTA_OERR, rx_oerr);
+    SET_BIT(regs.rcsta, RCSTA_FERR, rx_count > 0 && rx_fifo[0].ferr);
+    SET_BIT(regs.pir1, PIR1_RCIF, rx_count > 0);
+    SET_BIT(regs.pir1, PIR1_TXIF, !txreg_full);
+    SET_BIT(regs.txsta, TXSTA_TRMT, !tsr_busy);
+    SET_BIT(regs.eecon1, EECON1_WR, eeprom_busy);
+}
+
+
+bool simcore_step(uint64_t limit)
+{
+    uint64_t event_cycles = limit;
+    enum event_type event;
+
+    simcore_sync();
+
+    event = next_event(&event_cycles);
+    if (event_cycles > simcore_cycles) {
+        simcore_cycles = event_cycles;
+    }
+
+    switch (event) {
+        case NONE:
+            update_next_event();
+            return false;
+
+        case TIMER0:
+            *regs.intcon |= SIMCORE_INTCON_T0IF;
+            tmr0_start_cycles = event_cycles;
+            tmr0_start_value = 0;
+        break;
+
+        case TX_DONE:
+            if (tsr_valid && sim_peer_receive) {
+                sim_peer_receive(tsr_byte);
+            }
+
+            tsr_busy = false;
+            if (txreg_full) {
+                txreg_full = false;
+                uart_start_tx(txreg);
+            }
+        break;
+
+        case RX: {
+            uint8_t byte = peer_queue[peer_queue_start].byte;
+            bool valid = uart_baud_matches(peer_queue[peer_queue_start].baud);
+
+            peer_queue_start = (peer_queue_start + 1) % PEER_QUEUE_SIZE;
+            peer_queue_count -= 1;
+
+            // A byte received at the wrong baud rate is garbage
+            uart_rx(valid ? byte : (uint8_t)(byte ^ 0x5a), !valid);
+        }
+        break;
+
+        case EEPROM_DONE:
+            eeprom_busy = false;
+            *regs.pir2 |= PIR2_EEIF;
+        break;
+
+        case CALLBACK: {
+            void (*callback)(void) = callbacks[0].callback;
+
+            callback_count -= 1;
+            memmove(&callbacks[0], &callbacks[1],
+                    callback_count * sizeof(callbacks[0]));
+            callback();
+        }
+        break;
+    }
+
+    simcore_sync();
+    update_next_event();
+    return true;
+}
+
+
+bool simcore_int_pending(void)
+{
+    uint8_t intcon = *regs.intcon;
+
+    if ((intcon & SIMCORE_INTCON_T0IE) && (intcon & SIMCORE_INTCON_T0IF)) {
+        return true;
+    }
+
+    return (intcon & SIMCORE_INTCON_PEIE) &&
+            ((*regs.pir1 & *regs.pie1) || (*regs.pir2 & *regs.pie2));
+}
+
+
+uint8_t simcore_uart_read(void)
+{
+    simcore_sync();
+
+    if (rx_count > 0) {
+        rx_last = rx_fifo[0].byte;
+        rx_fifo[0] = rx_fifo[1];
+        rx_count -= 1;
+        simcore_sync();
+    }
+
+    return rx_last;
+}
+
+
+void simcore_uart_write(uint8_t val)
+{
+    simcore_sync();
+
+    if (!(*regs.rcsta & RCSTA_SPEN) || !(*regs.txsta & TXSTA_TXEN)) {
+        return;
+    }
+
+    if (!tsr_busy) {
+        uart_start_tx(val);
+    } else {
+        txreg = val;
+        txreg_full = true;
+    }
+
+    simcore_sync();
+    update_next_event();
+}
+
+
+uint16_t simcore_timer0_read(void)
+{
+    simcore_sync();
+    return (uint16_t)tmr0_value(simcore_cycles);
+}
+
+
+// Timer1 is only modelled as a free-running counter of the instruction cycles
+// (through its pre-scaler), for profiling: it cannot be written, and does not
+// interrupt.
+uint16_t simcore_timer1_read(void)
+{
+    uint8_t con = *regs.t1con;
+
+    if (!(con & T1CON_TMR1ON) || (con & T1CON_TMR1CS)) {
+        return 0;
+    }
+
+    return (uint16_t)(simcore_cycles >> ((con & T1CON_T1CKPS) >> 4));
+}
+
+
+void simcore_timer0_write(uint16_t val)
+{
+    simcore_sync();
+
+    // The prescaler is cleared, and the timer does not count during the next
+    // two instruction cycles.
+    tmr0_start_value = val % tmr0_modulus(tmr0_con);
+    tmr0_start_cycles = simcore_cycles + 2;
+    update_next_event();
+}
+
+
+// Reload written by the firmware right after an increment of the timer (see
+// HAL_TIMER0_ADD_HIGH()), which stops counting during the given number of
+// cycles
+void simcore_timer0_add(uint16_t val, uint32_t lost_cycles)
+{
+    uint32_t prescaler;
+    uint64_t increment;
+
+    simcore_sync();
+
+    prescaler = tmr0_prescaler(tmr0_con);
+    increment = tmr0_start_cycles + prescaler;
+    if (simcore_cycles >= tmr0_start_cycles) {
+        increment += (simcore_cycles - tmr0_start_cycles) / prescaler *
+                prescaler;
+    }
+
+    tmr0_start_value = (tmr0_value(increment) + val) % tmr0_modulus(tmr0_con);
+    tmr0_start_cycles = increment + lost_cycles;
+    update_next_event();
+}
+
+
+void simcore_eeprom_write(uint8_t addr, uint8_t val)
+{
+    simcore_sync();
+
+    if (eeprom_busy) {
+        simcore_fatal("EEPROM write while busy");
+    }
+
+    sim_eeprom[addr] = val;
+    eeprom_busy = true;
+    eeprom_write_end = simcore_cycles +
+            (uint64_t)(EEPROM_WRITE_SECS * osc_freq / 4);
+
+    simcore_sync();
+    update_next_event();
+
+    if (sim_eeprom_write_started) {
+        sim_eeprom_write_started(addr);
+    }
+}
+
+
+void simcore_init(const struct simcore_regs *init_regs, long double start_time)
+{
+    regs = *init_regs;
+
+    if (!eeprom_initialized) {
+        memset(sim_eeprom, 0xff, sizeof(sim_eeprom));
+        eeprom_initialized = true;
+    }
+    eeprom_busy = false;
+    sim_eeprom_write_started = NULL;
+
+    simcore_cycles = 0;
+    osc_freq = OSC_FREQ;
+    time_base_cycles = 0;
+    time_base = start_time;
+    callback_count = 0;
+
+    tmr0_con = *regs.t0con;
+    tmr0_start_cycles = 0;
+    tmr0_start_value = 0;
+
+    rx_count = 0;
+    rx_last = 0;
+    rx_oerr = false;
+    tsr_busy = false;
+    txreg_full = false;
+
+    peer_queue_start = 0;
+    peer_queue_count = 0;
+    peer_send_end = start_time;
+    sim_peer_baud = 4800;
+    sim_peer_receive = NULL;
+    sim_uart_overruns = 0;
+
+    simcore_sync();
+    update_next_event();
+}
+
+
+// Simulation control
+
+void sim_set_osc_freq(double freq)
+{
+    time_base = simcore_cycles_to_time(simcore_cycles);
+    time_base_cycles = simcore_cycles;
+    osc_freq = freq;
+    update_next_event();
+}
+
+
+void sim_run(long double duration)
+{
+    sim_run_until(sim_time() + duration);
+}
+
+
+long double sim_time(void)
+{
+    return simcore_cycles_to_time(simcore_cycles);
+}
+
+
+uint64_t sim_cycles(void)
+{
+    return simcore_cycles;
+}
+
+
+void sim_at(long double time, void (*callback)(void))
+{
+    uint64_t c = simcore_time_to_cycles(time);
+    unsigned pos = callback_count;
+
+    if (callback_count == MAX_CALLBACKS) {
+        simcore_fatal("too many callbacks");
+    }
+
+    while (pos > 0 && callbacks[pos - 1].cycles > c) {
+        callbacks[pos] = callbacks[pos - 1];
+        pos -= 1;
+    }
+
+    callbacks[pos].cycles = c;
+    callbacks[pos].callback = callback;
+    callback_count += 1;
+    update_next_event();
+}
+
+
+// Serial port peer
+
+void sim_peer_send(uint8_t byte)
+{
+    unsigned pos;
+    long double now = sim_time();
+
+    if (peer_queue_count == PEER_QUEUE_SIZE) {
+        simcore_fatal("peer send queue full");
+    }
+
+    if (peer_send_end < now) {
+        peer_send_end = now;
+    }
+    peer_send_end += 10.0L / sim_peer_baud;
+
+    pos = (peer_queue_start + peer_queue_count) % PEER_QUEUE_SIZE;
+    peer_queue[pos].end = peer_send_end;
+    peer_queue[pos].byte = byte;
+    peer_queue[pos].baud = sim_peer_baud;
+    peer_queue_count += 1;
+    update_next_event();
+}
+
+
+long double sim_peer_send_end(void)
+{
+    long double now = sim_time();
+    return (peer_send_end > now) ? peer_send_end : now;
+}
+
+
+uint32_t sim_set_uart_baud(uint32_t baud)
+{
+    long double n = roundl(osc_freq / 4 / baud) - 1;
+
+    if (n < 0) {
+        n = 0;
+    } else if (n > 0xffff) {
+        n = 0xffff;
+    }
+
+    *regs.spbrg = (uint8_t)n;
+    *regs.spbrgh = (uint8_t)((uint32_t)n >> 8);
+    *regs.baudcon |= BAUDCON_BRG16;
+    *regs.txsta |= TXSTA_BRGH;
+
+    return (uint32_t)lroundl(osc_freq / 4 / uart_bit_cycles());
+}
@@ -0,0 +1,78 @@
+// Peripheral models shared by the PIC simulators: time keeping, scheduled
+// callbacks, Timer0, EUSART, data EEPROM and interrupt flags. The simulators
+// provide the location of the special function registers, and advance
+// simcore_cycles as the firmware executes.
+
+#ifndef SIMCORE_H
+#define SIMCORE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sim.h"
+
+// Special function registers used by the peripheral models
+struct simcore_regs {
+    volatile uint8_t *intcon;
+    volatile uint8_t *pir1;
+    volatile uint8_t *pie1;
+    volatile uint8_t *rcsta;
+    volatile uint8_t *txsta;
+    volatile uint8_t *baudcon;
+    volatile uint8_t *spbrg;
+    volatile uint8_t *spbrgh;
+    volatile uint8_t *t0con;
+    volatile uint8_t *t1con;
+    volatile uint8_t *pir2;
+    volatile uint8_t *pie2;
+    volatile uint8_t *eecon1;
+};
+
+// Register bits
+#define SIMCORE_INTCON_GIE 0x80
+#define SIMCORE_INTCON_PEIE 0x40
+#define SIMCORE_INTCON_T0IE 0x20
+#define SIMCORE_INTCON_T0IF 0x04
+
+// Current time, in instruction cycles
+extern uint64_t simcore_cycles;
+
+// Cycle of the next peripheral event (simcore_step() needs to be called)
+extern uint64_t simcore_next_event;
+
+// Conversions between UTC time and instruction cycles
+long double simcore_cycles_to_time(uint64_t c);
+uint64_t simcore_time_to_cycles(long double t);
+
+// Reset the peripherals. The registers should already have their reset
+// values.
+void simcore_init(const struct simcore_regs *regs, long double start_time);
+
+// Update the registers that reflect the peripheral state, and the peripheral
+// state after register writes by the firmware.
+void simcore_sync(void);
+
+// Process the next event before the limit (included). Return false if there
+// is no event before the limit, after advancing the time to the limit.
+bool simcore_step(uint64_t limit);
+
+// Return true if an enabled interrupt flag is set (ignoring GIE)
+bool simcore_int_pending(void);
+
+// Register accesses with side effects
+uint8_t simcore_uart_read(void);
+void simcore_uart_write(uint8_t val);
+uint16_t simcore_timer0_read(void);
+void simcore_timer0_write(uint16_t val);
+void simcore_timer0_add(uint16_t val, uint32_t lost_cycles);
+uint16_t simcore_timer1_read(void);
+
+// Start writing a byte to the data EEPROM (after the EECON2 unlock sequence,
+// which the simulators check). EECON1.WR is set until the write is done, then
+// PIR2.EEIF is set.
+void simcore_eeprom_write(uint8_t addr, uint8_t val);
+
+// Report a simulator error and abort
+__attribute__((noreturn)) void simcore_fatal(const char *msg);
+
+#endif
@@ -0,0 +1,159 @@
+// Firmware symbol lookup, for the tools running the firmware image on the
+// PIC18 instruction set simulator.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbols.h"
+
+#define MAX_NAME 64
+
+// Symbol file contents
+static uint8_t *symbols;
+static size_t symbols_size;
+
+
+static bool read_file(const char *path, uint8_t **data, size_t *size)
+{
+    FILE *file = fopen(path, "rb");
+    long length;
+
+    if (!file) {
+        return false;
+    }
+
+    if (fseek(file, 0, SEEK_END) != 0 || (length = ftell(file)) < 0 ||
+            fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return false;
+    }
+
+    *size = (size_t)length;
+    *data = malloc(*size + 1);
+    if (!*data || fread(*data, 1, *size, file) != *size) {
+        fclose(file);
+        return false;
+    }
+    (*data)[*size] = '\0';
+
+    fclose(file);
+    return true;
+}
+
+
+static uint32_t get_u16(const uint8_t *data)
+{
+    return (uint32_t)(data[0] | data[1] << 8);
+}
+
+
+static uint32_t get_u32(const uint8_t *data)
+{
+    return get_u16(data) | get_u16(data + 2) << 16;
+}
+
+
+// Find a symbol in an ELF32 (little endian) file. Returns false if not found.
+static bool find_elf_symbol(const char *name, uint32_t *addr)
+{
+    uint32_t shoff, shentsize, shnum;
+
+    if (symbols_size < 52) {
+        return false;
+    }
+
+    shoff = get_u32(symbols + 32);
+    shentsize = get_u16(symbols + 46);
+    shnum = get_u16(symbols + 48);
+
+    for (uint32_t i = 0 ; i < shnum ; i += 1) {
+        const uint8_t *sh = symbols + shoff + i * shentsize;
+        const uint8_t *strtab_sh;
+        uint32_t offset, size, strtab_offset, strtab_size;
+
+        if ((size_t)(sh - symbols) + 40 > symbols_size ||
+                get_u32(sh + 4) != 2) { // SHT_SYMTAB
+            continue;
+        }
+
+        offset = get_u32(sh + 16);
+        size = get_u32(sh + 20);
+        strtab_sh = symbols + shoff + get_u32(sh + 24) * shentsize;
+        if ((size_t)(strtab_sh - symbols) + 40 > symbols_size) {
+            continue;
+        }
+        strtab_offset = get_u32(strtab_sh + 16);
+        strtab_size = get_u32(strtab_sh + 20);
+
+        if ((size_t)offset + size > symbols_size ||
+                (size_t)strtab_offset + strtab_size > symbols_size) {
+            continue;
+        }
+
+        for (uint32_t sym = offset ; sym + 16 <= offset + size ; sym += 16) {
+            uint32_t name_offset = get_u32(symbols + sym);
+            const char *sym_name;
+
+            if (name_offset >= strtab_size ||
+                    get_u16(symbols + sym + 14) == 0) {
+                continue;
+            }
+
+            sym_name = (const char *)symbols + strtab_offset + name_offset;
+            if (strcmp(sym_name, name) == 0 ||
+                    (sym_name[0] == '_' && strcmp(sym_name + 1, name) == 0)) {
+                *addr = get_u32(symbols + sym + 4);
+                return true;
+            }
+        }
+    }
+
+    return false;
+}
+
+
+// Find a symbol in a text symbol file
+static bool find_text_symbol(const char *name, uint32_t *addr)
+{
+    const char *line = (const char *)symbols;
+
+    while (line && *line) {
+        char sym_name[MAX_NAME];
+        unsigned long val;
+
+        if (sscanf(line, "%63s %lx", sym_name, &val) == 2 &&
+                (strcmp(sym_name, name) == 0 || (sym_name[0] == '_' &&
+                strcmp(sym_name + 1, name) == 0))) {
+            *addr = (uint32_t)val;
+            return true;
+        }
+
+        line = strchr(line, '\n');
+        if (line) {
+            line += 1;
+        }
+    }
+
+    return false;
+}
+
+
+bool symbols_find(const char *name, uint32_t *addr)
+{
+    if (symbols_size >= 4 && memcmp(symbols, "\x7f" "ELF", 4) == 0) {
+        return find_elf_symbol(name, addr);
+    }
+
+    return find_text_symbol(name, addr);
+}
+
+
+bool symbols_load(const char *path)
+{
+    free(symbols);
+    symbols = NULL;
+    symbols_size = 0;
+
+    return read_file(path, &symbols, &symbols_size);
+}
@@ -0,0 +1,20 @@
+// Firmware symbol lookup, for the tools running the firmware image on the
+// PIC18 instruction set simulator.
+//
+// The symbols are read from the ELF file produced by XC8, or from a text file
+// with one "name address" line per function (hexadecimal byte address).
+
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Read a symbol file. Returns false if it cannot be read.
+bool symbols_load(const char *path);
+
+// Find the address of a symbol (the C names are also found with the leading
+// underscore added by the compiler). Returns false if not found.
+bool symbols_find(const char *name, uint32_t *addr);
+
+#endif
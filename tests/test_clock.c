@@ -0,0 +1,875 @@
+// Whole firmware tests, running on the PIC simulator with a virtual GPS
+// receiver. Each test runs in its own process, as the firmware state cannot be
+// reset. Built with each GPS driver (test_clock and test_clock_ubx), the
+// receiver speaking the protocol of the driver.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "gps.h"
+#include "gpssim.h"
+#include "picsim.h"
+#include "timebase.h"
+
+// Time zone matching settings.h
+#define TEST_TZ "CET-1CEST,M3.5.0,M10.5.0/3"
+
+static int exit_status = 0;
+
+// Number of status LED and display changes
+static unsigned led_changes;
+static bool last_led;
+static unsigned display_changes;
+
+
+static void display_changed(void)
+{
+    display_changes += 1;
+
+    if (sim_display.status_led != last_led) {
+        last_led = sim_display.status_led;
+        led_changes += 1;
+    }
+}
+
+
+static void start(long double start_time, long double fix_time)
+{
+    sim_init(start_time);
+    gpssim_ubx = (GPS_DRIVER == GPS_DRIVER_UBX);
+    gpssim_init();
+    gpssim_fix_time = fix_time;
+
+    led_changes = 0;
+    last_led = false;
+    display_changes = 0;
+    sim_display_changed = display_changed;
+}
+
+
+static void fail(const char *test, const char *msg)
+{
+    printf("KO %s: %s\n", test, msg);
+    exit_status = 1;
+}
+
+
+// Check that the display shows the local time corresponding to the given UTC
+// time. Between 2:00 and 3:00, check that the cathode poisoning prevention
+// sequence is displayed instead.
+static void check_display(const char *test, time_t utc)
+{
+    struct tm tm;
+    int8_t expected[6];
+    bool ok = true;
+
+    localtime_r(&utc, &tm);
+
+    expected[0] = (int8_t)(tm.tm_hour / 10);
+    expected[1] = (int8_t)(tm.tm_hour % 10);
+    expected[2] = (int8_t)(tm.tm_min / 10);
+    expected[3] = (int8_t)(tm.tm_min % 10);
+    expected[4] = (int8_t)(tm.tm_sec / 10);
+    expected[5] = (int8_t)(tm.tm_sec % 10);
+
+    if (tm.tm_hour == 2) {
+        // Digits 0, 2 and 4 cannot display all values
+        ok = (sim_display.digits[1] == sim_display.digits[3]) &&
+                (sim_display.digits[1] == sim_display.digits[5]);
+    } else {
+        ok = (memcmp(expected, sim_display.digits, sizeof(expected)) == 0);
+        ok = ok && (sim_display.right_sep == (tm.tm_sec & 1));
+    }
+
+    if (!ok) {
+        char msg[128];
+
+        snprintf(msg, sizeof(msg),
+                "%02d:%02d:%02d displayed %d%d:%d%d:%d%d",
+                tm.tm_hour, tm.tm_min, tm.tm_sec,
+                sim_display.digits[0], sim_display.digits[1],
+                sim_display.digits[2], sim_display.digits[3],
+                sim_display.digits[4], sim_display.digits[5]);
+        fail(test, msg);
+    }
+}
+
+
+// Run the simulation, checking the display in the middle of each second
+static void check_seconds(const char *test, time_t from, time_t to)
+{
+    for (time_t t = from ; t < to ; t += 1) {
+        sim_run_until((long double)t + 0.5L);
+        check_display(test, t);
+    }
+}
+
+
+// Check that the separators show the GPS status shortly after it changes
+// during an odd second (separators on), without waiting for the next second
+static void check_separators(const char *test)
+{
+    if ((sim_display.digits[5] & 1) == 0) {
+        fail(test, "status change during an even second");
+    }
+
+    sim_run(0.005L);
+    if (sim_display.left_sep != (gps_status == STATUS_OK) ||
+            sim_display.right_sep != gps_is_sync) {
+        fail(test, "separators not updated on a status change");
+    }
+}
+
+
+// Boot and synchronization
+static void test_sync(void)
+{
+    const char *test = "sync";
+    time_t t0 = 1623758400; // 15/6/2021 12:00:00 UTC
+
+    start(t0 - 0.3L, t0 + 20);
+
+    sim_run_until(t0 + 15);
+    if (gps_is_sync) {
+        fail(test, "synchronized before the GPS fix");
+    }
+
+    sim_run_until(t0 + 40);
+    if (!gps_is_sync || gps_status != STATUS_OK) {
+        fail(test, "not synchronized");
+    }
+
+    check_seconds(test, t0 + 40, t0 + 100);
+
+    if (sim_uart_overruns != 0) {
+        fail(test, "serial overruns");
+    }
+}
+
+
+// DST start
+static void test_dst_start(void)
+{
+    const char *test = "dst_start";
+    time_t dst_start = 1616893200; // 28/3/2021 01:00:00 UTC
+
+    start(dst_start - 300, 0);
+    check_seconds(test, dst_start - 120, dst_start + 120);
+}
+
+
+// DST end
+static void test_dst_end(void)
+{
+    const char *test = "dst_end";
+    time_t dst_end = 1635642000; // 31/10/2021 01:00:00 UTC
+
+    start(dst_end - 7200 - 300, 0);
+    check_seconds(test, dst_end - 7200 - 60, dst_end - 7200 + 60);
+    check_seconds(test, dst_end - 60, dst_end + 60);
+    check_seconds(test, dst_end + 3600 - 60, dst_end + 3600 + 60);
+}
+
+
+// GPS outage: the clock keeps running, and the status LED indicates the error
+static void test_outage(void)
+{
+    const char *test = "outage";
+    time_t t0 = 1623758400;
+
+    start(t0, 0);
+    sim_run_until(t0 + 60);
+
+    gpssim_enabled = false;
+    led_changes = 0;
+    sim_run_until(t0 + 3660);
+
+    if (gps_status != STATUS_ERR_NO_DATA) {
+        fail(test, "outage not detected");
+    }
+    if (led_changes < 1000) {
+        fail(test, "status LED not blinking");
+    }
+    check_seconds(test, t0 + 3660, t0 + 3670);
+
+    // The error status is reset after 255 clock messages
+    gpssim_enabled = true;
+    sim_run_until(t0 + 3660 + 2600);
+
+    if (gps_status != STATUS_OK) {
+        fail(test, "status not reset after the outage");
+    }
+    check_seconds(test, t0 + 3660 + 2600, t0 + 3660 + 2610);
+}
+
+
+// The initialization does not block: the startup animation runs and the core
+// sleeps while the receiver does not answer, and the receiver is initialized
+// once it does
+static void test_init(void)
+{
+    const char *test = "init";
+    time_t t0 = 1623758400;
+
+    start(t0, 0);
+    gpssim_enabled = false;
+    sim_run_until(t0 + 30);
+
+    if (display_changes < 20) {
+        fail(test, "no startup animation");
+    }
+    if (sim_spin_cycles > 0) {
+        fail(test, "busy-waiting");
+    }
+
+    gpssim_enabled = true;
+    sim_run_until(t0 + 60);
+
+    if (!gps_is_sync || gps_status != STATUS_OK) {
+        fail(test, "not synchronized");
+    }
+    check_seconds(test, t0 + 60, t0 + 70);
+}
+
+
+// The serial port is switched to the high baud rate accepted by the receiver
+static void test_baud_rate(void)
+{
+    const char *test = "baud_rate";
+    time_t t0 = 1623758400;
+
+    start(t0, 0);
+    sim_run_until(t0 + 60);
+
+    if (gps_baud_rate != GPS_HIGH_BAUD_RATE ||
+            sim_peer_baud != GPS_HIGH_BAUD_RATE) {
+        fail(test, "high rate not used");
+    }
+    check_seconds(test, t0 + 60, t0 + 70);
+}
+
+
+// The serial port falls back to the low baud rate if the receiver does not
+// answer at the high rate
+static void test_baud_fallback(void)
+{
+    const char *test = "baud_fallback";
+    time_t t0 = 1623758400;
+
+    start(t0, 0);
+    gpssim_max_baud = GPS_LOW_BAUD_RATE;
+    sim_run_until(t0 + 60);
+
+    if (gps_baud_rate != GPS_LOW_BAUD_RATE ||
+            sim_peer_baud != GPS_LOW_BAUD_RATE) {
+        fail(test, "low rate not used");
+    }
+    if (!gps_is_sync || gps_status != STATUS_OK) {
+        fail(test, "not synchronized");
+    }
+    check_seconds(test, t0 + 60, t0 + 70);
+}
+
+
+// Debug messages sent by the receiver are ignored
+static void test_debug_msgs(void)
+{
+    const char *test = "debug_msgs";
+    time_t t0 = 1623758400;
+
+    start(t0, 0);
+    gpssim_debug_msgs = true;
+    sim_run_until(t0 + 600);
+
+    if (gps_status != STATUS_OK) {
+        fail(test, "error status");
+    }
+    check_seconds(test, t0 + 600, t0 + 610);
+}
+
+
+// A recorded message stream is decoded
+static void test_capture(void)
+{
+    const char *test = "capture";
+    time_t t0 = 1623758400;
+
+#if GPS_DRIVER == GPS_DRIVER_UBX
+    // NAV-TIMEUTC of 15/6/2021 12:10:00 UTC (built from the protocol
+    // specification)
+    static const uint8_t capture[] = {
+        0xb5, 0x62, 0x01, 0x21, 0x14, 0x00, 0x10, 0x54, 0xe9, 0x0c, 0x19,
+        0x00, 0x00, 0x00, 0x6a, 0xff, 0xff, 0xff, 0xe5, 0x07, 0x06, 0x0f,
+        0x0c, 0x0a, 0x00, 0x07, 0x2d, 0xf8,
+    };
+#else
+    // Message 7 captured at 15/6/2021 12:10:00 UTC
+    static const uint8_t capture[] = {
+        0xa0, 0xa2, 0x00, 0x14, 0x07, 0x08, 0x72, 0x01, 0x4a, 0x88, 0x68,
+        0x08, 0x00, 0x01, 0x77, 0xfa, 0x00, 0x01, 0xe2, 0x40, 0x0c, 0xe9,
+        0x54, 0x10, 0x05, 0xb2, 0xb0, 0xb3,
+    };
+#endif
+
+    start(t0, 0);
+    sim_run_until(t0 + 300.2L);
+
+    gpssim_enabled = false;
+    gpssim_send_raw(capture, sizeof(capture));
+
+    // Received at 300.207 s (38400 baud)
+    sim_run_until(t0 + 302.7L);
+    check_display(test, t0 + 602);
+}
+
+
+// Several days of operation, across a year change, with an oscillator
+// frequency error
+static void test_long_run(void)
+{
+    const char *test = "long_run";
+    time_t t0 = 1640865600; // 30/12/2021 12:00:00 UTC
+
+    start(t0, 0);
+    sim_set_osc_freq(OSC_FREQ * (1 + 50e-6));
+
+    for (time_t t = t0 + 60 ; t < t0 + 3 * 86400 ; t += 599) {
+        sim_run_until((long double)t + 0.5L);
+        check_display(test, t);
+    }
+
+    if (gps_status != STATUS_OK) {
+        fail(test, "error status");
+    }
+}
+
+
+// In steady state, the core wakes up about once per second (when the second
+// changes, plus the serial interrupts of the GPS messages), and the display
+// stays exact
+static void test_wakeups(void)
+{
+    const char *test = "wakeups";
+    time_t t0 = 1623758400;
+    uint64_t wakeups;
+    uint32_t msg7_count;
+    double rate;
+
+    start(t0, 0);
+    sim_run_until(t0 + 600);
+    wakeups = sim_wakeups;
+    msg7_count = gpssim_msg7_count;
+
+    for (time_t t = t0 + 600 ; t < t0 + 1200 ; t += 59) {
+        sim_run_until((long double)t + 0.5L);
+        check_display(test, t);
+    }
+    sim_run_until(t0 + 1200);
+
+    rate = (double)(sim_wakeups - wakeups) / 600;
+    printf("  %s: %.2f per second, %u clock messages\n", test, rate,
+            (unsigned)(gpssim_msg7_count - msg7_count));
+    if (rate > 1.5) {
+        fail(test, "too many wakeups");
+    }
+}
+
+
+// Between 2:00 and 3:00, the cathode poisoning prevention sequence shows each
+// digit in turn, one per second, and the core still wakes up about once per
+// second; the time is displayed again at 3:00
+static void test_poison(void)
+{
+    const char *test = "poison";
+    time_t t0 = 1623801600; // 16/6/2021 00:00:00 UTC, 02:00:00 local time
+    uint64_t wakeups;
+    unsigned seen = 0;
+    double rate;
+
+    start(t0 - 600, 0);
+    check_seconds(test, t0 - 60, t0);
+    wakeups = sim_wakeups;
+
+    for (time_t t = t0 ; t < t0 + 600 ; t += 1) {
+        sim_run_until((long double)t + 0.5L);
+        check_display(test, t);
+        if (sim_display.left_sep || sim_display.right_sep) {
+            fail(test, "separators on");
+        }
+        if (sim_display.digits[5] >= 0) {
+            seen |= 1U << sim_display.digits[5];
+        }
+    }
+
+    rate = (double)(sim_wakeups - wakeups) / 600;
+    printf("  %s: %.2f wakeups per second\n", test, rate);
+    if (seen != 0x3ff) {
+        fail(test, "not all digits shown");
+    }
+    if (rate > 1.5) {
+        fail(test, "too many wakeups");
+    }
+
+    sim_run_until(t0 + 3600 - 10);
+    check_seconds(test, t0 + 3600 - 10, t0 + 3600 + 60);
+}
+
+
+// The clock message interval is stretched while the clock is accurate, and set
+// back to the minimum after an error
+static void test_adaptive_rate(void)
+{
+    const char *test = "adaptive_rate";
+    time_t t0 = 1623758400;
+#if GPS_DRIVER == GPS_DRIVER_UBX
+    static const uint8_t bad_csum_msg[] = {
+        0xb5, 0x62, 0x05, 0x01, 0x02, 0x00, 0x06, 0x01, 0x00, 0x00,
+    };
+#else
+    static const uint8_t bad_csum_msg[] = {
+        0xa0, 0xa2, 0x00, 0x01, 0x0b, 0x00, 0x00, 0xb0, 0xb3,
+    };
+#endif
+    uint32_t msg7_count;
+
+    start(t0, 0);
+    sim_set_osc_freq(OSC_FREQ * (1 + 20e-6));
+    sim_run_until(t0 + 1800);
+
+    msg7_count = gpssim_msg7_count;
+    check_seconds(test, t0 + 1800, t0 + 3600);
+
+    if (gps_msg_interval != GPS_MAX_MSG_INTERVAL) {
+        fail(test, "interval not stretched");
+    }
+    if (gpssim_msg7_count - msg7_count > 1800 / GPS_MAX_MSG_INTERVAL + 1) {
+        fail(test, "too many messages");
+    }
+
+    // Received during an odd second, while the separators are on
+    gpssim_send_raw(bad_csum_msg, sizeof(bad_csum_msg));
+    while (gps_status == STATUS_OK && sim_time() < t0 + 3600) {
+        sim_run(0.001L);
+    }
+    check_separators(test);
+    sim_run_until(t0 + 3601);
+
+    if (gps_msg_interval != GPS_MIN_MSG_INTERVAL) {
+        fail(test, "interval not reset after an error");
+    }
+
+    msg7_count = gpssim_msg7_count;
+    check_seconds(test, t0 + 3601, t0 + 3700);
+    if (gpssim_msg7_count - msg7_count < 99 / GPS_MIN_MSG_INTERVAL) {
+        fail(test, "too few messages after an error");
+    }
+}
+
+
+// Error of the firmware timebase against the simulation time, in seconds
+static long double clock_error(void)
+{
+    uint16_t timer = sim_timer0_read();
+    long double phase = cur_phase;
+
+    if (INTCONbits.T0IF) {
+        // The timer counts from the end of the period not handled yet
+        phase += (long double)period_ticks * PHASE_PER_TICK +
+                PHASE_PER_RELOAD;
+    } else {
+        timer = TIMER0_SINCE_TICK(timer);
+    }
+    phase += (long double)timer * PHASE_PER_COUNT;
+
+    return (long double)cur_days * SECONDS_PER_DAY + cur_secs +
+            phase / PHASE_PER_SECOND - sim_time();
+}
+
+
+// The time is set without the latency of the messages (offset after the GPS
+// second, transmission, and processing)
+static void test_latency(void)
+{
+    const char *test = "latency";
+    time_t t0 = 1623758400;
+
+    start(t0, 0);
+    gpssim_debug_msgs = true;
+    sim_run_until(t0 + 60);
+
+    for (time_t t = t0 + 60 ; t < t0 + 600 ; t += 1) {
+        sim_run_until((long double)t + 0.5L);
+
+        if (fabsl(clock_error()) > 0.001L) { // 1 ms
+            char msg[64];
+
+            snprintf(msg, sizeof(msg), "error of %+.2f ms",
+                    (double)clock_error() * 1e3);
+            fail(test, msg);
+            return;
+        }
+    }
+}
+
+
+// Oscillator with a frequency error and a wander (e.g. temperature), in ppm
+static double osc_error_ppm(long double t, long double t0)
+{
+    return 50 + 1.5 * sin(2 * M_PI * (double)(t - t0) / 21600);
+}
+
+
+// The frequency-locked loop learns the oscillator error, and the clock holds
+// the time during a day without GPS
+static void test_holdover(void)
+{
+    const char *test = "holdover";
+    time_t t0 = 1623758400;
+    time_t outage_start = t0 + 4 * 3600;
+    time_t outage_end = outage_start + 86400;
+    long double start_error = 0;
+    long double max_drift = 0;
+
+    start(t0, 0);
+
+    for (time_t t = t0 + 60 ; t <= outage_end ; t += 60) {
+        sim_set_osc_freq(OSC_FREQ * (1 + osc_error_ppm(t, t0) * 1e-6));
+        sim_run_until(t);
+
+        if (t == outage_start) {
+            gpssim_enabled = false;
+            start_error = clock_error();
+        } else if (t > outage_start) {
+            long double drift = fabsl(clock_error() - start_error);
+            if (drift > max_drift) {
+                max_drift = drift;
+            }
+        }
+
+        if ((t - t0) % 3600 == 0) {
+            printf("  %s: %2ld h, oscillator %+.2f ppm, correction %+.2f ppm, "
+                    "error %+.1f ms\n", test, (long)(t - t0) / 3600,
+                    osc_error_ppm(t, t0),
+                    -tick_correction * 1e6 / (double)PHASE_PER_TICK,
+                    (double)clock_error() * 1e3);
+        }
+    }
+
+    // Uncorrected, the oscillator error would give 4.3 s
+    if (max_drift > 0.1L) {
+        fail(test, "drift during the outage");
+    }
+    check_seconds(test, outage_end, outage_end + 10);
+}
+
+
+// Power loss simulation: pipe to the test process, start of the simulated
+// losses, and number of EEPROM writes until the loss
+static int eeprom_pipe;
+static long double loss_start;
+static unsigned loss_writes;
+
+
+// Send the EEPROM contents to the test process, preceded by a flag telling if
+// the power was lost during a write
+static void send_eeprom(bool power_lost)
+{
+    uint8_t flag = power_lost;
+
+    if (write(eeprom_pipe, &flag, 1) != 1 ||
+            write(eeprom_pipe, sim_eeprom, SIM_EEPROM_SIZE) !=
+            SIM_EEPROM_SIZE) {
+        exit(1);
+    }
+}
+
+
+// Lose the power while the byte being written has neither its old nor its new
+// value
+static void eeprom_write_started(uint8_t addr)
+{
+    if (sim_time() < loss_start || --loss_writes != 0) {
+        return;
+    }
+
+    sim_eeprom[addr] = (uint8_t)~sim_eeprom[addr];
+    send_eeprom(true);
+    exit(exit_status);
+}
+
+
+// Run the firmware from its first start (in another process, as its state
+// cannot be reset) until the given time, and get the EEPROM contents. If
+// writes is not 0, the power is lost at the start of this EEPROM write after
+// the given time, if it happens before the stop time (*power_lost is set).
+static bool run_first_start(long double start_time, long double fix_time,
+    long double stop_time, long double write_loss_start, unsigned writes,
+    uint8_t *eeprom, bool *power_lost)
+{
+    int fds[2];
+    pid_t pid;
+    uint8_t buf[1 + SIM_EEPROM_SIZE];
+    size_t length = 0;
+    int status;
+
+    fflush(stdout);
+    if (pipe(fds) != 0 || (pid = fork()) < 0) {
+        perror("fork");
+        exit(1);
+    }
+
+    if (pid == 0) {
+        close(fds[0]);
+        eeprom_pipe = fds[1];
+        start(start_time, fix_time);
+        if (writes != 0) {
+            loss_start = write_loss_start;
+            loss_writes = writes;
+            sim_eeprom_write_started = eeprom_write_started;
+        }
+        sim_run_until(stop_time);
+        send_eeprom(false);
+        exit(exit_status);
+    }
+
+    close(fds[1]);
+    while (length < sizeof(buf)) {
+        ssize_t count = read(fds[0], buf + length, sizeof(buf) - length);
+        if (count <= 0) {
+            break;
+        }
+        length += (size_t)count;
+    }
+    close(fds[0]);
+
+    waitpid(pid, &status, 0);
+    if (length != sizeof(buf) || !WIFEXITED(status) ||
+            WEXITSTATUS(status) != 0) {
+        return false;
+    }
+
+    memcpy(eeprom, buf + 1, SIM_EEPROM_SIZE);
+    if (power_lost) {
+        *power_lost = buf[0];
+    }
+    return true;
+}
+
+
+// After a restart, the time saved at the last fix is displayed right away as
+// unsynchronized, and sent to the receiver with its position and clock drift,
+// which gets a fix sooner
+static void test_warm_start(void)
+{
+    const char *test = "warm_start";
+    time_t t0 = 1623758400;
+    time_t t1 = t0 + 40; // Restart (power cut of a few milliseconds)
+    uint8_t eeprom[SIM_EEPROM_SIZE];
+    struct tm tm;
+
+    if (!run_first_start(t0 - 0.3L, t0, t1, 0, 0, eeprom, NULL)) {
+        fail(test, "first start");
+        return;
+    }
+
+    // Without the aiding, the receiver would get a fix after 5 minutes
+    start(t1, t1 + 300);
+    memcpy(sim_eeprom, eeprom, sizeof(eeprom));
+
+    // The time of the save (about t0 + 10) is displayed
+    localtime_r(&t0, &tm);
+    for (time_t t = t1 ; t < t1 + 5 ; t += 1) {
+        sim_run_until((long double)t + 0.5L);
+
+        if (sim_display.digits[0] != tm.tm_hour / 10 ||
+                sim_display.digits[1] != tm.tm_hour % 10 ||
+                sim_display.digits[2] != tm.tm_min / 10 ||
+                sim_display.digits[3] != tm.tm_min % 10 ||
+                sim_display.digits[4] != 1) {
+            fail(test, "estimated time not displayed");
+            return;
+        }
+        if (sim_display.right_sep) {
+            fail(test, "estimated time displayed as synchronized");
+            return;
+        }
+    }
+
+    sim_run_until(t1 + 40);
+    if (!gpssim_aided) {
+        fail(test, "initialization data not sent");
+    }
+    if (!gps_is_sync || gps_status != STATUS_OK) {
+        fail(test, "not synchronized");
+    }
+    check_seconds(test, t1 + 40, t1 + 50);
+}
+
+
+#if GPS_DRIVER == GPS_DRIVER_UBX
+// After a power cut of a day, the restored time is far behind: only the
+// position is sent to the u-blox receiver, which still gets a fix sooner
+static void test_long_power_cut(void)
+{
+    const char *test = "long_power_cut";
+    time_t t0 = 1623758400;
+    time_t t1 = t0 + 40 + 86400;
+    uint8_t eeprom[SIM_EEPROM_SIZE];
+
+    if (!run_first_start(t0 - 0.3L, t0, t0 + 40, 0, 0, eeprom, NULL)) {
+        fail(test, "first start");
+        return;
+    }
+
+    start(t1, t1 + 300);
+    memcpy(sim_eeprom, eeprom, sizeof(eeprom));
+    sim_run_until(t1 + 40);
+
+    if (!gpssim_aided) {
+        fail(test, "initialization data not sent");
+    }
+    if (!gps_is_sync || gps_status != STATUS_OK) {
+        fail(test, "not synchronized");
+    }
+    check_seconds(test, t1 + 40, t1 + 50);
+}
+#endif
+
+
+// Restart the firmware (in another process) with the given EEPROM contents,
+// and check that a time between from and to is displayed right away
+static bool check_restart(const uint8_t *eeprom, time_t from, time_t to)
+{
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+
+    if (pid == 0) {
+        struct tm tm;
+        int displayed;
+        int from_secs;
+        int to_secs;
+
+        start(to + 3600, 0);
+        memcpy(sim_eeprom, eeprom, SIM_EEPROM_SIZE);
+        sim_run_until(to + 3600 + 0.5L);
+
+        // Local times of the day (the range must not include a midnight)
+        displayed = ((sim_display.digits[0] * 10 + sim_display.digits[1]) *
+                60 + sim_display.digits[2] * 10 + sim_display.digits[3]) * 60 +
+                sim_display.digits[4] * 10 + sim_display.digits[5];
+        localtime_r(&from, &tm);
+        from_secs = (tm.tm_hour * 60 + tm.tm_min) * 60 + tm.tm_sec;
+        localtime_r(&to, &tm);
+        to_secs = (tm.tm_hour * 60 + tm.tm_min) * 60 + tm.tm_sec;
+
+        exit(displayed >= from_secs && displayed <= to_secs + 1 ? 0 : 1);
+    }
+
+    waitpid(pid, &status, 0);
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+// A power loss while the clock state is saved, at any byte, loses at most
+// this save: the previous state is restored at the next start
+static void test_power_loss(void)
+{
+    const char *test = "power_loss";
+    time_t t0 = 1623758400;
+    time_t loss_start = t0 + 3 * 3600; // The journal has wrapped around
+    time_t stop = loss_start + 1800; // A save happens before
+    uint8_t eeprom[SIM_EEPROM_SIZE];
+    bool power_lost = true;
+    unsigned writes;
+
+    for (writes = 1 ; power_lost ; writes += 1) {
+        char msg[64];
+
+        if (!run_first_start(t0, 0, stop, loss_start, writes, eeprom,
+                &power_lost)) {
+            fail(test, "first start");
+            return;
+        }
+
+        // The saves happen at most about 20 minutes apart
+        if (!check_restart(eeprom, loss_start - 1200, stop)) {
+            snprintf(msg, sizeof(msg), "wrong state after a loss at write %u",
+                    writes);
+            fail(test, msg);
+            return;
+        }
+    }
+
+    printf("  %s: %u losses, at each write of a save\n", test, writes - 2);
+}
+
+
+static void run_test(const char *name, void (*test)(void))
+{
+    pid_t pid;
+    int status;
+
+    fflush(stdout);
+    pid = fork();
+
+    if (pid < 0) {
+        perror("fork");
+        exit(1);
+    }
+
+    if (pid == 0) {
+        test();
+        exit(exit_status);
+    }
+
+    waitpid(pid, &status, 0);
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        printf("OK %s\n", name);
+    } else {
+        printf("KO %s\n", name);
+        exit_status = 1;
+    }
+}
+
+
+int main(void)
+{
+    setenv("TZ", TEST_TZ, 1);
+    tzset();
+
+    run_test("sync", test_sync);
+    run_test("dst_start", test_dst_start);
+    run_test("dst_end", test_dst_end);
+    run_test("outage", test_outage);
+    run_test("init", test_init);
+    run_test("baud_rate", test_baud_rate);
+    run_test("baud_fallback", test_baud_fallback);
+    run_test("debug_msgs", test_debug_msgs);
+    run_test("capture", test_capture);
+    run_test("long_run", test_long_run);
+    run_test("latency", test_latency);
+    run_test("holdover", test_holdover);
+    run_test("adaptive_rate", test_adaptive_rate);
+    run_test("wakeups", test_wakeups);
+    run_test("poison", test_poison);
+    run_test("warm_start", test_warm_start);
+#if GPS_DRIVER == GPS_DRIVER_UBX
+    run_test("long_power_cut", test_long_power_cut);
+#endif
+    run_test("power_loss", test_power_loss);
+
+    return exit_status;
+}
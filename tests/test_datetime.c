@@ -1,14 +1,64 @@
+#include <stdbool.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "datetime.h"
 
 
+// Time zone rules of the tests
+static const struct tz_rule utc_rules[] = {
+    { 0, 0, 0, 0, TZ_NO_DST },
+};
+
+static const struct tz_rule cet_rules[] = {
+    { 0, 0, 60, 60, TZ_TRANSITION(3, 5, 6, 120), TZ_TRANSITION(10, 5, 6, 120) },
+};
+
+static const struct tz_rule est_rules[] = {
+    { 0, 0, -300, 60,
+            TZ_TRANSITION(3, 2, 6, 120), TZ_TRANSITION(11, 1, 6, 60) },
+};
+
+static const struct tz_rule aest_rules[] = {
+    { 0, 0, 600, 60,
+            TZ_TRANSITION(10, 1, 6, 120), TZ_TRANSITION(4, 1, 6, 120) },
+};
+
+static const struct tz_rule ist_rules[] = {
+    { 0, 0, 330, 0, TZ_NO_DST },
+};
+
+// DST still active at the end of the year
+static const struct tz_rule degraded_rules[] = {
+    { 0, 0, 0, 60, TZ_TRANSITION(3, 5, 6, 120), TZ_TRANSITION(12, 5, 3, 1440) },
+};
+
+// CET/CEST, then permanent CEST from 15/6/2020 (no offset change), then
+// EST/EDT from 1/7/2021 00:00 UTC, with DST from the 1st of April (fixed day)
+// to the last Sunday of October
+static const struct tz_rule changing_rules[] = {
+    { 0, 0, 60, 60, TZ_TRANSITION(3, 5, 6, 120), TZ_TRANSITION(10, 5, 6, 120) },
+    { 18428, 0, 120, 0, TZ_NO_DST },
+    { 18809, 0, -300, 60,
+        TZ_TRANSITION(4, TZ_FIXED_DAY, 1, 120), TZ_TRANSITION(10, 5, 6, 60) },
+};
+
+#define SET_RULES(rules) set_rules((rules), sizeof(rules) / sizeof((rules)[0]))
+
 static int exit_status = 0;
 
 
+static void set_rules(const struct tz_rule *rules, uint8_t count)
+{
+    tz_rules = rules;
+    tz_rule_count = count;
+    reset_local_time();
+}
+
+
 static void test_date_calc(uint16_t days, uint16_t exp_year, uint8_t exp_month, uint8_t exp_day)
 {
-    utc_offset_secs = 0;
+    SET_RULES(utc_rules);
 
     recalc_local_time(days, 0);
 
@@ -26,6 +76,88 @@ static void test_date_calc(uint16_t days, uint16_t exp_year, uint8_t exp_month,
 }
 
 
+// Former calculation of the date, with loops over the years of a 4-year cycle
+// and over the months (valid until 28/2/2100)
+static void former_date_calc(uint16_t days, uint16_t *year, uint8_t *month,
+    uint8_t *day)
+{
+    static const uint8_t month_days[2][12]  = {
+        { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 },
+        { 31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 }
+    };
+    bool is_leap;
+
+    *year = 1970 + 4 * (days / (3 * 365 + 366));
+    days = days % (3 * 365 + 366);
+
+    for (;;) {
+        uint16_t to_remove;
+
+        is_leap = ((*year % 4) == 0);
+        to_remove = is_leap ? 366 : 365;
+
+        if (days >= to_remove) {
+            *year += 1;
+            days -= to_remove;
+        } else {
+            break;
+        }
+    }
+
+    *month = 1;
+    while (days >= month_days[is_leap][*month - 1]) {
+        days -= month_days[is_leap][*month - 1];
+        *month += 1;
+    }
+
+    *day = (uint8_t)days + 1;
+}
+
+
+// Check the date of all the supported days against the former calculation
+// (until it became invalid) and against gmtime(), and its conversion back to
+// a day count
+static void test_all_dates(void)
+{
+    SET_RULES(utc_rules);
+
+    for (uint32_t days = 0 ; days <= UINT16_MAX ; days += 1) {
+        time_t time = (time_t)days * 86400 + 43200;
+        struct tm tm;
+        uint16_t year = 0;
+        uint8_t month = 0;
+        uint8_t day = 0;
+
+        reset_local_time();
+        recalc_local_time((uint16_t)days, 43200);
+        gmtime_r(&time, &tm);
+
+        if (days < 47541) { // 1/3/2100
+            former_date_calc((uint16_t)days, &year, &month, &day);
+        } else {
+            year = (uint16_t)(tm.tm_year + 1900);
+            month = (uint8_t)(tm.tm_mon + 1);
+            day = (uint8_t)tm.tm_mday;
+        }
+
+        if (local_time.year != year || local_time.month != month ||
+                local_time.day != day ||
+                local_time.year != tm.tm_year + 1900 ||
+                local_time.month != tm.tm_mon + 1 ||
+                local_time.day != tm.tm_mday ||
+                date_to_days(year, month, day) != days) {
+            printf("KO %u => %02hhu/%02hhu/%04hu (expected %02d/%02d/%04d)\n",
+                days, local_time.day, local_time.month, local_time.year,
+                tm.tm_mday, tm.tm_mon + 1, tm.tm_year + 1900);
+            exit_status = 1;
+            return;
+        }
+    }
+
+    printf("OK all dates from 01/01/1970 to 06/06/2149\n");
+}
+
+
 static void run_date_calc_tests(void)
 {
     test_date_calc(0, 1970, 1, 1);
@@ -59,6 +191,25 @@ static void run_date_calc_tests(void)
     test_date_calc(11323, 2001, 1, 1);
     test_date_calc(11323 + 59, 2001, 3, 1);
     test_date_calc(11323 + 364, 2001, 12, 31);
+
+    test_date_calc(47482, 2100, 1, 1);
+    test_date_calc(47482 + 58, 2100, 2, 28);
+    test_date_calc(47482 + 59, 2100, 3, 1);
+    test_date_calc(47482 + 364, 2100, 12, 31);
+
+    test_date_calc(47847, 2101, 1, 1);
+    test_date_calc(47847 + 59, 2101, 3, 1);
+
+    test_date_calc(UINT16_MAX, 2149, 6, 6);
+
+    test_all_dates();
+}
+
+
+// Convert a packed BCD value of the local time to binary
+static uint8_t from_bcd(uint8_t bcd)
+{
+    return (uint8_t)((bcd >> 4) * 10 + (bcd & 0x0f));
 }
 
 
@@ -74,9 +225,9 @@ static void test_dst_calc(uint32_t seconds_from_epoch, uint16_t exp_year,
     uint16_t year = local_time.year;
     uint8_t month = local_time.month;
     uint8_t day = local_time.day;
-    uint8_t hour = local_time.hour;
-    uint8_t minute = local_time.minute;
-    uint8_t second = local_time.second;
+    uint8_t hour = from_bcd(local_time.hour);
+    uint8_t minute = from_bcd(local_time.minute);
+    uint8_t second = from_bcd(local_time.second);
 
     if (year == exp_year && month == exp_month && day == exp_day &&
         hour == exp_hour && minute == exp_min && second == exp_sec) {
@@ -95,16 +246,7 @@ static void test_dst_calc(uint32_t seconds_from_epoch, uint16_t exp_year,
 static void run_dst_tests(void)
 {
     // CET/CEST transition
-    utc_offset_secs = 3600;
-    dst_start.month = 3;
-    dst_start.week = 5;
-    dst_start.day = 6;
-    dst_start.hour = 3;
-
-    dst_end.month = 10;
-    dst_end.week = 5;
-    dst_end.day = 6;
-    dst_end.hour = 3;
+    SET_RULES(cet_rules);
 
     // Start of the year
     test_dst_calc(1609455600, 2021, 1, 1, 0, 0, 0);
@@ -128,19 +270,169 @@ static void run_dst_tests(void)
     test_dst_calc(1640991599, 2021, 12, 31, 23, 59, 59);
 
     // Degraded case: DST still active at the end of the year
-    utc_offset_secs = 0;
-    dst_start.month = 3;
-    dst_start.week = 5;
-    dst_start.day = 6;
-    dst_start.hour = 3;
-
-    dst_end.month = 12;
-    dst_end.week = 5;
-    dst_end.day = 3;
-    dst_end.hour = 25;
+    SET_RULES(degraded_rules);
 
     test_dst_calc(1609455600, 2021, 1, 1, 0, 0, 0);
 
+    // AEST/AEDT transition (southern hemisphere)
+    SET_RULES(aest_rules);
+
+    // Start of the year
+    test_dst_calc(1609419600, 2021, 1, 1, 0, 0, 0);
+
+    // Just before DST ends
+    test_dst_calc(1617465599, 2021, 4, 4, 2, 59, 59);
+
+    // Just after DST ends (3:00 -> 2:00)
+    test_dst_calc(1617465600, 2021, 4, 4, 2, 0, 0);
+
+    // Just before DST starts
+    test_dst_calc(1633190399, 2021, 10, 3, 1, 59, 59);
+
+    // Just after DST starts (2:00 -> 3:00)
+    test_dst_calc(1633190400, 2021, 10, 3, 3, 0, 0);
+
+    // Last second of year
+    test_dst_calc(1640955599, 2021, 12, 31, 23, 59, 59);
+
+    // Start of the next year
+    test_dst_calc(1640955600, 2022, 1, 1, 0, 0, 0);
+
+    // Rule changes
+    SET_RULES(changing_rules);
+
+    // Last second of permanent CEST
+    test_dst_calc(1625097599, 2021, 7, 1, 1, 59, 59);
+
+    // EDT from the rule change (and back to the previous day)
+    test_dst_calc(1625097600, 2021, 6, 30, 20, 0, 0);
+
+    // Just before DST starts on the 1st of April
+    test_dst_calc(1648796399, 2022, 4, 1, 1, 59, 59);
+
+    // Just after DST starts (2:00 -> 3:00)
+    test_dst_calc(1648796400, 2022, 4, 1, 3, 0, 0);
+
+    // Back to the first rule
+    test_dst_calc(1616893200, 2021, 3, 28, 3, 0, 0);
+}
+
+
+// Hash the local time into the given value (FNV-1a)
+static uint32_t hash_local_time(uint32_t hash)
+{
+    const uint8_t values[] = {
+        (uint8_t)local_time.year, (uint8_t)(local_time.year >> 8),
+        local_time.month, local_time.day,
+        local_time.hour, local_time.minute, local_time.second,
+    };
+
+    for (size_t i = 0 ; i < sizeof(values) ; i += 1) {
+        hash = (hash ^ values[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+
+// Simulate the clock running from first_day for day_count days, the timestamp
+// being incremented by 1 to 255 seconds at each step (the seconds elapsed
+// between two passes of the main loop), in turn. Each day, the calculated
+// local times are hashed in day_hashes.
+static void run_clock(bool incremental, uint16_t first_day, uint16_t day_count,
+    uint32_t *day_hashes)
+{
+    uint16_t days = first_day;
+    uint32_t secs = 0;
+    uint8_t step = 1;
+
+    recalc_local_time(days, secs);
+
+    for (uint16_t day_idx = 0 ; day_idx < day_count ; day_idx += 1) {
+        uint32_t hash = 2166136261U;
+
+        while (days == first_day + day_idx) {
+            hash = hash_local_time(hash);
+
+            secs += step;
+            if (secs >= 86400) {
+                secs -= 86400;
+                days += 1;
+            }
+
+            if (incremental) {
+                advance_local_time(step);
+            } else {
+                recalc_local_time(days, secs);
+            }
+
+            step = (uint8_t)((step % UINT8_MAX) + 1);
+        }
+
+        day_hashes[day_idx] = hash;
+    }
+}
+
+
+// Check that the incremental update and the full recalculation give the same
+// local times over several years
+static void test_incremental(const char *desc, uint16_t first_day,
+    uint16_t day_count)
+{
+    static uint32_t full_hashes[4000];
+    static uint32_t incr_hashes[4000];
+
+    run_clock(false, first_day, day_count, full_hashes);
+    run_clock(true, first_day, day_count, incr_hashes);
+
+    for (uint16_t day_idx = 0 ; day_idx < day_count ; day_idx += 1) {
+        if (full_hashes[day_idx] != incr_hashes[day_idx]) {
+            uint16_t days = (uint16_t)(first_day + day_idx);
+
+            recalc_local_time(days, 0);
+            printf("KO %s: incremental time differs on day %hu "
+                "(%02hhu/%02hhu/%04hu)\n", desc, days,
+                local_time.day, local_time.month, local_time.year);
+            exit_status = 1;
+            return;
+        }
+    }
+
+    printf("OK %s: incremental time matches over %hu days\n", desc,
+        day_count);
+}
+
+
+static void run_incremental_tests(void)
+{
+    // CET/CEST, 2019 to 2022
+    SET_RULES(cet_rules);
+
+    test_incremental("CET/CEST", 17897, 1461);
+
+    // EST/EDT (second Sunday of March - first Sunday of November)
+    SET_RULES(est_rules);
+
+    test_incremental("EST/EDT", 17897, 1461);
+
+    // AEST/AEDT (first Sunday of October - first Sunday of April)
+    SET_RULES(aest_rules);
+
+    test_incremental("AEST/AEDT", 17897, 1461);
+
+    // IST, no DST, offset not a whole number of hours
+    SET_RULES(ist_rules);
+
+    test_incremental("IST", 17897, 731);
+
+    // Degraded case: DST still active at the end of the year
+    SET_RULES(degraded_rules);
+
+    test_incremental("Degraded DST", 17897, 731);
+
+    // Rule changes
+    SET_RULES(changing_rules);
+    test_incremental("Rule changes", 17897, 1461);
 }
 
 
@@ -148,6 +440,7 @@ int main(void)
 {
     run_date_calc_tests();
     run_dst_tests();
+    run_incremental_tests();
 
     return exit_status;
 }
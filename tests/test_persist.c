@@ -0,0 +1,203 @@
+// Test of the EEPROM journal of the clock state (persist.c) on the PIC
+// simulator: a power loss at any write of a save must leave the previous state
+// restored at the next start, never a record mixing old and new bytes.
+//
+// The journal is filled with a state, then a state differing in all its bytes
+// is saved, so that every byte of the record is rewritten, and the power is
+// cut at each write in turn (the byte being written gets the complement of its
+// new value). Many pseudo-random states are tried: a torn record only checked
+// by its CRC would be accepted now and then.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "persist.h"
+#include "picsim.h"
+#include "sim.h"
+
+#define ROUNDS 64
+
+// Saves filling the journal before the interrupted save (more than the slots)
+#define FILL_SAVES 12
+
+
+static int exit_status = 0;
+
+// Write at which the power is lost (1 for the first write of the save), and
+// EEPROM contents after the loss
+static unsigned loss_write;
+static unsigned write_count;
+static bool power_lost;
+static uint8_t lost_eeprom[SIM_EEPROM_SIZE];
+
+
+// The firmware only handles the EEPROM interrupt
+void firmware_main(void)
+{
+    INTCONbits.PEIE = 1;
+    INTCONbits.GIEH = 1;
+    for (;;) {
+        Sleep();
+    }
+}
+
+
+void handle_int(void)
+{
+    if (PIE2bits.EEIE && PIR2bits.EEIF) {
+        persist_handle_int();
+    }
+}
+
+
+static uint32_t next_rand(uint32_t *state)
+{
+    *state = *state * 1103515245 + 12345;
+    return *state >> 16;
+}
+
+
+// Keep the EEPROM contents when the power is lost, and let the save finish
+static void eeprom_write_started(uint8_t addr)
+{
+    write_count += 1;
+    if (write_count != loss_write) {
+        return;
+    }
+
+    memcpy(lost_eeprom, sim_eeprom, SIM_EEPROM_SIZE);
+    lost_eeprom[addr] = (uint8_t)~lost_eeprom[addr];
+    power_lost = true;
+}
+
+
+// Save a state and wait until it is written. Returns false on error.
+static bool save(const struct persist_state *state)
+{
+    if (!persist_save(state)) {
+        return false;
+    }
+
+    while (persist_busy()) {
+        sim_run(0.01L);
+    }
+
+    // End of the last write
+    sim_run(0.01L);
+
+    return true;
+}
+
+
+// Check that the EEPROM contents restore the expected state
+static bool check_load(const uint8_t *eeprom, const struct persist_state *exp,
+    unsigned round, const char *when)
+{
+    struct persist_state state;
+
+    memcpy(sim_eeprom, eeprom, SIM_EEPROM_SIZE);
+    if (!persist_load(&state) || memcmp(&state, exp, sizeof(state)) != 0) {
+        printf("KO round %u: wrong state restored %s\n", round, when);
+        exit_status = 1;
+        return false;
+    }
+
+    return true;
+}
+
+
+// Cut the power at each write of a save overwriting every byte of a record.
+// Returns the number of writes of the save, or 0 on error.
+static unsigned test_round(unsigned round, uint32_t *rand_state)
+{
+    struct persist_state old_state;
+    struct persist_state new_state;
+    uint8_t *old_bytes = (uint8_t *)&old_state;
+    uint8_t *new_bytes = (uint8_t *)&new_state;
+    uint8_t eeprom[SIM_EEPROM_SIZE];
+    char when[32];
+
+    for (size_t i = 0 ; i < sizeof(old_state) ; i += 1) {
+        uint8_t diff = (uint8_t)(next_rand(rand_state) % 255 + 1);
+
+        old_bytes[i] = (uint8_t)next_rand(rand_state);
+        new_bytes[i] = old_bytes[i] ^ diff;
+    }
+
+    // Empty journal
+    memset(sim_eeprom, 0xff, SIM_EEPROM_SIZE);
+    if (persist_load(&new_state)) {
+        printf("KO round %u: state restored from an erased EEPROM\n", round);
+        exit_status = 1;
+        return 0;
+    }
+
+    for (unsigned i = 0 ; i < FILL_SAVES ; i += 1) {
+        if (!save(&old_state)) {
+            printf("KO round %u: save not started\n", round);
+            exit_status = 1;
+            return 0;
+        }
+    }
+    memcpy(eeprom, sim_eeprom, SIM_EEPROM_SIZE);
+
+    for (loss_write = 1 ; ; loss_write += 1) {
+        if (!check_load(eeprom, &old_state, round, "before the save")) {
+            return 0;
+        }
+
+        write_count = 0;
+        power_lost = false;
+        sim_eeprom_write_started = eeprom_write_started;
+        save(&new_state);
+        sim_eeprom_write_started = NULL;
+
+        if (!power_lost) {
+            break;
+        }
+
+        snprintf(when, sizeof(when), "after a loss at write %u", loss_write);
+        if (!check_load(lost_eeprom, &old_state, round, when)) {
+            return 0;
+        }
+    }
+
+    if (!check_load(sim_eeprom, &new_state, round, "after the save")) {
+        return 0;
+    }
+
+    return write_count;
+}
+
+
+int main(void)
+{
+    uint32_t rand_state = 1;
+    unsigned min_writes = 0;
+    unsigned writes;
+
+    sim_init(0);
+    sim_run(0.001L);
+
+    for (unsigned round = 0 ; round < ROUNDS ; round += 1) {
+        writes = test_round(round, &rand_state);
+        if (writes == 0) {
+            return exit_status;
+        }
+        if (min_writes == 0 || writes < min_writes) {
+            min_writes = writes;
+        }
+    }
+
+    // The record (sequence number, state and CRC), and the invalidation of the
+    // CRC
+    if (min_writes != sizeof(struct persist_state) + 3) {
+        printf("KO only %u writes in a save\n", min_writes);
+        return 1;
+    }
+
+    printf("OK power loss at each of the %u writes of a save, %d states\n",
+        min_writes, ROUNDS);
+    return exit_status;
+}
@@ -0,0 +1,357 @@
+// Tests of the PIC18 instruction set simulator: results and cycle counts of
+// hand-assembled programs.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "pic18iss.h"
+
+// 1/1/2021 00:00:00 UTC
+#define START_TIME 1609459200
+
+// Address of the function under test, called by the main program, and of
+// the data table
+#define FUNCTION_ADDR 0x100
+#define TABLE_ADDR 0x200
+
+// Data memory addresses used by the programs
+#define R_STATUS 0xfd8
+#define R_WREG 0xfe8
+#define R_PRODL 0xff3
+#define R_PRODH 0xff4
+
+#define S_C 0x01
+#define S_Z 0x04
+#define S_N 0x10
+
+#define COUNT(array) (sizeof(array) / sizeof(*(array)))
+
+
+static int exit_status = 0;
+
+
+// Run the given function, called once by the main program, after sim_init().
+// Returns its profile.
+static struct iss_profile *run_function(const char *name,
+    const uint16_t *words, size_t count)
+{
+    static const uint16_t main_words[] = {
+        0x8ed3,         // BSF OSCCON, IDLEN
+        0xec80, 0xf000, // CALL FUNCTION_ADDR
+        0x0003,         // SLEEP
+        0xd7fe,         // BRA $-2
+    };
+    static const uint16_t table[] = {0x3412};
+    struct iss_profile *profile;
+
+    iss_load_words(0, main_words, COUNT(main_words));
+    iss_load_words(FUNCTION_ADDR, words, count);
+    iss_load_words(TABLE_ADDR, table, COUNT(table));
+    profile = iss_profile_function(name, FUNCTION_ADDR);
+
+    sim_run(0.001L);
+
+    return profile;
+}
+
+
+static bool check_profile(const struct iss_profile *profile, uint32_t calls,
+    uint64_t cycles)
+{
+    if (!profile || profile->calls != calls || profile->min_cycles != cycles ||
+        profile->max_cycles != cycles) {
+        printf("KO %s: %" PRIu32 " calls, %" PRIu64 " to %" PRIu64 " cycles "
+            "(expected %" PRIu32 " calls, %" PRIu64 " cycles)\n",
+            profile ? profile->name : "?", profile ? profile->calls : 0,
+            profile ? profile->min_cycles : 0,
+            profile ? profile->max_cycles : 0, calls, cycles);
+        exit_status = 1;
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool check_ram(const char *name, uint16_t addr, uint8_t exp_val)
+{
+    if (iss_ram[addr] != exp_val) {
+        printf("KO %s: 0x%03hx = 0x%02hhx (expected 0x%02hhx)\n", name, addr,
+            iss_ram[addr], exp_val);
+        exit_status = 1;
+        return false;
+    }
+
+    return true;
+}
+
+
+// Loop with DECFSZ and BRA
+static void test_loop(void)
+{
+    static const uint16_t words[] = {
+        0x0e05, // MOVLW 5
+        0x6e20, // MOVWF 0x20
+        0x2e20, // DECFSZ 0x20, f
+        0xd7fe, // BRA $-2
+        0x0012, // RETURN
+    };
+    struct iss_profile *profile;
+
+    sim_init(START_TIME);
+    profile = run_function("loop", words, COUNT(words));
+
+    // 2 + 4 * (1 + 2) + 2 + 2
+    if (check_profile(profile, 1, 18) && check_ram("loop", 0x20, 0)) {
+        printf("OK loop\n");
+    }
+}
+
+
+// Skip of a two-word instruction
+static void test_skip(void)
+{
+    static const uint16_t words[] = {
+        0x0e01,         // MOVLW 1
+        0x6e21,         // MOVWF 0x21
+        0xa021,         // BTFSS 0x21, 0
+        0xc021, 0xf022, // MOVFF 0x21, 0x22
+        0x0012,         // RETURN
+    };
+    struct iss_profile *profile;
+
+    sim_init(START_TIME);
+    profile = run_function("skip", words, COUNT(words));
+
+    // The second word of MOVFF is executed as a NOP
+    if (check_profile(profile, 1, 7) && check_ram("skip", 0x22, 0)) {
+        printf("OK skip of a two-word instruction\n");
+    }
+}
+
+
+// Arithmetic and status flags
+static void test_arithmetic(void)
+{
+    static const uint16_t words[] = {
+        0x0e38, // MOVLW 0x38
+        0x0f29, // ADDLW 0x29
+        0x0007, // DAW
+        0x6e23, // MOVWF 0x23
+        0x0ec8, // MOVLW 200
+        0x0d64, // MULLW 100
+        0x0e05, // MOVLW 5
+        0x0803, // SUBLW 3
+        0x0012, // RETURN
+    };
+    struct iss_profile *profile;
+
+    sim_init(START_TIME);
+    profile = run_function("arithmetic", words, COUNT(words));
+
+    if (!check_profile(profile, 1, 10) ||
+        !check_ram("decimal adjust", 0x23, 0x67) ||
+        !check_ram("multiplication low", R_PRODL, 0x20) ||
+        !check_ram("multiplication high", R_PRODH, 0x4e) ||
+        !check_ram("subtraction", R_WREG, 0xfe)) {
+        return;
+    }
+
+    if ((iss_ram[R_STATUS] & (S_C | S_Z | S_N)) != S_N) {
+        printf("KO subtraction: STATUS = 0x%02hhx\n", iss_ram[R_STATUS]);
+        exit_status = 1;
+        return;
+    }
+
+    printf("OK arithmetic\n");
+}
+
+
+// Indirect addressing and table reads
+static void test_memory(void)
+{
+    static const uint16_t words[] = {
+        0xee00, 0xf030, // LFSR 0, 0x030
+        0x0eaa,         // MOVLW 0xaa
+        0x6eee,         // MOVWF POSTINC0
+        0x6eee,         // MOVWF POSTINC0
+        0xcfe9, 0xf024, // MOVFF FSR0L, 0x24
+        0x0e02,         // MOVLW HIGH(TABLE_ADDR)
+        0x6ef7,         // MOVWF TBLPTRH
+        0x6af6,         // CLRF TBLPTRL
+        0x6af8,         // CLRF TBLPTRU
+        0x0009,         // TBLRD*+
+        0xcff5, 0xf025, // MOVFF TABLAT, 0x25
+        0x0009,         // TBLRD*+
+        0xcff5, 0xf026, // MOVFF TABLAT, 0x26
+        0x0012,         // RETURN
+    };
+    struct iss_profile *profile;
+
+    sim_init(START_TIME);
+    profile = run_function("memory", words, COUNT(words));
+
+    if (check_profile(profile, 1, 21) &&
+        check_ram("indirect write", 0x30, 0xaa) &&
+        check_ram("indirect write", 0x31, 0xaa) &&
+        check_ram("post-increment", 0x24, 0x32) &&
+        check_ram("table read", 0x25, 0x12) &&
+        check_ram("table read", 0x26, 0x34)) {
+        printf("OK indirect addressing and table reads\n");
+    }
+}
+
+
+// Nested calls: the caller includes the callee
+static void test_calls(void)
+{
+    static const uint16_t words[] = {
+        0xd81f, // RCALL FUNCTION_ADDR + 0x40
+        0x0012, // RETURN
+    };
+    static const uint16_t callee_words[] = {
+        0x0000, // NOP
+        0x0012, // RETURN
+    };
+    struct iss_profile *callee;
+    struct iss_profile *profile;
+
+    sim_init(START_TIME);
+    iss_load_words(FUNCTION_ADDR + 0x40, callee_words, COUNT(callee_words));
+    callee = iss_profile_function("callee", FUNCTION_ADDR + 0x40);
+    profile = run_function("caller", words, COUNT(words));
+
+    if (check_profile(callee, 1, 3) && check_profile(profile, 1, 7)) {
+        printf("OK nested calls\n");
+    }
+}
+
+
+// Cycle accounting: each cycle is charged once, to the innermost profiled
+// function, to the main program or to idle mode
+static void test_accounting(void)
+{
+    static const uint16_t words[] = {
+        0xd81f, // RCALL FUNCTION_ADDR + 0x40
+        0x0012, // RETURN
+    };
+    static const uint16_t callee_words[] = {
+        0x0000, // NOP
+        0x0012, // RETURN
+    };
+    struct iss_profile *callee;
+    struct iss_profile *profile;
+
+    sim_init(START_TIME);
+    iss_load_words(FUNCTION_ADDR + 0x40, callee_words, COUNT(callee_words));
+    callee = iss_profile_function("callee", FUNCTION_ADDR + 0x40);
+    profile = run_function("caller", words, COUNT(words));
+
+    // Main program: BSF, CALL and SLEEP
+    if (!profile || profile->self_cycles != 4 || callee->self_cycles != 3 ||
+        iss_other_cycles != 4 || iss_idle_cycles + 11 != sim_cycles()) {
+        printf("KO accounting: %" PRIu64 " caller, %" PRIu64 " callee, %"
+            PRIu64 " other, %" PRIu64 " idle cycles out of %" PRIu64 "\n",
+            profile ? profile->self_cycles : 0, callee->self_cycles,
+            iss_other_cycles, iss_idle_cycles, sim_cycles());
+        exit_status = 1;
+    } else {
+        printf("OK cycle accounting\n");
+    }
+}
+
+
+// Timer0 interrupts, waking up the core from idle mode
+static void test_interrupt(void)
+{
+    static const uint16_t words[] = {
+        0xef80, 0xf000, // GOTO FUNCTION_ADDR
+        0x0000, 0x0000, // (unused)
+        0x2a27,         // INCF 0x27, f (interrupt vector)
+        0x94f2,         // BCF INTCON, TMR0IF
+        0x0011,         // RETFIE FAST
+    };
+    static const uint16_t main_words[] = {
+        0x8ed3, // BSF OSCCON, IDLEN
+        0x0e88, // MOVLW 0x88 (Timer0 on, 16-bit, no prescaler)
+        0x6ed5, // MOVWF T0CON
+        0x0ea0, // MOVLW 0xa0 (GIE, TMR0IE)
+        0x6ef2, // MOVWF INTCON
+        0x0003, // SLEEP
+        0xd7fe, // BRA $-2
+    };
+
+    sim_init(START_TIME);
+    iss_load_words(0, words, COUNT(words));
+    iss_load_words(FUNCTION_ADDR, main_words, COUNT(main_words));
+
+    // 5530122 cycles, one interrupt every 65536 cycles
+    sim_run(1);
+
+    if (!check_profile(&iss_int_profile, 84, 7) ||
+        !check_ram("interrupt count", 0x27, 84)) {
+        return;
+    }
+
+    // The whole handler is charged to the interrupts (including the latency)
+    if (iss_int_profile.self_cycles != 84 * 7) {
+        printf("KO interrupt accounting: %" PRIu64 " cycles (expected %d)\n",
+            iss_int_profile.self_cycles, 84 * 7);
+        exit_status = 1;
+        return;
+    }
+
+    printf("OK Timer0 interrupts\n");
+}
+
+
+// Timer1 (free-running, 16-bit reads), read around a delay loop
+static void test_timer1(void)
+{
+    static const uint16_t words[] = {
+        0x0e81,         // MOVLW 0x81 (Timer1 on, 16-bit reads)
+        0x6ecd,         // MOVWF T1CON
+        0x50ce,         // MOVF TMR1L, w
+        0x6e28,         // MOVWF 0x28
+        0xcfcf, 0xf029, // MOVFF TMR1H, 0x29
+        0x0e64,         // MOVLW 100
+        0x6e20,         // MOVWF 0x20
+        0x2e20,         // DECFSZ 0x20, f
+        0xd7fe,         // BRA $-2
+        0x50ce,         // MOVF TMR1L, w
+        0x6e2a,         // MOVWF 0x2a
+        0xcfcf, 0xf02b, // MOVFF TMR1H, 0x2b
+        0x0012,         // RETURN
+    };
+    uint16_t first, second;
+
+    sim_init(START_TIME);
+    run_function("timer1", words, COUNT(words));
+
+    // 1 + 1 + 2 + 1 + 1 + 99 * (1 + 2) + 2 cycles from a read to the next
+    first = (uint16_t)(iss_ram[0x28] | iss_ram[0x29] << 8);
+    second = (uint16_t)(iss_ram[0x2a] | iss_ram[0x2b] << 8);
+    if ((uint16_t)(second - first) != 305) {
+        printf("KO timer1: %" PRIu16 " cycles between the reads (expected "
+            "305)\n", (uint16_t)(second - first));
+        exit_status = 1;
+    } else {
+        printf("OK Timer1 reads\n");
+    }
+}
+
+
+int main(void)
+{
+    test_loop();
+    test_skip();
+    test_arithmetic();
+    test_memory();
+    test_calls();
+    test_accounting();
+    test_interrupt();
+    test_timer1();
+
+    return exit_status;
+}
@@ -0,0 +1,148 @@
+// Interrupt profiler test: the firmware built with ISR_PROFILE runs on the PIC
+// simulator with the virtual GPS receiver, and the statistics dumps sent on
+// the serial line are checked.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gps.h"
+#include "gpssim.h"
+#include "picsim.h"
+
+#define SOURCE_COUNT 7
+#define HISTOGRAM_SIZE 8
+
+static const char *const source_names[SOURCE_COUNT] = {
+    "INT", "TLAT", "TICK", "RX", "TX", "EE", "CRIT",
+};
+
+static int exit_status = 0;
+
+// Serial line output, as received by the virtual receiver
+static void (*gpssim_receive)(uint8_t byte);
+static char output[4096];
+static size_t output_length;
+
+// Parsed dump: number of events of each source (histogram total), maximum,
+// and receive FIFO count
+struct dump {
+    unsigned events[SOURCE_COUNT];
+    unsigned max[SOURCE_COUNT];
+    unsigned rx_full;
+};
+
+
+static void receive_byte(uint8_t byte)
+{
+    if (output_length < sizeof(output) - 1) {
+        output[output_length] = (char)byte;
+        output_length += 1;
+        output[output_length] = '\0';
+    }
+
+    gpssim_receive(byte);
+}
+
+
+static void fail(const char *msg)
+{
+    printf("KO profile: %s\n", msg);
+    exit_status = 1;
+}
+
+
+// Toggle the switch, and parse the dump sent. Returns false if it is invalid.
+static bool dump(struct dump *result)
+{
+    const char *line;
+
+    output_length = 0;
+    output[0] = '\0';
+    PORTCbits.RC3 = !PORTCbits.RC3;
+    sim_run(3);
+
+    line = strstr(output, "PROF ");
+    for (unsigned i = 0 ; i < SOURCE_COUNT ; i += 1) {
+        char name[8];
+        unsigned min, max, histogram[HISTOGRAM_SIZE];
+
+        if (!line || sscanf(line, "PROF %7s %x %x %x %x %x %x %x %x %x %x",
+                name, &min, &max, &histogram[0], &histogram[1],
+                &histogram[2], &histogram[3], &histogram[4], &histogram[5],
+                &histogram[6], &histogram[7]) != 11 ||
+                strcmp(name, source_names[i]) != 0) {
+            return false;
+        }
+
+        result->events[i] = 0;
+        for (unsigned b = 0 ; b < HISTOGRAM_SIZE ; b += 1) {
+            result->events[i] += histogram[b];
+        }
+        result->max[i] = max;
+
+        line = strstr(line + 1, "PROF ");
+    }
+
+    return line && sscanf(line, "PROF RXFULL %x", &result->rx_full) == 1 &&
+            strstr(line, "\r\n") && !strstr(line + 1, "PROF ");
+}
+
+
+int main(void)
+{
+    struct dump first, second;
+    long double t0 = 1623758400; // 15/6/2021 12:00:00 UTC
+
+    sim_init(t0);
+    gpssim_init();
+    gpssim_receive = sim_peer_receive;
+    sim_peer_receive = receive_byte;
+
+    sim_run(60);
+    if (!gps_is_sync) {
+        fail("not synchronized");
+    }
+
+    if (!dump(&first)) {
+        fail("invalid first dump");
+    } else {
+        // A Timer0 period per second once the time is displayed (one per
+        // tick during the startup animation and the dump), and a message 7
+        // every 10 seconds. The statistics of each source are reset when its
+        // line is sent, so the counts may differ by the ticks between the
+        // lines.
+        if (first.events[2] < 60 || first.events[2] > 300 ||
+                first.events[1] + 2 < first.events[2] ||
+                first.events[1] > first.events[2] + 2) {
+            fail("tick count");
+        }
+        if (first.events[3] < 6 * 28 || first.events[4] == 0 ||
+                first.events[6] == 0) {
+            fail("receive, transmit or critical section count");
+        }
+        if (first.events[0] < first.events[2] + first.events[3]) {
+            fail("interrupt count");
+        }
+    }
+
+    // The statistics were reset by the first dump
+    sim_run(10);
+    if (!dump(&second)) {
+        fail("invalid second dump");
+    } else if (second.events[2] > 40 || second.events[2] < 10) {
+        fail("tick count after reset");
+    }
+
+    sim_run(30);
+    if (!gps_is_sync || gps_status != STATUS_OK) {
+        fail("clock disturbed by the dumps");
+    }
+
+    if (exit_status == 0) {
+        printf("OK profile\n");
+    }
+
+    return exit_status;
+}
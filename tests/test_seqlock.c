@@ -0,0 +1,244 @@
+// Stress test of the sequence lock of the timebase (timebase_snapshot()), on
+// the PIC18 instruction set simulator: a Timer0 interrupt updating the time is
+// triggered at every instruction boundary of the reader, and the time read
+// must always be consistent (all of its bytes from before the interrupt, or
+// all from after).
+//
+// The reader and the interrupt handler are hand-assembled like the code XC8
+// generates for timebase_snapshot() and the update of the time in
+// timebase_tick(). As a control, the same reader without the sequence check
+// must read a torn time at some boundaries.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "pic18iss.h"
+
+// 1/1/2021 00:00:00 UTC
+#define START_TIME 1609459200
+
+#define MAIN_ADDR 0x080
+#define READER_ADDR 0x100
+
+// Data memory addresses: time updated by the interrupt handler (sequence
+// number, days and seconds, little-endian), interrupt count, Timer0 preload,
+// and time read
+#define SEQ 0x20
+#define DAYS 0x21
+#define SECS 0x23
+#define INT_COUNT 0x27
+#define PRELOAD 0x30
+#define SNAPSHOT 0x40
+
+// Time before the interrupt: all the bytes change when it is incremented
+#define DAYS_BEFORE 0x00ff
+#define SECS_BEFORE 0xffffffffU
+
+// Longest delay of the interrupt from the start of the timer, in cycles;
+// beyond the end of the reader
+#define MAX_DELAY 100
+
+#define COUNT(array) (sizeof(array) / sizeof(*(array)))
+
+
+static int exit_status = 0;
+
+
+// Interrupt handler (a single interrupt: it disables itself) and main program
+// starting Timer0 (no prescaler) before calling the reader
+static const uint16_t program_words[] = {
+    0xef40, 0xf000, // GOTO MAIN_ADDR
+    0x0000, 0x0000, // (unused)
+    0x2a20,         // INCF SEQ, f (interrupt vector)
+    0x2a23,         // INCF SECS, f
+    0x0e00,         // MOVLW 0
+    0x2224,         // ADDWFC SECS + 1, f
+    0x2225,         // ADDWFC SECS + 2, f
+    0x2226,         // ADDWFC SECS + 3, f
+    0x2221,         // ADDWFC DAYS, f
+    0x2222,         // ADDWFC DAYS + 1, f
+    0x2a27,         // INCF INT_COUNT, f
+    0x9af2,         // BCF INTCON, TMR0IE
+    0x94f2,         // BCF INTCON, TMR0IF
+    0x0011,         // RETFIE FAST
+};
+
+static const uint16_t main_words[] = {
+    0x8ed3,         // BSF OSCCON, IDLEN
+    0x0e88,         // MOVLW 0x88 (Timer0 on, 16-bit, no prescaler)
+    0x6ed5,         // MOVWF T0CON
+    0xc030, 0xffd7, // MOVFF PRELOAD, TMR0H
+    0xc031, 0xffd6, // MOVFF PRELOAD + 1, TMR0L
+    0x8af2,         // BSF INTCON, TMR0IE
+    0x8ef2,         // BSF INTCON, GIE
+    0xec80, 0xf000, // CALL READER_ADDR
+    0x0003,         // SLEEP
+    0xd7fe,         // BRA $-2
+};
+
+// Sequence lock reader
+static const uint16_t seqlock_words[] = {
+    0xc020, 0xf040, // MOVFF SEQ, SNAPSHOT
+    0xc021, 0xf041, // MOVFF DAYS, SNAPSHOT + 1
+    0xc022, 0xf042, // MOVFF DAYS + 1, SNAPSHOT + 2
+    0xc023, 0xf043, // MOVFF SECS, SNAPSHOT + 3
+    0xc024, 0xf044, // MOVFF SECS + 1, SNAPSHOT + 4
+    0xc025, 0xf045, // MOVFF SECS + 2, SNAPSHOT + 5
+    0xc026, 0xf046, // MOVFF SECS + 3, SNAPSHOT + 6
+    0x5020,         // MOVF SEQ, w
+    0x6240,         // CPFSEQ SNAPSHOT
+    0xd7ef,         // BRA READER_ADDR
+    0x0012,         // RETURN
+};
+
+// Reader without the sequence check
+static const uint16_t plain_words[] = {
+    0xc020, 0xf040, // MOVFF SEQ, SNAPSHOT
+    0xc021, 0xf041, // MOVFF DAYS, SNAPSHOT + 1
+    0xc022, 0xf042, // MOVFF DAYS + 1, SNAPSHOT + 2
+    0xc023, 0xf043, // MOVFF SECS, SNAPSHOT + 3
+    0xc024, 0xf044, // MOVFF SECS + 1, SNAPSHOT + 4
+    0xc025, 0xf045, // MOVFF SECS + 2, SNAPSHOT + 5
+    0xc026, 0xf046, // MOVFF SECS + 3, SNAPSHOT + 6
+    0x0012,         // RETURN
+};
+
+
+static uint32_t read_u32(uint16_t addr)
+{
+    return (uint32_t)iss_ram[addr] | (uint32_t)iss_ram[addr + 1] << 8 |
+        (uint32_t)iss_ram[addr + 2] << 16 | (uint32_t)iss_ram[addr + 3] << 24;
+}
+
+
+// Run the reader with the Timer0 interrupt delayed by the given number of
+// cycles from the start of the timer (after the end of the run if 0). Returns
+// the cycles taken by the reader (without the interrupt).
+static uint64_t run_reader(struct iss_profile *profile, const uint16_t *words,
+    size_t count, unsigned delay)
+{
+    uint16_t preload = (uint16_t)(0x10000U - (delay ? delay : 0xffffU));
+
+    sim_init(START_TIME);
+    iss_load_words(0, program_words, COUNT(program_words));
+    iss_load_words(MAIN_ADDR, main_words, COUNT(main_words));
+    iss_load_words(READER_ADDR, words, count);
+
+    iss_ram[PRELOAD] = (uint8_t)(preload >> 8);
+    iss_ram[PRELOAD + 1] = (uint8_t)preload;
+    iss_ram[DAYS] = (uint8_t)DAYS_BEFORE;
+    iss_ram[DAYS + 1] = (uint8_t)(DAYS_BEFORE >> 8);
+    for (unsigned i = 0 ; i < 4 ; i += 1) {
+        iss_ram[SECS + i] = (uint8_t)(SECS_BEFORE >> (8 * i));
+    }
+
+    // About 550 cycles
+    sim_run(0.0001L);
+
+    return profile->total_cycles;
+}
+
+
+// Check that the time read is the one before or after the interrupt, and
+// matches the sequence number read. Returns false if it is torn.
+static bool snapshot_consistent(void)
+{
+    uint8_t seq = iss_ram[SNAPSHOT];
+    uint16_t days = (uint16_t)(iss_ram[SNAPSHOT + 1] |
+        iss_ram[SNAPSHOT + 2] << 8);
+    uint32_t secs = read_u32(SNAPSHOT + 3);
+
+    if (seq == 0) {
+        return days == DAYS_BEFORE && secs == SECS_BEFORE;
+    }
+
+    return seq == 1 && days == DAYS_BEFORE + 1 && secs == 0;
+}
+
+
+// Sweep the interrupt over the reader, one cycle at a time. Returns the number
+// of torn reads, or -1 on error.
+static int sweep(const char *name, const uint16_t *words, size_t count,
+    unsigned *retries)
+{
+    struct iss_profile *profile = iss_profile_function(name, READER_ADDR);
+    uint64_t base_cycles;
+    int torn = 0;
+
+    if (!profile) {
+        printf("KO %s: cannot profile the reader\n", name);
+        return -1;
+    }
+
+    // Without interrupt
+    base_cycles = run_reader(profile, words, count, 0);
+    if (iss_ram[INT_COUNT] != 0 || iss_ram[SNAPSHOT] != 0 ||
+            !snapshot_consistent()) {
+        printf("KO %s: read without interrupt\n", name);
+        return -1;
+    }
+
+    *retries = 0;
+    for (unsigned delay = 1 ; delay <= MAX_DELAY ; delay += 1) {
+        uint64_t cycles = run_reader(profile, words, count, delay);
+
+        if (iss_ram[INT_COUNT] != 1 || profile->calls != 1) {
+            printf("KO %s: interrupt after %u cycles: %hhu interrupts, %"
+                PRIu32 " reader calls\n", name, delay, iss_ram[INT_COUNT],
+                profile->calls);
+            return -1;
+        }
+
+        // The first interrupt precedes the reader, the last one follows it
+        if ((delay == 1 && iss_ram[SNAPSHOT] != 1) ||
+                (delay == MAX_DELAY && iss_ram[SNAPSHOT] != 0)) {
+            printf("KO %s: interrupt after %u cycles not outside the reader\n",
+                name, delay);
+            return -1;
+        }
+
+        if (cycles != base_cycles) {
+            *retries += 1;
+        }
+
+        if (!snapshot_consistent()) {
+            torn += 1;
+        }
+    }
+
+    return torn;
+}
+
+
+int main(void)
+{
+    unsigned retries = 0;
+    int torn;
+
+    // Errors are reported by sweep()
+    torn = sweep("seqlock", seqlock_words, COUNT(seqlock_words), &retries);
+    if (torn == 0 && retries != 0) {
+        printf("OK seqlock: no torn read over %d interrupt delays (%u "
+            "retries)\n", MAX_DELAY, retries);
+    } else {
+        if (torn >= 0) {
+            printf("KO seqlock: %d torn reads, %u retries\n", torn, retries);
+        }
+        exit_status = 1;
+    }
+
+    torn = sweep("plain", plain_words, COUNT(plain_words), &retries);
+    if (torn > 0) {
+        printf("OK plain reader: %d torn reads over %d interrupt delays\n",
+            torn, MAX_DELAY);
+    } else {
+        if (torn == 0) {
+            printf("KO plain reader: no torn read (the interrupts do not hit "
+                "the reader)\n");
+        }
+        exit_status = 1;
+    }
+
+    return exit_status;
+}
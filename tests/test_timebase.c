@@ -0,0 +1,278 @@
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "datetime.h"
+#include "timebase.h"
+
+
+static int exit_status = 0;
+
+
+// Check the conversion of a GPS time to a timestamp against the former
+// 64-bit calculation, and the conversion back
+static bool check_gps_time(uint16_t gps_week, uint32_t gps_time_of_week)
+{
+    uint64_t gps_centisecs = 31596480000 - 1800 +
+        ((uint64_t)gps_week * 60480000) + (uint64_t)gps_time_of_week;
+    uint16_t exp_days = (uint16_t)(gps_centisecs / 8640000);
+    uint32_t exp_centisecs = (uint32_t)(gps_centisecs % 8640000);
+    uint16_t days;
+    uint32_t centisecs;
+    uint16_t week;
+    uint32_t time_of_week;
+
+    gps_to_timestamp(gps_week, gps_time_of_week, &days, &centisecs);
+
+    if (days != exp_days || centisecs != exp_centisecs) {
+        printf("KO week %hu, TOW %u => %hu days, %u cs "
+            "(expected %hu days, %u cs)\n", gps_week, gps_time_of_week,
+            days, centisecs, exp_days, exp_centisecs);
+        exit_status = 1;
+        return false;
+    }
+
+    timestamp_to_gps(days, centisecs, &week, &time_of_week);
+
+    if (week != gps_week || time_of_week != gps_time_of_week) {
+        printf("KO %hu days, %u cs => week %hu, TOW %u "
+            "(expected week %hu, TOW %u)\n", days, centisecs, week,
+            time_of_week, gps_week, gps_time_of_week);
+        exit_status = 1;
+        return false;
+    }
+
+    return true;
+}
+
+
+// Check all supported GPS weeks, with times of week around the day and leap
+// second boundaries and pseudo-random times of week
+static void test_gps_weeks(void)
+{
+    static const uint32_t fixed_tows[] = {
+        0, 1, 1799, 1800, 1801, 8639999, 8640000, 8641799, 8641800,
+        34559999, 34560000, 34561799, 34561800, 60478199, 60478200, 60479999,
+    };
+    uint32_t rand_state = 1;
+    uint32_t count = 0;
+
+    for (uint16_t week = 0 ; week <= GPS_MAX_WEEK ; week += 1) {
+        for (size_t i = 0 ; i < sizeof(fixed_tows) / sizeof(*fixed_tows) ;
+            i += 1) {
+            if (!check_gps_time(week, fixed_tows[i])) {
+                return;
+            }
+            count += 1;
+        }
+
+        for (uint8_t i = 0 ; i < 64 ; i += 1) {
+            rand_state = rand_state * 1103515245U + 12345U;
+            if (!check_gps_time(week, rand_state % 60480000)) {
+                return;
+            }
+            count += 1;
+        }
+    }
+
+    printf("OK GPS time to timestamp conversions, weeks 0 to %d, %u values\n",
+        GPS_MAX_WEEK, count);
+}
+
+
+// Current timebase time, in phase units since the start of day 0
+static uint64_t timebase_phase(void)
+{
+    return ((uint64_t)cur_days * SECONDS_PER_DAY + cur_secs) *
+        PHASE_PER_SECOND + cur_phase;
+}
+
+
+// Set the timebase and run it for the given number of Timer0 periods (of 1 to
+// MAX_PERIOD_TICKS ticks in turn), checking that it stays exact
+static bool check_timebase(uint16_t days, uint32_t centisecs, uint32_t delay,
+    uint16_t timer, int8_t ticks_handled, uint32_t period_total)
+{
+    // Time of the last handled tick, in phase units
+    uint64_t exp_phase = ((uint64_t)days * CENTISECS_PER_DAY + centisecs) *
+        PHASE_PER_CENTISEC + delay - (uint64_t)timer * PHASE_PER_COUNT +
+        (uint64_t)((int64_t)ticks_handled * (int64_t)PHASE_PER_TICK);
+    uint32_t exp_elapsed = 0;
+    uint8_t start_count;
+
+    timebase_set(days, centisecs, delay, timer, ticks_handled);
+    start_count = sec_count;
+
+    for (uint32_t period = 0 ; period <= period_total ; period += 1) {
+        if (period != 0) {
+            uint64_t prev_second = exp_phase / PHASE_PER_SECOND;
+            uint8_t ticks = (uint8_t)(1 + period % MAX_PERIOD_TICKS);
+
+            exp_phase += ticks * PHASE_PER_TICK + PHASE_PER_RELOAD;
+            exp_elapsed += (uint32_t)(exp_phase / PHASE_PER_SECOND -
+                prev_second);
+
+            timebase_tick(ticks);
+        }
+
+        uint8_t elapsed = (uint8_t)(sec_count - start_count);
+
+        if (timebase_phase() != exp_phase || elapsed != exp_elapsed) {
+            printf("KO timebase set to %hu days %u cs + %u (timer %hu, %hhd "
+                "ticks handled), period %u: %hu days %u s + %u, %hhu s "
+                "elapsed (expected %" PRIu64 " phase units, %u s elapsed)\n",
+                days, centisecs, delay, timer, ticks_handled, period, cur_days,
+                cur_secs, cur_phase, elapsed, exp_phase, exp_elapsed);
+            exit_status = 1;
+            return false;
+        }
+
+        if (exp_elapsed >= 200) {
+            // Simulate the main loop handling the elapsed seconds
+            exp_elapsed = 0;
+            start_count = sec_count;
+        }
+    }
+
+    return true;
+}
+
+
+// Check that the timebase does not drift, starting from various times
+static void test_timebase(void)
+{
+    uint32_t rand_state = 1;
+
+    // A few days of periods (about 107216 periods of 8.5 ticks per day)
+    if (!check_timebase(18000, 0, 0, 0, 0, 3 * 107216)) {
+        return;
+    }
+
+    // Around day changes, with pending or handled periods, and with delays
+    if (!check_timebase(18000, CENTISECS_PER_DAY - 1, 0, 0, 0, 100) ||
+        !check_timebase(18000, 0, 0, 65535, 0, 100) ||
+        !check_timebase(18000, 0, 0, 65535, -1, 100) ||
+        !check_timebase(18000, 0, 0, 65535, -MAX_PERIOD_TICKS, 100) ||
+        !check_timebase(18000, 0, 0, 4095, MAX_PERIOD_TICKS, 100) ||
+        !check_timebase(18000, 50, 0, 0, -1, 100) ||
+        !check_timebase(18000, 0, 0, 10, 3, 100) ||
+        !check_timebase(18000, CENTISECS_PER_DAY - 1, 0, 65535, 3, 100) ||
+        !check_timebase(18000, CENTISECS_PER_DAY - 1, PHASE_PER_SECOND / 2,
+            0, 0, 100) ||
+        !check_timebase(18000, CENTISECS_PER_DAY - 60, PHASE_PER_SECOND / 2,
+            0, 0, 100)) {
+        return;
+    }
+
+    for (uint16_t i = 0 ; i < 1000 ; i += 1) {
+        uint32_t centisecs;
+        uint32_t delay;
+        uint16_t timer;
+
+        rand_state = rand_state * 1103515245U + 12345U;
+        centisecs = rand_state % CENTISECS_PER_DAY;
+        rand_state = rand_state * 1103515245U + 12345U;
+        timer = (uint16_t)(rand_state >> 8);
+
+        rand_state = rand_state * 1103515245U + 12345U;
+        delay = (rand_state >> 8) % (PHASE_PER_SECOND / 2);
+
+        if (!check_timebase(18000, centisecs, delay, timer,
+            (int8_t)((int8_t)(i % 8) - 4), 1000)) {
+            return;
+        }
+    }
+
+    printf("OK timebase is exact\n");
+}
+
+
+// Run the timebase with an oscillator frequency error, setting the time every
+// 10 seconds with a +/- 10 ms jitter, and check that the frequency-locked loop
+// learns the error
+static bool check_fll(double ppm)
+{
+    const uint16_t base_days = 18000;
+    const long double rate = 1 + ppm * 1e-6L; // Actual / nominal frequency
+    const uint32_t fix_ticks = 105; // About 10 s
+    const uint32_t tick_total = 4 * 37977; // About 4 hours
+    long double true_phase = 0; // True time of the last tick since base_days
+    int32_t exp_correction = (int32_t)lroundl(PHASE_PER_TICK / rate) -
+        (int32_t)PHASE_PER_TICK;
+    int32_t max_correction = (int32_t)(PHASE_PER_TICK / 5000); // 200 ppm
+    uint32_t rand_state = 1;
+    uint32_t fix_tick = 0;
+
+    // Periods ending after each second, as in steady state
+    for (uint32_t tick = 0 ; tick <= tick_total ; ) {
+        uint8_t ticks;
+
+        if (tick >= fix_tick) {
+            // Fix at the next centisecond, received after a delay of up to
+            // 20 ms (so that the Timer0 value is not always truncated the
+            // same way)
+            uint64_t centisecs =
+                    (uint64_t)ceill(true_phase / PHASE_PER_CENTISEC);
+            uint32_t delay;
+            long double since_tick;
+            uint16_t timer;
+
+            rand_state = rand_state * 1103515245U + 12345U;
+            delay = (rand_state >> 8) % (2 * PHASE_PER_CENTISEC);
+            since_tick = centisecs * (long double)PHASE_PER_CENTISEC + delay -
+                true_phase;
+            timer = (uint16_t)(since_tick * rate / PHASE_PER_COUNT);
+
+            rand_state = rand_state * 1103515245U + 12345U;
+            centisecs += (rand_state >> 16) % 3;
+
+            timebase_set((uint16_t)(base_days + centisecs / CENTISECS_PER_DAY),
+                (uint32_t)(centisecs % CENTISECS_PER_DAY), delay, timer, 0);
+            fix_tick += fix_ticks;
+        }
+
+        ticks = timebase_ticks_to_second();
+        true_phase += (ticks * PHASE_PER_TICK + PHASE_PER_RELOAD) / rate;
+        timebase_tick(ticks);
+        tick += ticks;
+    }
+
+    // Beyond the limit of the correction, it must stay at the limit
+    if (exp_correction > max_correction) {
+        exp_correction = max_correction;
+    } else if (exp_correction < -max_correction) {
+        exp_correction = -max_correction;
+    }
+
+    // Within 1 ppm, given the jitter
+    if (tick_correction < exp_correction - 210 ||
+        tick_correction > exp_correction + 210) {
+        printf("KO frequency-locked loop with a %+.1f ppm error: correction %d "
+            "(expected %d)\n", ppm, tick_correction, exp_correction);
+        exit_status = 1;
+        return false;
+    }
+
+    printf("OK frequency-locked loop with a %+.1f ppm error: correction %d "
+        "(expected %d)\n", ppm, tick_correction, exp_correction);
+    return true;
+}
+
+
+int main(void)
+{
+    test_gps_weeks();
+    test_timebase();
+    check_fll(50);
+    check_fll(-30.5);
+
+    // Errors beyond the limit, from no correction (the largest slope is
+    // limited as well)
+    timebase_restore(cur_days, cur_secs, 0);
+    check_fll(270);
+    timebase_restore(cur_days, cur_secs, 0);
+    check_fll(-270);
+
+    return exit_status;
+}
@@ -0,0 +1,306 @@
+// Check the compiled time zone tables (tzdata.c) against the time zone
+// database of the host, which they were generated from (tzcompile): the local
+// time calculated by the firmware must match localtime_r() every hour, and
+// around every UTC offset change, from 1970 to 2149. The comparison is skipped
+// if the host database is not the version of the tables, as the rules of some
+// zones change between versions. The UTC offset changes of a few zones from
+// 2021 to 2030, which do not depend on the version, are checked in any case.
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TZ_ALL_ZONES
+
+#include "datetime.h"
+#include "tzdata.h"
+
+#define END_TIME (65536L * 86400L)
+
+#define TZDATA_VERSION_FILE "/usr/share/zoneinfo/tzdata.zi"
+
+// UTC offset change: zone, time, and offsets before and after (minutes)
+struct fixed_change {
+    const char *zone;
+    time_t time;
+    int before;
+    int after;
+};
+
+static const struct fixed_change fixed_changes[] = {
+    { "Europe/Paris", 1616893200, 60, 120 },
+    { "Europe/Paris", 1635642000, 120, 60 },
+    { "Europe/Paris", 1648342800, 60, 120 },
+    { "Europe/Paris", 1667091600, 120, 60 },
+    { "Europe/Paris", 1679792400, 60, 120 },
+    { "Europe/Paris", 1698541200, 120, 60 },
+    { "Europe/Paris", 1711846800, 60, 120 },
+    { "Europe/Paris", 1729990800, 120, 60 },
+    { "Europe/Paris", 1743296400, 60, 120 },
+    { "Europe/Paris", 1761440400, 120, 60 },
+    { "Europe/Paris", 1774746000, 60, 120 },
+    { "Europe/Paris", 1792890000, 120, 60 },
+    { "Europe/Paris", 1806195600, 60, 120 },
+    { "Europe/Paris", 1824944400, 120, 60 },
+    { "Europe/Paris", 1837645200, 60, 120 },
+    { "Europe/Paris", 1856394000, 120, 60 },
+    { "Europe/Paris", 1869094800, 60, 120 },
+    { "Europe/Paris", 1887843600, 120, 60 },
+    { "Europe/Paris", 1901149200, 60, 120 },
+    { "Europe/Paris", 1919293200, 120, 60 },
+    { "America/New_York", 1615705200, -300, -240 },
+    { "America/New_York", 1636264800, -240, -300 },
+    { "America/New_York", 1647154800, -300, -240 },
+    { "America/New_York", 1667714400, -240, -300 },
+    { "America/New_York", 1678604400, -300, -240 },
+    { "America/New_York", 1699164000, -240, -300 },
+    { "America/New_York", 1710054000, -300, -240 },
+    { "America/New_York", 1730613600, -240, -300 },
+    { "America/New_York", 1741503600, -300, -240 },
+    { "America/New_York", 1762063200, -240, -300 },
+    { "America/New_York", 1772953200, -300, -240 },
+    { "America/New_York", 1793512800, -240, -300 },
+    { "America/New_York", 1805007600, -300, -240 },
+    { "America/New_York", 1825567200, -240, -300 },
+    { "America/New_York", 1836457200, -300, -240 },
+    { "America/New_York", 1857016800, -240, -300 },
+    { "America/New_York", 1867906800, -300, -240 },
+    { "America/New_York", 1888466400, -240, -300 },
+    { "America/New_York", 1899356400, -300, -240 },
+    { "America/New_York", 1919916000, -240, -300 },
+    { "Australia/Sydney", 1617465600, 660, 600 },
+    { "Australia/Sydney", 1633190400, 600, 660 },
+    { "Australia/Sydney", 1648915200, 660, 600 },
+    { "Australia/Sydney", 1664640000, 600, 660 },
+    { "Australia/Sydney", 1680364800, 660, 600 },
+    { "Australia/Sydney", 1696089600, 600, 660 },
+    { "Australia/Sydney", 1712419200, 660, 600 },
+    { "Australia/Sydney", 1728144000, 600, 660 },
+    { "Australia/Sydney", 1743868800, 660, 600 },
+    { "Australia/Sydney", 1759593600, 600, 660 },
+    { "Australia/Sydney", 1775318400, 660, 600 },
+    { "Australia/Sydney", 1791043200, 600, 660 },
+    { "Australia/Sydney", 1806768000, 660, 600 },
+    { "Australia/Sydney", 1822492800, 600, 660 },
+    { "Australia/Sydney", 1838217600, 660, 600 },
+    { "Australia/Sydney", 1853942400, 600, 660 },
+    { "Australia/Sydney", 1869667200, 660, 600 },
+    { "Australia/Sydney", 1885996800, 600, 660 },
+    { "Australia/Sydney", 1901721600, 660, 600 },
+    { "Australia/Sydney", 1917446400, 600, 660 },
+};
+
+
+static int exit_status = 0;
+
+
+static uint8_t from_bcd(uint8_t bcd)
+{
+    return (uint8_t)((bcd >> 4) * 10 + (bcd & 0x0f));
+}
+
+
+// Compare the local time at a timestamp with the expected one (tm); returns
+// false if it differs. Unless recalc is set, the local time is advanced from
+// the previous timestamp, a second before.
+static bool compare_time(const char *zone, time_t time, const struct tm *tm,
+    bool recalc)
+{
+    uint16_t days = (uint16_t)(time / 86400);
+    uint32_t secs = (uint32_t)(time % 86400);
+
+    if (recalc) {
+        recalc_local_time(days, secs);
+    } else {
+        advance_local_time(1);
+    }
+
+    // The local (and standard time) day count needs to fit in 16 bits as well;
+    // the first and last days are skipped
+    if (time + tm->tm_gmtoff < 86400 ||
+            time + tm->tm_gmtoff >= END_TIME - 86400) {
+        return true;
+    }
+
+    if (local_time.year != tm->tm_year + 1900 ||
+            local_time.month != tm->tm_mon + 1 ||
+            local_time.day != tm->tm_mday ||
+            from_bcd(local_time.hour) != tm->tm_hour ||
+            from_bcd(local_time.minute) != tm->tm_min ||
+            from_bcd(local_time.second) != tm->tm_sec) {
+        printf("KO %s: %lld => %02hhu/%02hhu/%04hu %02hhx:%02hhx:%02hhx "
+            "(expected %02d/%02d/%04d %02d:%02d:%02d)\n", zone,
+            (long long)time, local_time.day, local_time.month,
+            local_time.year, local_time.hour, local_time.minute,
+            local_time.second, tm->tm_mday, tm->tm_mon + 1,
+            tm->tm_year + 1900, tm->tm_hour, tm->tm_min, tm->tm_sec);
+        exit_status = 1;
+        return false;
+    }
+
+    return true;
+}
+
+
+static bool check_time(const char *zone, time_t time, bool recalc)
+{
+    struct tm tm;
+
+    localtime_r(&time, &tm);
+    return compare_time(zone, time, &tm, recalc);
+}
+
+
+static void test_zone(const struct tz_zone *zone)
+{
+    time_t prev_time = 0;
+    long prev_offset;
+    unsigned change_count = 0;
+    struct tm tm;
+
+    setenv("TZ", zone->name, 1);
+    tzset();
+
+    tz_rules = zone->rules;
+    tz_rule_count = zone->rule_count;
+    reset_local_time();
+
+    localtime_r(&prev_time, &tm);
+    prev_offset = tm.tm_gmtoff;
+
+    for (time_t time = 0 ; time < END_TIME ; time += 3600) {
+        localtime_r(&time, &tm);
+
+        if (tm.tm_gmtoff != prev_offset) {
+            time_t low = prev_time;
+            time_t high = time;
+
+            // Find the offset change, and check the seconds around it, with
+            // the local time advanced incrementally
+            while (high - low > 1) {
+                time_t mid = low + (high - low) / 2;
+
+                localtime_r(&mid, &tm);
+                if (tm.tm_gmtoff == prev_offset) {
+                    low = mid;
+                } else {
+                    high = mid;
+                }
+            }
+
+            if (!check_time(zone->name, high - 2, true) ||
+                    !check_time(zone->name, high - 1, false) ||
+                    !check_time(zone->name, high, false) ||
+                    !check_time(zone->name, high + 1, false)) {
+                return;
+            }
+
+            localtime_r(&time, &tm);
+            prev_offset = tm.tm_gmtoff;
+            change_count += 1;
+        }
+
+        if (!compare_time(zone->name, time, &tm, true)) {
+            return;
+        }
+
+        prev_time = time;
+    }
+
+    printf("OK %s: %hhu rules match over %u offset changes\n", zone->name,
+        zone->rule_count, change_count);
+}
+
+
+// Check the local time around the fixed offset changes, with the local time
+// advanced incrementally over each change. Returns the number of changes
+// checked (of the zones in the tables).
+static unsigned test_fixed_changes(void)
+{
+    unsigned count = 0;
+
+    for (size_t i = 0 ; i < sizeof(fixed_changes) / sizeof(fixed_changes[0]) ;
+            i += 1) {
+        const struct fixed_change *change = &fixed_changes[i];
+        const struct tz_zone *zone = NULL;
+        time_t local;
+        struct tm tm;
+
+        for (unsigned z = 0 ; z < TZ_ZONE_COUNT ; z += 1) {
+            if (strcmp(tz_zones[z].name, change->zone) == 0) {
+                zone = &tz_zones[z];
+            }
+        }
+        if (!zone) {
+            continue;
+        }
+
+        tz_rules = zone->rules;
+        tz_rule_count = zone->rule_count;
+        reset_local_time();
+
+        local = change->time - 1 + change->before * 60;
+        gmtime_r(&local, &tm);
+        tm.tm_gmtoff = change->before * 60;
+        if (!compare_time(zone->name, change->time - 1, &tm, true)) {
+            return count;
+        }
+
+        local = change->time + change->after * 60;
+        gmtime_r(&local, &tm);
+        tm.tm_gmtoff = change->after * 60;
+        if (!compare_time(zone->name, change->time, &tm, false)) {
+            return count;
+        }
+
+        count += 1;
+    }
+
+    return count;
+}
+
+
+// Version of the time zone database of the host, if known
+static void get_version(char *version, size_t size)
+{
+    FILE *file = fopen(TZDATA_VERSION_FILE, "r");
+
+    strcpy(version, "unknown");
+    if (file) {
+        char line[64];
+
+        if (fgets(line, sizeof(line), file) &&
+                sscanf(line, "# version %31s", line) == 1 &&
+                strlen(line) < size) {
+            strcpy(version, line);
+        }
+        fclose(file);
+    }
+}
+
+
+int main(void)
+{
+    char version[32];
+    unsigned count;
+
+    count = test_fixed_changes();
+    if (exit_status == 0) {
+        printf("OK %u UTC offset changes from 2021 to 2030\n", count);
+    }
+
+    get_version(version, sizeof(version));
+    if (strcmp(version, TZDATA_VERSION) != 0) {
+        printf("  tzdata: host database version %s, tables from %s: "
+            "comparison skipped\n", version, TZDATA_VERSION);
+        return exit_status;
+    }
+
+    for (unsigned z = 0 ; z < TZ_ZONE_COUNT ; z += 1) {
+        test_zone(&tz_zones[z]);
+    }
+
+    return exit_status;
+}
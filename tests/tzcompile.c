@@ -0,0 +1,734 @@
+// Time zone table compiler.
+//
+// Compiles zones of the IANA time zone database, as installed on the host
+// (read through localtime_r()), into the time zone rule tables used by the
+// firmware (see datetime.h). The UTC offset changes of each zone over the
+// range of the timestamps (1970 - 2149) are found, then covered by as few
+// rules as possible: from the start of a rule, its DST transitions are tried
+// in every form the firmware supports (nth or last week day of the month, or
+// day of the month, possibly a day before or after the observed date), and
+// the one matching the observed changes for the longest time is kept.
+//
+// Usage: tzcompile <tzdata.h> <tzdata.c> <zone>...
+//
+// The tables are written in tzdata.c; tzdata.h gives an identifier to each
+// zone, to be selected with TIME_ZONE in settings.h.
+
+#include <ctype.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "datetime.h"
+
+#define SECONDS_PER_DAY 86400L
+#define END_DAYS 65536L // Day after the last day of the timestamps
+#define END_TIME (END_DAYS * SECONDS_PER_DAY)
+
+#define MAX_CHANGES 4096
+#define MAX_RULES 255
+#define MAX_ZONES 64
+#define MAX_CANDIDATES 16
+
+#define TZDATA_VERSION_FILE "/usr/share/zoneinfo/tzdata.zi"
+
+// UTC offset change (the offsets are in minutes)
+struct change {
+    int64_t time;
+    int16_t offset; // Offset from the change
+};
+
+struct zone {
+    const char *name;
+    char id[64];
+    char var[64];
+    struct tz_rule rules[MAX_RULES];
+    unsigned rule_count;
+};
+
+static struct change changes[MAX_CHANGES];
+static unsigned change_count;
+static int16_t initial_offset;
+
+static struct zone zones[MAX_ZONES];
+static unsigned zone_count;
+
+
+// Days since 1/1/1970 of a date (proleptic Gregorian calendar)
+static int64_t days_from_civil(int64_t year, unsigned month, unsigned day)
+{
+    int64_t era;
+    unsigned year_of_era;
+    unsigned day_of_year;
+    unsigned day_of_era;
+
+    year -= (month <= 2);
+    era = (year >= 0 ? year : year - 399) / 400;
+    year_of_era = (unsigned)(year - era * 400);
+    day_of_year = (153 * (month + (month > 2 ? (unsigned)-3 : 9)) + 2) / 5 +
+            day - 1;
+    day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 +
+            day_of_year;
+
+    return era * 146097 + day_of_era - 719468;
+}
+
+
+static bool leap_year(int64_t year)
+{
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+
+static unsigned month_days(int64_t year, unsigned month)
+{
+    static const unsigned days[12] = {
+        31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+    };
+
+    return days[month - 1] + (month == 2 && leap_year(year));
+}
+
+
+// Civil date of a day count
+static void civil_from_days(int64_t days, int64_t *year, unsigned *month,
+    unsigned *day)
+{
+    int64_t y = 1970 + days / 366 - 1;
+
+    while (days_from_civil(y + 1, 1, 1) <= days) {
+        y += 1;
+    }
+
+    *year = y;
+    *month = 1;
+    days -= days_from_civil(y, 1, 1);
+    while (days >= month_days(y, *month)) {
+        days -= month_days(y, *month);
+        *month += 1;
+    }
+    *day = (unsigned)days + 1;
+}
+
+
+// Floor division, for negative times
+static int64_t floor_div(int64_t a, int64_t b)
+{
+    return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+
+// UTC offset of the selected zone (TZ) at a time, in seconds
+static long host_offset(int64_t time)
+{
+    time_t t = (time_t)time;
+    struct tm tm;
+
+    localtime_r(&t, &tm);
+    return tm.tm_gmtoff;
+}
+
+
+// Find the UTC offset changes of the selected zone. Returns false if the
+// offsets or changes are not a whole number of minutes.
+static bool find_changes(const char *name)
+{
+    long prev_offset = host_offset(0);
+
+    change_count = 0;
+    initial_offset = (int16_t)(prev_offset / 60);
+    if (prev_offset % 60 != 0) {
+        fprintf(stderr, "%s: offset %ld s is not a whole number of minutes\n",
+                name, prev_offset);
+        return false;
+    }
+
+    for (int64_t time = 3600 ; time < END_TIME ; time += 3600) {
+        long offset = host_offset(time);
+        int64_t low = time - 3600;
+        int64_t high = time;
+
+        if (offset == prev_offset) {
+            continue;
+        }
+
+        // Find the change second: the offset is prev_offset at low, and
+        // offset at high
+        while (high - low > 1) {
+            int64_t mid = low + (high - low) / 2;
+
+            if (host_offset(mid) == prev_offset) {
+                low = mid;
+            } else {
+                high = mid;
+            }
+        }
+
+        if (high % 60 != 0 || offset % 60 != 0) {
+            fprintf(stderr, "%s: change at %lld to %ld s is not on a whole "
+                    "minute\n", name, (long long)high, offset);
+            return false;
+        }
+
+        if (change_count == MAX_CHANGES) {
+            fprintf(stderr, "%s: too many changes\n", name);
+            return false;
+        }
+
+        changes[change_count].time = high;
+        changes[change_count].offset = (int16_t)(offset / 60);
+        change_count += 1;
+        prev_offset = offset;
+    }
+
+    return true;
+}
+
+
+// Observed offset at a time (minutes)
+static int16_t actual_offset(int64_t time)
+{
+    unsigned low = 0;
+    unsigned high = change_count;
+
+    // Find the number of changes up to the time
+    while (low < high) {
+        unsigned mid = (low + high) / 2;
+
+        if (changes[mid].time <= time) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low ? changes[low - 1].offset : initial_offset;
+}
+
+
+// Day of the year (0 = 1st of January) of a transition, as calculated by the
+// firmware
+static int64_t transition_day(int64_t year, const struct tz_transition *trans)
+{
+    unsigned month = trans->month_week & 0x0f;
+    unsigned week = trans->month_week >> 4;
+    int64_t first = days_from_civil(year, month, 1);
+    unsigned first_day; // 0 = Monday
+    unsigned offset;
+
+    if (week == TZ_FIXED_DAY) {
+        return first - days_from_civil(year, 1, 1) + trans->day - 1;
+    }
+
+    first_day = (unsigned)((first % 7 + 7 + EPOCH_DAY_NUM) % 7);
+    offset = (trans->day + 7 - first_day) % 7 + 7 * (week - 1);
+    if (offset >= month_days(year, month)) {
+        offset -= 7;
+    }
+
+    return first - days_from_civil(year, 1, 1) + offset;
+}
+
+
+// UTC instant of a transition in a (standard time) year
+static int64_t transition_time(int64_t year, const struct tz_rule *rule,
+    const struct tz_transition *trans)
+{
+    return (days_from_civil(year, 1, 1) + transition_day(year, trans)) *
+            SECONDS_PER_DAY + (trans->minutes - rule->std_offset) * 60L;
+}
+
+
+// UTC offset given by a rule at a time (minutes), as calculated by the
+// firmware
+static int16_t rule_offset(const struct tz_rule *rule, int64_t time)
+{
+    int64_t year;
+    unsigned month;
+    unsigned day;
+    int64_t start;
+    int64_t end;
+    bool dst;
+
+    if (rule->dst_save == 0) {
+        return rule->std_offset;
+    }
+
+    civil_from_days(floor_div(time + rule->std_offset * 60L, SECONDS_PER_DAY),
+            &year, &month, &day);
+    start = transition_time(year, rule, &rule->dst_start);
+    end = transition_time(year, rule, &rule->dst_end);
+
+    if (start < end) {
+        dst = (time >= start && time < end);
+    } else {
+        dst = (time < end || time >= start);
+    }
+
+    return (int16_t)(rule->std_offset + (dst ? rule->dst_save : 0));
+}
+
+
+static int compare_times(const void *a, const void *b)
+{
+    int64_t ta = *(const int64_t *)a;
+    int64_t tb = *(const int64_t *)b;
+
+    return (ta > tb) - (ta < tb);
+}
+
+
+// Find the first time from start at which a rule does not give the observed
+// offset (END_TIME if none). Between the observed changes, the rule
+// transitions and the year changes, both offsets are constant, so they only
+// need to be compared there.
+static int64_t rule_match_end(const struct tz_rule *rule, int64_t start)
+{
+    static int64_t times[MAX_CHANGES + 3 * 200];
+    unsigned time_count = 0;
+    int64_t year;
+    unsigned month;
+    unsigned day;
+
+    times[time_count++] = start;
+
+    for (unsigned c = 0 ; c < change_count ; c += 1) {
+        if (changes[c].time > start) {
+            times[time_count++] = changes[c].time;
+        }
+    }
+
+    civil_from_days(floor_div(start, SECONDS_PER_DAY), &year, &month, &day);
+    for (year -= 1 ; year <= 2150 ; year += 1) {
+        int64_t candidates[3] = {
+            days_from_civil(year, 1, 1) * SECONDS_PER_DAY -
+                    rule->std_offset * 60L,
+            rule->dst_save ? transition_time(year, rule, &rule->dst_start) : 0,
+            rule->dst_save ? transition_time(year, rule, &rule->dst_end) : 0,
+        };
+
+        for (unsigned i = 0 ; i < 3 ; i += 1) {
+            if (candidates[i] > start && candidates[i] < END_TIME) {
+                times[time_count++] = candidates[i];
+            }
+        }
+    }
+
+    qsort(times, time_count, sizeof(times[0]), compare_times);
+
+    for (unsigned t = 0 ; t < time_count ; t += 1) {
+        if (times[t] < END_TIME &&
+                rule_offset(rule, times[t]) != actual_offset(times[t])) {
+            return times[t];
+        }
+    }
+
+    return END_TIME;
+}
+
+
+// Forms of a transition observed at a UTC time, in standard time: on the day
+// of the transition or the day before or after (with the time adjusted), as
+// the nth or last week day of the month or as a day of the month
+static unsigned transition_forms(int64_t time, int16_t std_offset,
+    struct tz_transition *forms)
+{
+    int64_t local = time + std_offset * 60L;
+    int64_t local_day = floor_div(local, SECONDS_PER_DAY);
+    long minutes = (long)(local - local_day * SECONDS_PER_DAY) / 60;
+    unsigned count = 0;
+
+    // The forms are tried in this order; the first one matching the longest
+    // is kept.
+    static const int shifts[3] = { 0, -1, 1 };
+
+    for (unsigned s = 0 ; s < 3 ; s += 1) {
+        int64_t days = local_day + shifts[s];
+        int16_t trans_minutes = (int16_t)(minutes - shifts[s] * 24 * 60);
+        uint8_t week_day = (uint8_t)((days % 7 + 7 + EPOCH_DAY_NUM) % 7);
+        int64_t year;
+        unsigned month;
+        unsigned day;
+
+        civil_from_days(days, &year, &month, &day);
+
+        if (day + 7 > month_days(year, month)) {
+            forms[count++] = (struct tz_transition)TZ_TRANSITION(month,
+                    TZ_LAST_WEEK, week_day, trans_minutes);
+        }
+
+        if (day <= 28) {
+            forms[count++] = (struct tz_transition)TZ_TRANSITION(month,
+                    (day - 1) / 7 + 1, week_day, trans_minutes);
+        }
+
+        forms[count++] = (struct tz_transition)TZ_TRANSITION(month,
+                TZ_FIXED_DAY, day, trans_minutes);
+    }
+
+    return count;
+}
+
+
+// Find the rule matching the observed offsets for the longest time from a
+// start time. Returns the end of the match.
+static int64_t best_rule(int64_t start, struct tz_rule *best)
+{
+    int16_t offset = actual_offset(start);
+    int16_t next_offset = offset;
+    int64_t best_end;
+    int16_t std_offset;
+    int16_t dst_offset;
+    int64_t dst_start = -1;
+    int64_t dst_end = -1;
+    struct tz_transition start_forms[MAX_CANDIDATES];
+    struct tz_transition end_forms[MAX_CANDIDATES];
+    unsigned start_count;
+    unsigned end_count;
+    int64_t days = floor_div(start, SECONDS_PER_DAY);
+
+    // Rule without DST
+    memset(best, 0, sizeof(*best));
+    best->start_days = (uint16_t)days;
+    best->start_minutes = (uint16_t)((start - days * SECONDS_PER_DAY) / 60);
+    best->std_offset = offset;
+    best_end = rule_match_end(best, start);
+
+    // Offsets after the next change, and first DST start and end with these
+    // offsets
+    for (unsigned c = 0 ; c < change_count ; c += 1) {
+        if (changes[c].time > start) {
+            next_offset = changes[c].offset;
+            break;
+        }
+    }
+
+    std_offset = (next_offset < offset) ? next_offset : offset;
+    dst_offset = (next_offset > offset) ? next_offset : offset;
+
+    if (dst_offset == std_offset || dst_offset - std_offset > UINT8_MAX) {
+        return best_end;
+    }
+
+    for (unsigned c = 0 ; c < change_count ; c += 1) {
+        int16_t prev = c ? changes[c - 1].offset : initial_offset;
+
+        if (changes[c].time <= start) {
+            continue;
+        }
+
+        if (prev == std_offset && changes[c].offset == dst_offset &&
+                dst_start < 0) {
+            dst_start = changes[c].time;
+        } else if (prev == dst_offset && changes[c].offset == std_offset &&
+                dst_end < 0) {
+            dst_end = changes[c].time;
+        } else if (changes[c].offset != std_offset &&
+                changes[c].offset != dst_offset) {
+            break;
+        }
+
+        if (dst_start >= 0 && dst_end >= 0) {
+            break;
+        }
+    }
+
+    if (dst_start < 0 || dst_end < 0) {
+        return best_end;
+    }
+
+    start_count = transition_forms(dst_start, std_offset, start_forms);
+    end_count = transition_forms(dst_end, std_offset, end_forms);
+
+    for (unsigned s = 0 ; s < start_count ; s += 1) {
+        for (unsigned e = 0 ; e < end_count ; e += 1) {
+            struct tz_rule rule = *best;
+            int64_t end;
+
+            rule.std_offset = std_offset;
+            rule.dst_save = (uint8_t)(dst_offset - std_offset);
+            rule.dst_start = start_forms[s];
+            rule.dst_end = end_forms[e];
+
+            end = rule_match_end(&rule, start);
+            if (end > best_end) {
+                best_end = end;
+                *best = rule;
+            }
+        }
+    }
+
+    return best_end;
+}
+
+
+static bool compile_zone(struct zone *zone)
+{
+    int64_t start = 0;
+
+    if (setenv("TZ", zone->name, 1) != 0) {
+        return false;
+    }
+    tzset();
+
+    if (!find_changes(zone->name)) {
+        return false;
+    }
+
+    zone->rule_count = 0;
+    while (start < END_TIME) {
+        int64_t end;
+
+        if (zone->rule_count == MAX_RULES) {
+            fprintf(stderr, "%s: more than %d rules needed\n", zone->name,
+                    MAX_RULES);
+            return false;
+        }
+
+        end = best_rule(start, &zone->rules[zone->rule_count]);
+        if (end <= start) {
+            fprintf(stderr, "%s: no rule matches at %lld\n", zone->name,
+                    (long long)start);
+            return false;
+        }
+
+        zone->rule_count += 1;
+        start = end;
+    }
+
+    return true;
+}
+
+
+// Identifier (TZ_EUROPE_PARIS) and table name (tz_europe_paris) of a zone
+static void zone_names(struct zone *zone)
+{
+    size_t len = strlen(zone->name);
+
+    if (len + 4 > sizeof(zone->id)) {
+        len = sizeof(zone->id) - 4;
+    }
+
+    strcpy(zone->id, "TZ_");
+    strcpy(zone->var, "tz_");
+    for (size_t i = 0 ; i < len ; i += 1) {
+        char c = zone->name[i];
+
+        if (!isalnum((unsigned char)c)) {
+            c = '_';
+        }
+
+        zone->id[i + 3] = (char)toupper((unsigned char)c);
+        zone->var[i + 3] = (char)tolower((unsigned char)c);
+    }
+    zone->id[len + 3] = '\0';
+    zone->var[len + 3] = '\0';
+}
+
+
+// Version of the time zone database, if known
+static void get_version(char *version, size_t size)
+{
+    FILE *file = fopen(TZDATA_VERSION_FILE, "r");
+
+    strcpy(version, "unknown");
+    if (file) {
+        char line[64];
+
+        if (fgets(line, sizeof(line), file) &&
+                sscanf(line, "# version %31s", line) == 1 &&
+                strlen(line) < size) {
+            strcpy(version, line);
+        }
+        fclose(file);
+    }
+}
+
+
+static void write_transition(FILE *file, const struct tz_transition *trans)
+{
+    fprintf(file, "TZ_TRANSITION(%u, %u, %u, %d)", trans->month_week & 0x0f,
+            trans->month_week >> 4, trans->day, trans->minutes);
+}
+
+
+static bool write_header(const char *path, const char *version)
+{
+    FILE *file = fopen(path, "w");
+
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file,
+            "// 150189-71 Nixie Clock alternative firmware\n"
+            "// Distributed under the terms of the MIT license.\n"
+            "\n"
+            "// Time zone rule tables, generated by tests/tzcompile from the "
+            "IANA time zone\n"
+            "// database (version %s). Do not edit; run \"make tzdata\" in "
+            "tests/ instead.\n"
+            "\n"
+            "#ifndef TZDATA_H\n"
+            "#define TZDATA_H\n"
+            "\n"
+            "#include \"datetime.h\"\n"
+            "\n"
+            "// Zones, for TIME_ZONE in settings.h\n", version);
+
+    for (unsigned z = 0 ; z < zone_count ; z += 1) {
+        fprintf(file, "#define %s %u // %s\n", zones[z].id, z + 1,
+                zones[z].name);
+    }
+
+    fprintf(file,
+            "\n"
+            "#define TZ_ZONE_COUNT %u\n"
+            "\n"
+            "#if defined(TZ_ALL_ZONES)\n"
+            "// Version of the database (host tests)\n"
+            "#define TZDATA_VERSION \"%s\"\n"
+            "\n"
+            "// All the zones (host tests)\n"
+            "struct tz_zone {\n"
+            "    const char *name;\n"
+            "    const struct tz_rule *rules;\n"
+            "    uint8_t rule_count;\n"
+            "};\n"
+            "\n"
+            "extern const struct tz_zone tz_zones[TZ_ZONE_COUNT];\n"
+            "#else\n"
+            "// Rules of the zone selected by TIME_ZONE\n"
+            "extern const struct tz_rule *const tz_zone_rules;\n"
+            "extern const uint8_t tz_zone_rule_count;\n"
+            "#endif\n"
+            "\n"
+            "#endif\n", zone_count, version);
+
+    return fclose(file) == 0;
+}
+
+
+static bool write_source(const char *path, const char *version)
+{
+    FILE *file = fopen(path, "w");
+
+    if (!file) {
+        return false;
+    }
+
+    fprintf(file,
+            "// 150189-71 Nixie Clock alternative firmware\n"
+            "// Distributed under the terms of the MIT license.\n"
+            "\n"
+            "// Time zone rule tables, generated by tests/tzcompile from the "
+            "IANA time zone\n"
+            "// database (version %s). Do not edit; run \"make tzdata\" in "
+            "tests/ instead.\n"
+            "// Rule: { start days, start minutes (UTC), standard offset, DST "
+            "save (minutes),\n"
+            "// DST start, DST end: TZ_TRANSITION(month, week, day, minutes) "
+            "}\n"
+            "\n"
+            "#include \"tzdata.h\"\n"
+            "\n"
+            "#include \"settings.h\"\n", version);
+
+    for (unsigned z = 0 ; z < zone_count ; z += 1) {
+        const struct zone *zone = &zones[z];
+
+        fprintf(file,
+                "\n"
+                "#if defined(TZ_ALL_ZONES) || TIME_ZONE == %s\n"
+                "static const struct tz_rule %s[%u] = {\n",
+                zone->id, zone->var, zone->rule_count);
+
+        for (unsigned r = 0 ; r < zone->rule_count ; r += 1) {
+            const struct tz_rule *rule = &zone->rules[r];
+
+            fprintf(file, "    { %u, %u, %d, %u", rule->start_days,
+                    rule->start_minutes, rule->std_offset, rule->dst_save);
+            if (rule->dst_save) {
+                fprintf(file, ",\n        ");
+                write_transition(file, &rule->dst_start);
+                fprintf(file, ", ");
+                write_transition(file, &rule->dst_end);
+            } else {
+                fprintf(file, ", TZ_NO_DST");
+            }
+            fprintf(file, " },\n");
+        }
+
+        fprintf(file, "};\n#endif\n");
+    }
+
+    fprintf(file,
+            "\n"
+            "#if defined(TZ_ALL_ZONES)\n"
+            "const struct tz_zone tz_zones[TZ_ZONE_COUNT] = {\n");
+    for (unsigned z = 0 ; z < zone_count ; z += 1) {
+        fprintf(file, "    { \"%s\", %s, %u },\n", zones[z].name,
+                zones[z].var, zones[z].rule_count);
+    }
+    fprintf(file, "};\n#else\n");
+
+    for (unsigned z = 0 ; z < zone_count ; z += 1) {
+        fprintf(file, "#%s TIME_ZONE == %s\n#define TZ_ZONE_RULES %s\n",
+                z ? "elif" : "if", zones[z].id, zones[z].var);
+    }
+
+    fprintf(file,
+            "#else\n"
+            "#error \"TIME_ZONE (settings.h) is not a zone of tzdata.h\"\n"
+            "#endif\n"
+            "\n"
+            "const struct tz_rule *const tz_zone_rules = TZ_ZONE_RULES;\n"
+            "const uint8_t tz_zone_rule_count =\n"
+            "    sizeof(TZ_ZONE_RULES) / sizeof(TZ_ZONE_RULES[0]);\n"
+            "#endif\n");
+
+    return fclose(file) == 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    char version[32];
+
+    if (argc < 4) {
+        fprintf(stderr, "Usage: %s <tzdata.h> <tzdata.c> <zone>...\n",
+                argv[0]);
+        return 2;
+    }
+
+    if (argc - 3 > MAX_ZONES) {
+        fprintf(stderr, "Too many zones\n");
+        return 2;
+    }
+
+    for (int i = 3 ; i < argc ; i += 1) {
+        struct zone *zone = &zones[zone_count];
+
+        zone->name = argv[i];
+        zone_names(zone);
+        if (!compile_zone(zone)) {
+            return 1;
+        }
+
+        printf("%s: %u offset changes, %u rules\n", zone->name, change_count,
+                zone->rule_count);
+        zone_count += 1;
+    }
+
+    get_version(version, sizeof(version));
+
+    if (!write_header(argv[1], version) || !write_source(argv[2], version)) {
+        fprintf(stderr, "Cannot write the tables\n");
+        return 1;
+    }
+
+    return 0;
+}
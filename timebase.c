@@ -0,0 +1,303 @@
+// 150189-71 Nixie Clock alternative firmware
+// Copyright (C) Vincent Duvert
+// Distributed under the terms of the MIT license.
+
+#include "timebase.h"
+
+// The phase must hold a full second plus a tick and a reload, and a tick must
+// be shorter than a second; with these settings, no rounding is needed.
+#if PHASE_PER_SECOND > 0xFFFFFFFFUL - PHASE_PER_TICK - PHASE_PER_RELOAD
+#error "OSC_FREQ is too high for the phase accumulator"
+#endif
+
+#if PHASE_PER_TICK >= PHASE_PER_SECOND
+#error "Timer0 ticks must be shorter than a second"
+#endif
+
+// Frequency-locked loop: the time errors measured when the time is set are
+// accumulated over a window of about an hour. The frequency error is the slope
+// of the accumulated error, between the means of the two halves of the window;
+// the means average out the jitter of the GPS messages (milliseconds).
+#define FLL_WINDOW_SECS 3600UL
+#define FLL_WINDOW_TICKS \
+    (FLL_WINDOW_SECS * (OSC_FREQ / (4UL * TMR0_PRESCALER)) / TICK_COUNTS)
+
+// Errors are measured in Timer0 counts
+#define CYCLES_PER_COUNT (4L * TMR0_PRESCALER)
+#define COUNTS_PER_SECOND ((int32_t)(OSC_FREQ / CYCLES_PER_COUNT))
+
+// Larger errors are handled as time jumps (first fix, or fix after an error)
+// and restart the measurement (250 ms)
+#define FLL_MAX_ERROR (COUNTS_PER_SECOND / 4)
+
+// Limit of the accumulated error, so that the sums cannot overflow (1 s)
+#define FLL_MAX_ACC_ERROR COUNTS_PER_SECOND
+
+// Limit of the correction (+/- 200 ppm)
+#define FLL_MAX_CORRECTION ((int32_t)(PHASE_PER_TICK / 5000UL))
+
+// Limit of the slope numerator (accumulated error difference, in counts), so
+// that its conversion to phase units, divided by the ticks and added to the
+// correction, cannot overflow. Over the half window, it is already beyond the
+// correction limit (about 270 ppm).
+#define FLL_MAX_ERROR_DIFF ((int32_t)(INT32_MAX / PHASE_PER_COUNT / 2))
+
+// Definition of extern variables
+uint16_t cur_days;
+uint32_t cur_secs;
+uint32_t cur_phase;
+uint8_t sec_count;
+volatile uint8_t tick_seq;
+uint8_t tick_count;
+uint8_t period_ticks;
+int32_t tick_correction;
+int32_t timebase_error;
+
+// Phase added on each tick (PHASE_PER_TICK + tick_correction)
+static uint32_t phase_per_tick = PHASE_PER_TICK;
+
+// Frequency-locked loop state: ticks since the time was last set and since
+// the start of the window, accumulated error, and sums of the accumulated
+// errors and of the times of the fixes in each half of the window
+static bool fll_started;
+static uint32_t fll_ticks;
+static uint32_t fll_window_ticks;
+static int32_t fll_acc_error;
+static struct {
+    uint8_t count;
+    int32_t error_sum;
+    uint32_t ticks_sum;
+} fll_halves[2];
+
+
+static void fll_update(uint16_t days, uint32_t secs, uint32_t phase);
+
+
+void timebase_tick(uint8_t ticks)
+{
+    tick_seq += 1;
+    tick_count += ticks;
+    fll_ticks += ticks;
+
+    // The cycles lost by the reload of Timer0 at the start of the period
+    cur_phase += PHASE_PER_RELOAD;
+
+    do {
+        ticks -= 1;
+
+        cur_phase += phase_per_tick;
+        if (cur_phase < PHASE_PER_SECOND) {
+            continue;
+        }
+
+        // A second elapsed
+        cur_phase -= PHASE_PER_SECOND;
+
+        sec_count += 1;
+
+        cur_secs += 1;
+        if (cur_secs == SECONDS_PER_DAY) {
+            cur_days += 1;
+            cur_secs = 0;
+        }
+    } while (ticks != 0);
+}
+
+
+uint8_t timebase_ticks_to_second(void)
+{
+    uint32_t phase = cur_phase + PHASE_PER_RELOAD;
+    uint8_t ticks = 0;
+
+    do {
+        phase += phase_per_tick;
+        ticks += 1;
+    } while (phase < PHASE_PER_SECOND);
+
+    return ticks;
+}
+
+
+void timebase_snapshot(struct timebase_snapshot *snapshot)
+{
+    uint8_t seq;
+
+    // The reads are volatile so that they are repeated at each try
+    do {
+        seq = tick_seq;
+        snapshot->days = *(volatile uint16_t *)&cur_days;
+        snapshot->secs = *(volatile uint32_t *)&cur_secs;
+        snapshot->sec_count = *(volatile uint8_t *)&sec_count;
+    } while (seq != tick_seq);
+
+    snapshot->seq = seq;
+}
+
+
+// Add a signed phase offset, less than 0.9 second, to a time
+static void offset_time(uint16_t *days, uint32_t *secs, uint32_t *phase,
+    int32_t offset)
+{
+    if (offset >= 0) {
+        *phase += (uint32_t)offset;
+        if (*phase >= PHASE_PER_SECOND) {
+            *phase -= PHASE_PER_SECOND;
+            *secs += 1;
+            if (*secs == SECONDS_PER_DAY) {
+                *days += 1;
+                *secs = 0;
+            }
+        }
+    } else if (*phase >= (uint32_t)-offset) {
+        *phase -= (uint32_t)-offset;
+    } else {
+        *phase += PHASE_PER_SECOND - (uint32_t)-offset;
+        if (*secs == 0) {
+            *days -= 1;
+            *secs = SECONDS_PER_DAY;
+        }
+        *secs -= 1;
+    }
+}
+
+
+void timebase_set(uint16_t days, uint32_t centisecs, uint32_t delay,
+    uint16_t timer, int8_t ticks_handled)
+{
+    uint32_t secs = centisecs / 100;
+    uint8_t centisecs_in_sec = (uint8_t)(centisecs - secs * 100);
+    uint32_t phase = centisecs_in_sec * PHASE_PER_CENTISEC;
+
+    // Whole ticks and remaining counts elapsed from the last handled tick to
+    // the moment of the timer value (the period may be longer than the
+    // offsets handled by offset_time())
+    uint8_t timer_ticks = (uint8_t)(timer / TICK_COUNTS);
+    int8_t ticks = (int8_t)(timer_ticks - ticks_handled);
+    int32_t counts_phase = (int32_t)((timer % TICK_COUNTS) * PHASE_PER_COUNT);
+
+    // Time at that moment, then at the last handled tick
+    offset_time(&days, &secs, &phase, (int32_t)delay);
+    offset_time(&days, &secs, &phase, -counts_phase);
+    for ( ; ticks > 0 ; ticks -= 1) {
+        offset_time(&days, &secs, &phase, -(int32_t)PHASE_PER_TICK);
+    }
+    for ( ; ticks < 0 ; ticks += 1) {
+        offset_time(&days, &secs, &phase, (int32_t)PHASE_PER_TICK);
+    }
+
+    fll_update(days, secs, phase);
+
+    cur_days = days;
+    cur_secs = secs;
+    cur_phase = phase;
+}
+
+
+void timebase_restore(uint16_t days, uint32_t secs, int32_t correction)
+{
+    if (correction > FLL_MAX_CORRECTION || correction < -FLL_MAX_CORRECTION) {
+        correction = 0;
+    }
+
+    cur_days = days;
+    cur_secs = secs;
+    cur_phase = 0;
+    tick_correction = correction;
+    phase_per_tick = (uint32_t)((int32_t)PHASE_PER_TICK + correction);
+    timebase_error = TIMEBASE_JUMP;
+}
+
+
+static void fll_restart(void)
+{
+    fll_window_ticks = 0;
+    fll_acc_error = 0;
+    fll_halves[0].count = 0;
+    fll_halves[0].error_sum = 0;
+    fll_halves[0].ticks_sum = 0;
+    fll_halves[1] = fll_halves[0];
+}
+
+
+// Measure the error of the timebase against the new time (both as of the last
+// tick), and update the tick correction at the end of a window
+static void fll_update(uint16_t days, uint32_t secs, uint32_t phase)
+{
+    int32_t error_secs;
+    int32_t error;
+    uint8_t half;
+    int32_t error_diff;
+    uint32_t ticks_diff;
+
+    fll_window_ticks += fll_ticks;
+    fll_ticks = 0;
+    timebase_error = TIMEBASE_JUMP;
+
+    if (!fll_started) {
+        // No previous time to compare with
+        fll_started = true;
+        fll_restart();
+        return;
+    }
+
+    // Error of the timebase in seconds, then in Timer0 counts (positive if
+    // the timebase is late)
+    error_secs = (int32_t)(int16_t)(days - cur_days) *
+            (int32_t)SECONDS_PER_DAY + (int32_t)secs - (int32_t)cur_secs;
+    if (error_secs < -1 || error_secs > 1) {
+        // Time jump
+        fll_restart();
+        return;
+    }
+
+    error = error_secs * COUNTS_PER_SECOND +
+            (int32_t)(phase / PHASE_PER_COUNT) -
+            (int32_t)(cur_phase / PHASE_PER_COUNT);
+    if (error > FLL_MAX_ERROR || error < -FLL_MAX_ERROR) {
+        // Time jump
+        fll_restart();
+        return;
+    }
+
+    timebase_error = error;
+    fll_acc_error += error;
+    half = (fll_window_ticks < FLL_WINDOW_TICKS / 2) ? 0 : 1;
+
+    if (fll_acc_error > FLL_MAX_ACC_ERROR ||
+            fll_acc_error < -FLL_MAX_ACC_ERROR ||
+            fll_halves[half].count == UINT8_MAX) {
+        // Not a plausible oscillator error, or too many fixes
+        fll_restart();
+        return;
+    }
+
+    fll_halves[half].count += 1;
+    fll_halves[half].error_sum += fll_acc_error;
+    fll_halves[half].ticks_sum += fll_window_ticks;
+
+    if (fll_window_ticks < FLL_WINDOW_TICKS || fll_halves[0].count == 0) {
+        return;
+    }
+
+    // Slope between the means of the halves, in phase units per tick
+    error_diff = fll_halves[1].error_sum / fll_halves[1].count -
+            fll_halves[0].error_sum / fll_halves[0].count;
+    if (error_diff > FLL_MAX_ERROR_DIFF) {
+        error_diff = FLL_MAX_ERROR_DIFF;
+    } else if (error_diff < -FLL_MAX_ERROR_DIFF) {
+        error_diff = -FLL_MAX_ERROR_DIFF;
+    }
+    ticks_diff = fll_halves[1].ticks_sum / fll_halves[1].count -
+            fll_halves[0].ticks_sum / fll_halves[0].count;
+
+    tick_correction += error_diff * (int32_t)PHASE_PER_COUNT /
+            (int32_t)ticks_diff;
+    if (tick_correction > FLL_MAX_CORRECTION) {
+        tick_correction = FLL_MAX_CORRECTION;
+    } else if (tick_correction < -FLL_MAX_CORRECTION) {
+        tick_correction = -FLL_MAX_CORRECTION;
+    }
+    phase_per_tick = (uint32_t)((int32_t)PHASE_PER_TICK + tick_correction);
+
+    fll_restart();
+}
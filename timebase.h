@@ -0,0 +1,118 @@
+// 150189-71 Nixie Clock alternative firmware
+// Distributed under the terms of the MIT license.
+
+#ifndef TIMEBASE_H
+#define TIMEBASE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Oscillator frequency, in Hz. The crystal is nominally 22.1184 MHz; this is
+// the measured frequency of the clock's crystal. The remaining error and the
+// drift are learned from the GPS fixes (see tick_correction).
+#define OSC_FREQ 22120487UL
+
+// Timer0 pre-scaler, as configured in T0CON. Timer0 counts the instruction
+// clock (oscillator / 4); a tick is TICK_COUNTS counts (about 95 ms). Timer0
+// is reloaded at each overflow so that it overflows again after the number of
+// ticks until the next event due (period_ticks, at most MAX_PERIOD_TICKS, a
+// full turn of Timer0): in steady state, once per second.
+#define TMR0_PRESCALER 128
+#define TICK_COUNTS 4096UL
+#define MAX_PERIOD_TICKS 16
+
+// Instruction cycles lost by Timer0 at each reload: the write clears the
+// pre-scaler (the cycles from the increment the reload waits for to the write)
+// and stops the timer for 2 cycles (see HAL_TIMER0_ADD_HIGH())
+#define TMR0_RELOAD_CYCLES 10
+
+// The phase of the timebase (time elapsed in the current second) is counted in
+// 1/100th of oscillator cycles. This way, both a Timer0 count and a
+// centisecond are an integral number of phase units, and the ratio between
+// ticks and seconds is exact.
+#define PHASE_PER_SECOND (OSC_FREQ * 100UL)
+#define PHASE_PER_CENTISEC OSC_FREQ
+#define PHASE_PER_COUNT (4UL * TMR0_PRESCALER * 100UL)
+#define PHASE_PER_TICK (PHASE_PER_COUNT * TICK_COUNTS)
+#define PHASE_PER_RELOAD (4UL * 100UL * TMR0_RELOAD_CYCLES)
+
+#define SECONDS_PER_DAY 86400UL
+#define CENTISECS_PER_DAY (100UL * SECONDS_PER_DAY)
+
+// Current time, as of the last tick handled (the last Timer0 overflow): days
+// since 1/1/1970, seconds since the start of the day (UTC), and phase. The
+// main loop reads it with timebase_snapshot().
+extern uint16_t cur_days;
+extern uint32_t cur_secs;
+extern uint32_t cur_phase;
+
+// Free-running count of the elapsed seconds; the main loop counts the seconds
+// elapsed since it last read it
+extern uint8_t sec_count;
+
+// Sequence number of the time, incremented at each tick handled
+extern volatile uint8_t tick_seq;
+
+// Time as of the last tick handled, and sequence number of that tick
+struct timebase_snapshot {
+    uint16_t days;
+    uint32_t secs;
+    uint8_t sec_count;
+    uint8_t seq;
+};
+
+// Free-running tick counter
+extern uint8_t tick_count;
+
+// Number of ticks in the current Timer0 period, set by the interrupt handler
+// when it reloads Timer0
+extern uint8_t period_ticks;
+
+// Timer0 counts since the start of the current period (the last tick
+// handled), given a Timer0 value read with no overflow pending
+#define TIMER0_SINCE_TICK(timer) \
+    ((uint16_t)((timer) + period_ticks * TICK_COUNTS))
+
+// Oscillator frequency correction learned from the GPS fixes by the
+// frequency-locked loop, in phase units added to each tick (1 ppm is about
+// 210 units). Negative if the oscillator is faster than OSC_FREQ.
+extern int32_t tick_correction;
+
+// Error of the timebase measured by the last timebase_set(), in Timer0 counts
+// (positive if the timebase was late), or TIMEBASE_JUMP if the time jumped
+#define TIMEBASE_JUMP INT32_MAX
+extern int32_t timebase_error;
+
+// Handle the end of a Timer0 period of the given number of ticks (1 to
+// MAX_PERIOD_TICKS). Called from the interrupt handler.
+void timebase_tick(uint8_t ticks);
+
+// Number of ticks until the end of the tick in which the next second elapses
+// (the length of a period ending just after it). Called from the interrupt
+// handler.
+uint8_t timebase_ticks_to_second(void);
+
+// Read the time as of the last tick handled, without disabling the
+// interrupts: it is read again if a tick was handled meanwhile (sequence
+// lock). Called from the main loop; the interrupt handler cannot be
+// interrupted by it, so the updates of the time need no marking.
+void timebase_snapshot(struct timebase_snapshot *snapshot);
+
+// Set the current time, given in days and centiseconds since the start of the
+// day (UTC), plus a delay in phase units (less than 0.5 second). This is the
+// time of the moment when Timer0 had counted timer counts since the start of
+// its period; ticks_handled is the number of ticks handled since that moment,
+// or minus the ticks of the period if it ended before that moment but was not
+// handled yet. The difference with the current time is used to
+// learn the oscillator frequency.
+// Must be called with the Timer0 interrupt disabled.
+void timebase_set(uint16_t days, uint32_t centisecs, uint32_t delay,
+    uint16_t timer, int8_t ticks_handled);
+
+// Set an estimate of the current time (days and seconds, see timebase_set())
+// and a previously learned frequency correction, at startup. The next
+// timebase_set() is handled as a time jump.
+// Must be called with the Timer0 interrupt disabled.
+void timebase_restore(uint16_t days, uint32_t secs, int32_t correction);
+
+#endif
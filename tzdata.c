@@ -0,0 +1,426 @@
+// 150189-71 Nixie Clock alternative firmware
+// Distributed under the terms of the MIT license.
+
+// Time zone rule tables, generated by tests/tzcompile from the IANA time zone
+// database (version 2025b). Do not edit; run "make tzdata" in tests/ instead.
+// Rule: { start days, start minutes (UTC), standard offset, DST save (minutes),
+// DST start, DST end: TZ_TRANSITION(month, week, day, minutes) }
+
+#include "tzdata.h"
+
+#include "settings.h"
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_EUROPE_PARIS
+static const struct tz_rule tz_europe_paris[6] = {
+    { 0, 0, 60, 0, TZ_NO_DST },
+    { 2278, 0, 120, 0, TZ_NO_DST },
+    { 2459, 1380, 60, 60,
+        TZ_TRANSITION(4, 1, 6, 120), TZ_TRANSITION(9, 0, 25, 120) },
+    { 3189, 60, 60, 60,
+        TZ_TRANSITION(4, 1, 6, 120), TZ_TRANSITION(9, 5, 5, 1560) },
+    { 4105, 60, 60, 60,
+        TZ_TRANSITION(3, 5, 6, 120), TZ_TRANSITION(9, 5, 6, 120) },
+    { 9768, 60, 60, 60,
+        TZ_TRANSITION(3, 5, 6, 120), TZ_TRANSITION(10, 5, 6, 120) },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_AMERICA_NEW_YORK
+static const struct tz_rule tz_america_new_york[6] = {
+    { 0, 0, -300, 60,
+        TZ_TRANSITION(4, 5, 6, 120), TZ_TRANSITION(10, 5, 6, 60) },
+    { 1466, 420, -240, 0, TZ_NO_DST },
+    { 1760, 360, -300, 60,
+        TZ_TRANSITION(2, 5, 6, 120), TZ_TRANSITION(10, 5, 6, 60) },
+    { 2250, 420, -300, 60,
+        TZ_TRANSITION(4, 5, 6, 120), TZ_TRANSITION(10, 5, 6, 60) },
+    { 6303, 420, -300, 60,
+        TZ_TRANSITION(4, 1, 6, 120), TZ_TRANSITION(10, 5, 6, 60) },
+    { 13583, 420, -300, 60,
+        TZ_TRANSITION(3, 2, 6, 120), TZ_TRANSITION(11, 1, 6, 60) },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_AUSTRALIA_SYDNEY
+static const struct tz_rule tz_australia_sydney[14] = {
+    { 0, 0, 600, 0, TZ_NO_DST },
+    { 667, 960, 600, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(2, 0, 27, 120) },
+    { 1152, 960, 600, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 1, 6, 120) },
+    { 4447, 960, 600, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(4, 1, 6, 120) },
+    { 4811, 960, 600, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 1, 6, 120) },
+    { 5903, 960, 600, 60,
+        TZ_TRANSITION(10, 0, 19, 120), TZ_TRANSITION(3, 3, 6, 120) },
+    { 6499, 960, 600, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 3, 6, 120) },
+    { 7366, 960, 600, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 1, 6, 120) },
+    { 9557, 960, 600, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 5, 6, 120) },
+    { 11195, 960, 660, 0, TZ_NO_DST },
+    { 11405, 960, 600, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 5, 6, 120) },
+    { 13232, 960, 600, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(4, 1, 6, 120) },
+    { 13596, 960, 600, 0, TZ_NO_DST },
+    { 13813, 960, 600, 60,
+        TZ_TRANSITION(10, 1, 6, 120), TZ_TRANSITION(4, 1, 6, 120) },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_PACIFIC_AUCKLAND
+static const struct tz_rule tz_pacific_auckland[5] = {
+    { 0, 0, 720, 0, TZ_NO_DST },
+    { 1766, 840, 720, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(2, 5, 6, 120) },
+    { 2249, 840, 720, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 1, 6, 120) },
+    { 7219, 840, 720, 60,
+        TZ_TRANSITION(10, 1, 6, 120), TZ_TRANSITION(3, 3, 6, 120) },
+    { 13785, 840, 720, 60,
+        TZ_TRANSITION(9, 5, 6, 120), TZ_TRANSITION(4, 1, 6, 120) },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_AMERICA_SAO_PAULO
+static const struct tz_rule tz_america_sao_paulo[24] = {
+    { 0, 0, -180, 0, TZ_NO_DST },
+    { 5784, 180, -180, 60,
+        TZ_TRANSITION(10, 5, 5, 0), TZ_TRANSITION(3, 2, 4, 1380) },
+    { 6253, 120, -180, 60,
+        TZ_TRANSITION(10, 5, 6, 0), TZ_TRANSITION(2, 1, 5, 1380) },
+    { 6863, 180, -180, 60,
+        TZ_TRANSITION(10, 3, 6, 0), TZ_TRANSITION(1, 0, 28, 1380) },
+    { 7333, 120, -180, 60,
+        TZ_TRANSITION(10, 3, 6, 0), TZ_TRANSITION(2, 0, 10, 1380) },
+    { 7711, 120, -180, 60,
+        TZ_TRANSITION(10, 3, 6, 0), TZ_TRANSITION(2, 3, 5, 1380) },
+    { 8074, 120, -180, 60,
+        TZ_TRANSITION(10, 5, 6, 0), TZ_TRANSITION(1, 5, 5, 1380) },
+    { 8690, 180, -180, 60,
+        TZ_TRANSITION(10, 3, 6, 0), TZ_TRANSITION(2, 3, 5, 1380) },
+    { 9537, 120, -180, 60,
+        TZ_TRANSITION(10, 0, 6, 0), TZ_TRANSITION(2, 2, 4, 2820) },
+    { 10272, 120, -180, 60,
+        TZ_TRANSITION(10, 2, 6, 0), TZ_TRANSITION(2, 5, 5, 1380) },
+    { 10643, 120, -180, 0, TZ_NO_DST },
+    { 10867, 180, -180, 60,
+        TZ_TRANSITION(10, 1, 5, 1440), TZ_TRANSITION(2, 5, 5, 1380) },
+    { 11371, 120, -180, 60,
+        TZ_TRANSITION(10, 3, 0, -1440), TZ_TRANSITION(2, 3, 5, 1380) },
+    { 11980, 180, -180, 60,
+        TZ_TRANSITION(11, 1, 6, 0), TZ_TRANSITION(2, 3, 5, 1380) },
+    { 12344, 180, -120, 0, TZ_NO_DST },
+    { 12463, 120, -180, 60,
+        TZ_TRANSITION(11, 1, 1, 0), TZ_TRANSITION(2, 3, 6, -60) },
+    { 13072, 180, -120, 0, TZ_NO_DST },
+    { 13198, 120, -180, 0, TZ_NO_DST },
+    { 13457, 180, -180, 60,
+        TZ_TRANSITION(10, 2, 6, 0), TZ_TRANSITION(2, 5, 5, 1380) },
+    { 13926, 120, -180, 60,
+        TZ_TRANSITION(10, 3, 6, 0), TZ_TRANSITION(2, 3, 6, -60) },
+    { 15389, 120, -180, 60,
+        TZ_TRANSITION(10, 3, 6, 0), TZ_TRANSITION(2, 5, 5, 1380) },
+    { 15753, 120, -180, 60,
+        TZ_TRANSITION(10, 3, 6, 0), TZ_TRANSITION(2, 3, 5, 1380) },
+    { 17825, 180, -180, 60,
+        TZ_TRANSITION(11, 0, 4, 0), TZ_TRANSITION(2, 3, 5, 1380) },
+    { 18204, 180, -180, 0, TZ_NO_DST },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_ASIA_KOLKATA
+static const struct tz_rule tz_asia_kolkata[1] = {
+    { 0, 0, 330, 0, TZ_NO_DST },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_EUROPE_LONDON
+static const struct tz_rule tz_europe_london[5] = {
+    { 0, 0, 60, 0, TZ_NO_DST },
+    { 668, 120, 0, 60,
+        TZ_TRANSITION(3, 3, 5, 1560), TZ_TRANSITION(10, 4, 5, 1560) },
+    { 4098, 120, 0, 60,
+        TZ_TRANSITION(3, 5, 6, 60), TZ_TRANSITION(10, 4, 5, 1500) },
+    { 9425, 60, 0, 60,
+        TZ_TRANSITION(3, 5, 6, 60), TZ_TRANSITION(10, 4, 6, 60) },
+    { 10888, 60, 0, 60,
+        TZ_TRANSITION(3, 5, 6, 60), TZ_TRANSITION(10, 5, 6, 60) },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_EUROPE_DUBLIN
+static const struct tz_rule tz_europe_dublin[5] = {
+    { 0, 0, 60, 0, TZ_NO_DST },
+    { 668, 120, 0, 60,
+        TZ_TRANSITION(3, 3, 5, 1560), TZ_TRANSITION(10, 4, 5, 1560) },
+    { 4098, 120, 0, 60,
+        TZ_TRANSITION(3, 5, 6, 60), TZ_TRANSITION(10, 4, 5, 1500) },
+    { 9425, 60, 0, 60,
+        TZ_TRANSITION(3, 5, 6, 60), TZ_TRANSITION(10, 4, 6, 60) },
+    { 10888, 60, 0, 60,
+        TZ_TRANSITION(3, 5, 6, 60), TZ_TRANSITION(10, 5, 6, 60) },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_AUSTRALIA_LORD_HOWE
+static const struct tz_rule tz_australia_lord_howe[12] = {
+    { 0, 0, 600, 0, TZ_NO_DST },
+    { 4076, 840, 630, 0, TZ_NO_DST },
+    { 4314, 930, 630, 60,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 1, 6, 60) },
+    { 5777, 930, 630, 30,
+        TZ_TRANSITION(10, 0, 19, 120), TZ_TRANSITION(3, 3, 6, 90) },
+    { 6499, 930, 630, 30,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 3, 6, 90) },
+    { 7366, 900, 630, 30,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 1, 6, 90) },
+    { 9557, 900, 630, 30,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 5, 6, 90) },
+    { 11195, 930, 660, 0, TZ_NO_DST },
+    { 11405, 900, 630, 30,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(3, 5, 6, 90) },
+    { 13232, 900, 630, 30,
+        TZ_TRANSITION(10, 5, 6, 120), TZ_TRANSITION(4, 1, 6, 90) },
+    { 13596, 900, 630, 0, TZ_NO_DST },
+    { 13813, 930, 630, 30,
+        TZ_TRANSITION(10, 1, 6, 120), TZ_TRANSITION(4, 1, 6, 90) },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_ASIA_KATHMANDU
+static const struct tz_rule tz_asia_kathmandu[2] = {
+    { 0, 0, 330, 0, TZ_NO_DST },
+    { 5843, 1110, 345, 0, TZ_NO_DST },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_AFRICA_CASABLANCA
+static const struct tz_rule tz_africa_casablanca[69] = {
+    { 0, 0, 0, 0, TZ_NO_DST },
+    { 1635, 0, 0, 60,
+        TZ_TRANSITION(5, 1, 5, 0), TZ_TRANSITION(8, 5, 5, 1380) },
+    { 1948, 0, 0, 0, TZ_NO_DST },
+    { 2312, 0, 0, 60,
+        TZ_TRANSITION(5, 0, 1, 0), TZ_TRANSITION(8, 1, 6, -60) },
+    { 2774, 1380, 0, 60,
+        TZ_TRANSITION(6, 1, 3, 0), TZ_TRANSITION(9, 5, 1, 1380) },
+    { 3136, 1380, 0, 0, TZ_NO_DST },
+    { 5188, 0, 60, 0, TZ_NO_DST },
+    { 5843, 1380, 0, 0, TZ_NO_DST },
+    { 14031, 0, 0, 60,
+        TZ_TRANSITION(6, 0, 1, 0), TZ_TRANSITION(8, 5, 6, 1380) },
+    { 14476, 1380, 0, 60,
+        TZ_TRANSITION(5, 1, 6, 0), TZ_TRANSITION(8, 1, 5, 1380) },
+    { 15067, 0, 60, 0, TZ_NO_DST },
+    { 15185, 1380, 0, 60,
+        TZ_TRANSITION(4, 5, 6, 120), TZ_TRANSITION(7, 3, 4, 120) },
+    { 15572, 120, 0, 60,
+        TZ_TRANSITION(4, 5, 6, 120), TZ_TRANSITION(9, 5, 6, 120) },
+    { 15893, 120, 0, 60,
+        TZ_TRANSITION(8, 2, 5, 120), TZ_TRANSITION(10, 5, 6, 120) },
+    { 16159, 120, 0, 60,
+        TZ_TRANSITION(8, 1, 5, 120), TZ_TRANSITION(6, 5, 5, 120) },
+    { 16369, 120, 0, 60,
+        TZ_TRANSITION(3, 5, 6, 120), TZ_TRANSITION(6, 2, 6, 120) },
+    { 16635, 120, 0, 60,
+        TZ_TRANSITION(3, 5, 6, 120), TZ_TRANSITION(10, 5, 6, 120) },
+    { 16957, 120, 0, 60,
+        TZ_TRANSITION(7, 2, 6, 120), TZ_TRANSITION(10, 5, 6, 120) },
+    { 17251, 120, 0, 60,
+        TZ_TRANSITION(7, 1, 6, 120), TZ_TRANSITION(5, 3, 6, 120) },
+    { 17468, 120, 0, 60,
+        TZ_TRANSITION(3, 5, 6, 120), TZ_TRANSITION(5, 2, 6, 120) },
+    { 17699, 120, 0, 60,
+        TZ_TRANSITION(6, 2, 6, 120), TZ_TRANSITION(5, 1, 6, 120) },
+    { 18371, 120, 0, 60,
+        TZ_TRANSITION(5, 5, 6, 120), TZ_TRANSITION(4, 2, 6, 120) },
+    { 18763, 120, 0, 60,
+        TZ_TRANSITION(5, 2, 6, 120), TZ_TRANSITION(3, 5, 6, 120) },
+    { 19435, 120, 0, 60,
+        TZ_TRANSITION(4, 4, 6, 120), TZ_TRANSITION(3, 2, 6, 120) },
+    { 19827, 120, 0, 60,
+        TZ_TRANSITION(4, 1, 6, 120), TZ_TRANSITION(2, 5, 6, 120) },
+    { 20499, 120, 0, 60,
+        TZ_TRANSITION(3, 4, 6, 120), TZ_TRANSITION(2, 1, 6, 120) },
+    { 20891, 120, 0, 60,
+        TZ_TRANSITION(3, 1, 6, 120), TZ_TRANSITION(1, 4, 6, 120) },
+    { 21563, 120, 0, 60,
+        TZ_TRANSITION(2, 3, 6, 120), TZ_TRANSITION(12, 5, 6, 120) },
+    { 21955, 120, 0, 60,
+        TZ_TRANSITION(1, 5, 6, 120), TZ_TRANSITION(12, 4, 6, 120) },
+    { 22627, 120, 0, 60,
+        TZ_TRANSITION(1, 3, 6, 120), TZ_TRANSITION(11, 5, 6, 120) },
+    { 23019, 120, 0, 60,
+        TZ_TRANSITION(12, 5, 6, 120), TZ_TRANSITION(11, 3, 6, 120) },
+    { 23684, 120, 0, 60,
+        TZ_TRANSITION(12, 3, 6, 120), TZ_TRANSITION(10, 5, 6, 120) },
+    { 24083, 120, 0, 60,
+        TZ_TRANSITION(11, 4, 6, 120), TZ_TRANSITION(10, 3, 6, 120) },
+    { 24748, 120, 0, 60,
+        TZ_TRANSITION(11, 3, 6, 120), TZ_TRANSITION(9, 5, 6, 120) },
+    { 25140, 120, 0, 60,
+        TZ_TRANSITION(10, 4, 6, 120), TZ_TRANSITION(9, 3, 6, 120) },
+    { 25812, 120, 0, 60,
+        TZ_TRANSITION(10, 2, 6, 120), TZ_TRANSITION(8, 5, 6, 120) },
+    { 26204, 120, 0, 60,
+        TZ_TRANSITION(9, 3, 6, 120), TZ_TRANSITION(8, 2, 6, 120) },
+    { 26876, 120, 0, 60,
+        TZ_TRANSITION(9, 2, 6, 120), TZ_TRANSITION(7, 4, 6, 120) },
+    { 27268, 120, 0, 60,
+        TZ_TRANSITION(8, 3, 6, 120), TZ_TRANSITION(7, 2, 6, 120) },
+    { 27940, 120, 0, 60,
+        TZ_TRANSITION(8, 1, 6, 120), TZ_TRANSITION(6, 4, 6, 120) },
+    { 28332, 120, 0, 60,
+        TZ_TRANSITION(7, 3, 6, 120), TZ_TRANSITION(6, 1, 6, 120) },
+    { 29004, 120, 0, 60,
+        TZ_TRANSITION(7, 1, 6, 120), TZ_TRANSITION(5, 3, 6, 120) },
+    { 29396, 120, 0, 60,
+        TZ_TRANSITION(6, 3, 6, 120), TZ_TRANSITION(5, 1, 6, 120) },
+    { 30068, 120, 0, 60,
+        TZ_TRANSITION(6, 1, 6, 120), TZ_TRANSITION(4, 2, 6, 120) },
+    { 30460, 120, 0, 60,
+        TZ_TRANSITION(5, 2, 6, 120), TZ_TRANSITION(4, 1, 6, 120) },
+    { 31132, 120, 0, 60,
+        TZ_TRANSITION(5, 1, 6, 120), TZ_TRANSITION(3, 2, 6, 120) },
+    { 31524, 120, 0, 60,
+        TZ_TRANSITION(4, 2, 6, 120), TZ_TRANSITION(3, 1, 6, 120) },
+    { 32189, 120, 0, 60,
+        TZ_TRANSITION(3, 5, 6, 120), TZ_TRANSITION(2, 2, 6, 120) },
+    { 32588, 120, 0, 60,
+        TZ_TRANSITION(3, 1, 6, 120), TZ_TRANSITION(2, 1, 6, 120) },
+    { 33253, 120, 0, 60,
+        TZ_TRANSITION(2, 5, 6, 120), TZ_TRANSITION(1, 2, 6, 120) },
+    { 33645, 120, 0, 60,
+        TZ_TRANSITION(2, 1, 6, 120), TZ_TRANSITION(12, 5, 6, 120) },
+    { 34317, 120, 0, 60,
+        TZ_TRANSITION(1, 5, 6, 120), TZ_TRANSITION(12, 1, 6, 120) },
+    { 34709, 120, 0, 60,
+        TZ_TRANSITION(1, 1, 6, 120), TZ_TRANSITION(11, 4, 6, 120) },
+    { 35381, 120, 0, 60,
+        TZ_TRANSITION(12, 5, 6, 120), TZ_TRANSITION(11, 1, 6, 120) },
+    { 35773, 120, 0, 60,
+        TZ_TRANSITION(12, 1, 6, 120), TZ_TRANSITION(10, 3, 6, 120) },
+    { 36445, 120, 0, 60,
+        TZ_TRANSITION(11, 3, 6, 120), TZ_TRANSITION(10, 1, 6, 120) },
+    { 36837, 120, 0, 60,
+        TZ_TRANSITION(11, 1, 6, 120), TZ_TRANSITION(9, 3, 6, 120) },
+    { 37509, 120, 0, 60,
+        TZ_TRANSITION(10, 3, 6, 120), TZ_TRANSITION(8, 5, 6, 120) },
+    { 37901, 120, 0, 60,
+        TZ_TRANSITION(9, 5, 6, 120), TZ_TRANSITION(8, 3, 6, 120) },
+    { 38573, 120, 0, 60,
+        TZ_TRANSITION(9, 3, 6, 120), TZ_TRANSITION(7, 5, 6, 120) },
+    { 38965, 120, 0, 60,
+        TZ_TRANSITION(8, 4, 6, 120), TZ_TRANSITION(7, 3, 6, 120) },
+    { 39637, 120, 0, 60,
+        TZ_TRANSITION(8, 2, 6, 120), TZ_TRANSITION(6, 5, 6, 120) },
+    { 40029, 120, 0, 60,
+        TZ_TRANSITION(7, 3, 6, 120), TZ_TRANSITION(6, 3, 6, 120) },
+    { 40694, 120, 0, 60,
+        TZ_TRANSITION(7, 2, 6, 120), TZ_TRANSITION(5, 4, 6, 120) },
+    { 41086, 120, 0, 60,
+        TZ_TRANSITION(6, 3, 6, 120), TZ_TRANSITION(5, 3, 6, 120) },
+    { 41758, 120, 0, 60,
+        TZ_TRANSITION(6, 2, 6, 120), TZ_TRANSITION(4, 4, 6, 120) },
+    { 42150, 120, 0, 60,
+        TZ_TRANSITION(5, 3, 6, 120), TZ_TRANSITION(4, 2, 6, 120) },
+    { 42822, 120, 0, 0, TZ_NO_DST },
+    { 42864, 120, 60, 0, TZ_NO_DST },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES) || TIME_ZONE == TZ_AMERICA_SANTIAGO
+static const struct tz_rule tz_america_santiago[22] = {
+    { 0, 0, -240, 60,
+        TZ_TRANSITION(10, 2, 6, 0), TZ_TRANSITION(3, 5, 5, 1380) },
+    { 437, 180, -240, 60,
+        TZ_TRANSITION(10, 2, 5, 1440), TZ_TRANSITION(3, 2, 5, 1380) },
+    { 1368, 240, -180, 0, TZ_NO_DST },
+    { 1529, 180, -240, 60,
+        TZ_TRANSITION(10, 2, 5, 1440), TZ_TRANSITION(3, 2, 5, 1380) },
+    { 6282, 180, -240, 60,
+        TZ_TRANSITION(10, 2, 6, 0), TZ_TRANSITION(4, 2, 5, 1380) },
+    { 6646, 180, -240, 60,
+        TZ_TRANSITION(10, 2, 5, 1440), TZ_TRANSITION(3, 2, 5, 1380) },
+    { 7563, 240, -180, 0, TZ_NO_DST },
+    { 7738, 180, -240, 60,
+        TZ_TRANSITION(10, 2, 5, 1440), TZ_TRANSITION(3, 2, 4, 2820) },
+    { 9936, 180, -240, 60,
+        TZ_TRANSITION(10, 2, 6, 0), TZ_TRANSITION(3, 5, 5, 1380) },
+    { 10300, 180, -240, 0, TZ_NO_DST },
+    { 10496, 240, -180, 0, TZ_NO_DST },
+    { 10685, 180, -240, 60,
+        TZ_TRANSITION(10, 2, 5, 1440), TZ_TRANSITION(3, 2, 5, 1380) },
+    { 13947, 180, -240, 60,
+        TZ_TRANSITION(10, 2, 6, 0), TZ_TRANSITION(3, 5, 5, 1380) },
+    { 14318, 180, -240, 0, TZ_NO_DST },
+    { 14528, 240, -240, 60,
+        TZ_TRANSITION(10, 2, 6, 0), TZ_TRANSITION(4, 0, 3, 1380) },
+    { 15068, 180, -240, 60,
+        TZ_TRANSITION(8, 3, 6, 0), TZ_TRANSITION(5, 1, 5, 1380) },
+    { 15459, 180, -240, 60,
+        TZ_TRANSITION(9, 1, 5, 1440), TZ_TRANSITION(4, 5, 5, 1380) },
+    { 16551, 180, -180, 0, TZ_NO_DST },
+    { 16936, 180, -240, 60,
+        TZ_TRANSITION(8, 2, 6, 0), TZ_TRANSITION(5, 2, 5, 1380) },
+    { 17993, 180, -240, 60,
+        TZ_TRANSITION(9, 1, 5, 1440), TZ_TRANSITION(4, 1, 5, 1380) },
+    { 19239, 240, -240, 60,
+        TZ_TRANSITION(9, 2, 6, 0), TZ_TRANSITION(4, 1, 5, 1380) },
+    { 19603, 240, -240, 60,
+        TZ_TRANSITION(9, 1, 5, 1440), TZ_TRANSITION(4, 1, 5, 1380) },
+};
+#endif
+
+#if defined(TZ_ALL_ZONES)
+const struct tz_zone tz_zones[TZ_ZONE_COUNT] = {
+    { "Europe/Paris", tz_europe_paris, 6 },
+    { "America/New_York", tz_america_new_york, 6 },
+    { "Australia/Sydney", tz_australia_sydney, 14 },
+    { "Pacific/Auckland", tz_pacific_auckland, 5 },
+    { "America/Sao_Paulo", tz_america_sao_paulo, 24 },
+    { "Asia/Kolkata", tz_asia_kolkata, 1 },
+    { "Europe/London", tz_europe_london, 5 },
+    { "Europe/Dublin", tz_europe_dublin, 5 },
+    { "Australia/Lord_Howe", tz_australia_lord_howe, 12 },
+    { "Asia/Kathmandu", tz_asia_kathmandu, 2 },
+    { "Africa/Casablanca", tz_africa_casablanca, 69 },
+    { "America/Santiago", tz_america_santiago, 22 },
+};
+#else
+#if TIME_ZONE == TZ_EUROPE_PARIS
+#define TZ_ZONE_RULES tz_europe_paris
+#elif TIME_ZONE == TZ_AMERICA_NEW_YORK
+#define TZ_ZONE_RULES tz_america_new_york
+#elif TIME_ZONE == TZ_AUSTRALIA_SYDNEY
+#define TZ_ZONE_RULES tz_australia_sydney
+#elif TIME_ZONE == TZ_PACIFIC_AUCKLAND
+#define TZ_ZONE_RULES tz_pacific_auckland
+#elif TIME_ZONE == TZ_AMERICA_SAO_PAULO
+#define TZ_ZONE_RULES tz_america_sao_paulo
+#elif TIME_ZONE == TZ_ASIA_KOLKATA
+#define TZ_ZONE_RULES tz_asia_kolkata
+#elif TIME_ZONE == TZ_EUROPE_LONDON
+#define TZ_ZONE_RULES tz_europe_london
+#elif TIME_ZONE == TZ_EUROPE_DUBLIN
+#define TZ_ZONE_RULES tz_europe_dublin
+#elif TIME_ZONE == TZ_AUSTRALIA_LORD_HOWE
+#define TZ_ZONE_RULES tz_australia_lord_howe
+#elif TIME_ZONE == TZ_ASIA_KATHMANDU
+#define TZ_ZONE_RULES tz_asia_kathmandu
+#elif TIME_ZONE == TZ_AFRICA_CASABLANCA
+#define TZ_ZONE_RULES tz_africa_casablanca
+#elif TIME_ZONE == TZ_AMERICA_SANTIAGO
+#define TZ_ZONE_RULES tz_america_santiago
+#else
+#error "TIME_ZONE (settings.h) is not a zone of tzdata.h"
+#endif
+
+const struct tz_rule *const tz_zone_rules = TZ_ZONE_RULES;
+const uint8_t tz_zone_rule_count =
+    sizeof(TZ_ZONE_RULES) / sizeof(TZ_ZONE_RULES[0]);
+#endif
@@ -0,0 +1,46 @@
+// 150189-71 Nixie Clock alternative firmware
+// Distributed under the terms of the MIT license.
+
+// Time zone rule tables, generated by tests/tzcompile from the IANA time zone
+// database (version 2025b). Do not edit; run "make tzdata" in tests/ instead.
+
+#ifndef TZDATA_H
+#define TZDATA_H
+
+#include "datetime.h"
+
+// Zones, for TIME_ZONE in settings.h
+#define TZ_EUROPE_PARIS 1 // Europe/Paris
+#define TZ_AMERICA_NEW_YORK 2 // America/New_York
+#define TZ_AUSTRALIA_SYDNEY 3 // Australia/Sydney
+#define TZ_PACIFIC_AUCKLAND 4 // Pacific/Auckland
+#define TZ_AMERICA_SAO_PAULO 5 // America/Sao_Paulo
+#define TZ_ASIA_KOLKATA 6 // Asia/Kolkata
+#define TZ_EUROPE_LONDON 7 // Europe/London
+#define TZ_EUROPE_DUBLIN 8 // Europe/Dublin
+#define TZ_AUSTRALIA_LORD_HOWE 9 // Australia/Lord_Howe
+#define TZ_ASIA_KATHMANDU 10 // Asia/Kathmandu
+#define TZ_AFRICA_CASABLANCA 11 // Africa/Casablanca
+#define TZ_AMERICA_SANTIAGO 12 // America/Santiago
+
+#define TZ_ZONE_COUNT 12
+
+#if defined(TZ_ALL_ZONES)
+// Version of the database (host tests)
+#define TZDATA_VERSION "2025b"
+
+// All the zones (host tests)
+struct tz_zone {
+    const char *name;
+    const struct tz_rule *rules;
+    uint8_t rule_count;
+};
+
+extern const struct tz_zone tz_zones[TZ_ZONE_COUNT];
+#else
+// Rules of the zone selected by TIME_ZONE
+extern const struct tz_rule *const tz_zone_rules;
+extern const uint8_t tz_zone_rule_count;
+#endif
+
+#endif